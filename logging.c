@@ -10,6 +10,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include "logging.h"
+#include "logging_fmt.h"
+#include "logging_ctrl.h"
 
 /* #define LOGGING_DBG */
 #ifdef LOGGING_DBG
@@ -22,27 +24,626 @@
  * @brief logging configuration structure
  */
 typedef struct {
-  uint8_t time_set;                /**< Boolean value indicating if logging is fed by wall clock  */
-  int     min_level;               /**< Logging level threshold, logging with higher priority will be logged out*/
-  size_t  offset;                  /**< Internal offset for logging buffer  */
-  char    buf[LOGGING_BUF_LENGTH]; /**< Buffer to logging message  */
+  uint8_t       time_set;                /**< Boolean value indicating if logging is fed by wall clock  */
+  uint8_t       interfaces;              /**< Bitmask of the interfaces in use */
+  int           min_level;               /**< Logging level threshold, logging with higher priority will be logged out*/
 }lcfg_t;
 
+/**
+ * @brief record captured by the flight recorder
+ */
+typedef struct {
+  const char   *file_name;              /**< File name of the call site */
+  const char   *fmt;                    /**< Format string */
+  unsigned int line;                    /**< Line of the call site */
+  uint8_t      lvl;                     /**< Logging level */
+  uint8_t      len;                     /**< Bytes of packed parameters */
+  uint8_t      args[RECORDER_ARG_SIZE]; /**< Parameters packed by lfmt_vpack() */
+}lrecorded_t;
+
+/* Largest frame of COMPRESS_ON, the head, half the window incompressible and the CRC */
+#define LZ_HEAD_MAX           6
+#define LZ_OUT_SIZE           (LZ_HEAD_MAX + COMPRESS_WINDOW / 2 + COMPRESS_WINDOW / 510 + 16 + 1)
+
+/**
+ * @brief state of the record being logged, one per execution context if
+ * RTT_PER_CONTEXT is set
+ */
+typedef struct {
+  lfmt_stream_t out;                     /**< Output stream of the record being logged */
+  char          buf[LOGGING_BUF_LENGTH]; /**< Buffer to stream the logging message chunk by chunk */
+  uint8_t       resync;                  /**< Boolean value indicating if the last record was cut short, so the next one starts on a new line */
+#if (LOGGING_INTERFACE == INTERFACE_BOTH)
+  uint8_t       failed;                  /**< Bitmask of the interfaces which didn't accept the record so far */
+#endif
+#if (RTT_PER_CONTEXT != 0)
+  uint8_t       channel;                 /**< RTT up-buffer of the context */
+  uint32_t      seq;                     /**< Sequence number of the next record */
+#endif
+#if (RTT_STALL_WRITES > 0)
+  unsigned      stall_rd;                /**< Read offset of the up-buffer when the last record found it full */
+  unsigned      stall_cnt;               /**< Records in a row which found the up-buffer full at stall_rd */
+  uint8_t       stalled;                 /**< Boolean value indicating if the reader is taken as stalled */
+  uint32_t      skipped;                 /**< Records skipped since the reader stalled */
+#if (RTT_STALL_RECORDER != 0)
+  lrecorded_t   rec[RECORDER_NUM];       /**< Flight recorder */
+  uint16_t      rec_head;                /**< Slot of the next record in the flight recorder */
+  uint16_t      rec_num;                 /**< Records in the flight recorder */
+#endif
+#endif
+#if (RTT_TRIM_ON != 0)
+  size_t        head;                    /**< Bytes of the record which must not be trimmed */
+  uint8_t       trimmed;                 /**< Boolean value indicating if the record has been trimmed */
+#endif
+#if (ADAPTIVE_ON != 0)
+  uint8_t       shed;                    /**< Levels shed from the threshold because of the transport fill */
+  uint16_t      hold;                    /**< Calls left before a level can be restored */
+#endif
+#if (COMPRESS_ON != 0)
+  uint8_t       zhist[COMPRESS_WINDOW];  /**< History of the compressor, followed by the bytes not compressed yet */
+  uint8_t       zout[LZ_OUT_SIZE];       /**< Frame being sent */
+  uint16_t      ztab[1u << COMPRESS_HASH_BITS]; /**< Position plus one in zhist of the last 4 bytes by hash, 0 if none */
+  uint16_t      zlen;                    /**< Bytes in zhist */
+  uint16_t      zstart;                  /**< First byte of zhist not compressed yet */
+  uint16_t      zframes;                 /**< Frames sent since the history was dropped, 0 to drop it */
+  uint8_t       zseq;                    /**< Sequence number of the next frame */
+#endif
+}lrec_t;
+
 #if (LOGGING_CONFIG > LIGHT_WEIGHT)
 
 /* Defines  *********************************************************** */
 
+#if (RTT_PER_CONTEXT != 0)
+#if !(LOGGING_INTERFACE & SEGGER_RTT)
+#error "RTT_PER_CONTEXT requires SEGGER_RTT in LOGGING_INTERFACE"
+#endif
+#if (RTT_CONTEXT_CHANNEL + LOGGING_CONTEXT_NUM - 1 > SEGGER_RTT_MAX_NUM_UP_BUFFERS)
+#error "Not enough RTT up-buffers for RTT_PER_CONTEXT, raise SEGGER_RTT_MAX_NUM_UP_BUFFERS"
+#endif
+#if (CTRL_ON != 0) && (CTRL_CHANNEL >= RTT_CONTEXT_CHANNEL) \
+  && (CTRL_CHANNEL < RTT_CONTEXT_CHANNEL + LOGGING_CONTEXT_NUM - 1)
+#error "CTRL_CHANNEL overlaps the RTT_PER_CONTEXT up-buffers"
+#endif
+#define LREC_NUM              LOGGING_CONTEXT_NUM
+#define RTT_WRITE(r, str, len) SEGGER_RTT_WriteSingleProducer((r)->channel, (str), (len))
+#elif (RTT_SINGLE_PRODUCER != 0)
+#define LREC_NUM              1
+#define RTT_WRITE(r, str, len) SEGGER_RTT_WriteSingleProducer(0, (str), (len))
+#else
+#define LREC_NUM              1
+#define RTT_WRITE(r, str, len) SEGGER_RTT_Write(0, (str), (len))
+#endif
+
+#if (RTT_STALL_WRITES > 0) && !(LOGGING_INTERFACE & SEGGER_RTT)
+#error "RTT_STALL_WRITES requires SEGGER_RTT in LOGGING_INTERFACE"
+#endif
+#if (ADAPTIVE_ON != 0) && !(LOGGING_INTERFACE & SEGGER_RTT) && !defined(LOGGING_TRANSPORT_FILL)
+#error "ADAPTIVE_ON requires SEGGER_RTT in LOGGING_INTERFACE or LOGGING_TRANSPORT_FILL()"
+#endif
+
+#if (RTT_TRIM_ON != 0) && !(LOGGING_INTERFACE & SEGGER_RTT)
+#error "RTT_TRIM_ON requires SEGGER_RTT in LOGGING_INTERFACE"
+#endif
+
+#if (COMPACT_ON != 0) && (JSON_ON != 0)
+#error "COMPACT_ON and JSON_ON are exclusive"
+#endif
+
+#if (COMPRESS_ON != 0)
+#if (RTT_TRIM_ON != 0)
+#error "COMPRESS_ON and RTT_TRIM_ON are exclusive"
+#endif
+#if (COMPRESS_WINDOW < 64) || (COMPRESS_WINDOW > 16384)
+#error "COMPRESS_WINDOW must be in range [64, 16384]"
+#endif
+#if (COMPRESS_HASH_BITS < 4) || (COMPRESS_HASH_BITS > 14)
+#error "COMPRESS_HASH_BITS must be in range [4, 14]"
+#endif
+#define LZ_MIN_MATCH          4
+#define LZ_PENDING_MAX        (COMPRESS_WINDOW / 2)
+#define LZ_HASH(seq)          ((uint32_t)((seq) * 2654435761u) >> (32 - COMPRESS_HASH_BITS))
+#endif
+
+/* RTT up-buffer of a record */
+#if (RTT_PER_CONTEXT != 0)
+#define RTT_CHANNEL(r)        ((r)->channel)
+#else
+#define RTT_CHANNEL(r)        0
+#endif
+#define RTT_UP(r)             (&_SEGGER_RTT.aUp[RTT_CHANNEL(r)])
+
+/* Clock sources of the profiler and the record timestamps */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define DEMCR                   (*(volatile uint32_t *)0xE000EDFCu)
+#define DWT_CTRL                (*(volatile uint32_t *)0xE0001000u)
+#define DWT_CYCCNT              (*(volatile uint32_t *)0xE0001004u)
+#define CYCCNT_INIT()                       \
+  do {                                      \
+    DEMCR     |= (1u << 24); /* TRCENA */   \
+    DWT_CYCCNT = 0;                         \
+    DWT_CTRL  |= 1u;         /* CYCCNTENA */\
+  } while (0)
+#elif defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+static inline uint64_t _monotonic_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+#if defined(CYCCNT_INIT) && ((PROFILE_ON != 0) || (RTT_PER_CONTEXT != 0) || (JSON_ON != 0) \
+  || (BINARY_ON != 0))
+#define CLOCK_INIT()            CYCCNT_INIT()
+#else
+#define CLOCK_INIT()
+#endif
+
+#if (RTT_PER_CONTEXT != 0) || (JSON_ON != 0) || (BINARY_ON != 0)
+#if defined(LOGGING_TIMESTAMP)
+#define RECORD_TIMESTAMP()      ((uint64_t)LOGGING_TIMESTAMP())
+#elif defined(DWT_CYCCNT)
+#define RECORD_TIMESTAMP()      ((uint64_t)DWT_CYCCNT)
+#elif defined(__unix__) || defined(__APPLE__)
+#define RECORD_TIMESTAMP()      _monotonic_ns()
+#else
+#error "No timestamp for RTT_PER_CONTEXT, JSON_ON or BINARY_ON, define LOGGING_TIMESTAMP()"
+#endif
+#endif
+
+/* Ticks per second of RECORD_TIMESTAMP(), 0 if unknown */
+#if !defined(LOGGING_TIMESTAMP_HZ)
+#if !defined(LOGGING_TIMESTAMP) && !defined(DWT_CYCCNT) && (defined(__unix__) || defined(__APPLE__))
+#define LOGGING_TIMESTAMP_HZ    1000000000u
+#else
+#define LOGGING_TIMESTAMP_HZ    0
+#endif
+#endif
+
 /* Global Variables *************************************************** */
 
 /* Static Variables *************************************************** */
-static lcfg_t lcfg = { 0 };
+static lcfg_t lcfg = { .interfaces = LOGGING_INTERFACE };
+static lrec_t lrec[LREC_NUM];
+#if (RTT_PER_CONTEXT != 0) && (LOGGING_CONTEXT_NUM > 1)
+static char   lrec_rtt[LOGGING_CONTEXT_NUM - 1][RTT_CONTEXT_BUF_SIZE];
+#endif
+
+#if (MODULE_FILTER_NUM > 0)
+/**
+ * @brief level threshold override of a module
+ */
+typedef struct {
+  uint32_t hash;  /**< Hash of the module name */
+  uint8_t  level; /**< Level threshold */
+}module_filter_t;
+
+static module_filter_t lmodules[MODULE_FILTER_NUM];
+static uint8_t         lmodule_num;
+#endif
+
+#if (SITE_FILTER_NUM > 0)
+static uint32_t lsites[SITE_FILTER_NUM]; /**< Hashes of the disabled call sites */
+static uint8_t  lsite_num;
+#endif
+
+#if (STATS_ON != 0)
+static logging_stats_t lstats[LOGGING_CONTEXT_NUM];
+#define STATS_ADD(st, field, n) ((st)->field += (n))
+#else
+#define STATS_ADD(st, field, n)
+#endif
+
+#if (PROFILE_ON != 0)
+/**
+ * @brief stages of __log() timed by the profiler
+ */
+enum {
+  PROFILE_FILTER,
+  PROFILE_TIME,
+  PROFILE_FILE_LINE,
+  PROFILE_LEVEL,
+  PROFILE_FORMAT,
+  PROFILE_OUTPUT,
+  PROFILE_STAGE_NUM
+};
+
+static const char *const profile_stage_names[PROFILE_STAGE_NUM] = {
+  "filter", "time", "file_line", "level", "format", "output"
+};
+
+static uint32_t lprof[PROFILE_STAGE_NUM][LOGGING_LEVEL_NUM][PROFILE_BUCKET_NUM];
+
+#if defined(LOGGING_CYCLES)
+#define PROFILE_CYCLES()        LOGGING_CYCLES()
+#elif defined(DWT_CYCCNT)
+#define PROFILE_CYCLES()        DWT_CYCCNT
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_CYCLES()        ((uint32_t)__rdtsc())
+#elif defined(__unix__) || defined(__APPLE__)
+#define PROFILE_CYCLES()        ((uint32_t)_monotonic_ns())
+#else
+#error "No cycle counter for PROFILE_ON, define LOGGING_CYCLES()"
+#endif
+
+/* Stage timing, the macros expand to nothing if PROFILE_ON is 0 */
+#define PROFILE_START()         uint32_t prof_mark__ = PROFILE_CYCLES()
+#define PROFILE_STAGE(stage, lvl) _profile_stage((stage), (lvl), &prof_mark__)
+#else
+#define PROFILE_START()
+#define PROFILE_STAGE(stage, lvl)
+#endif
+
+#if (WATERMARK_ON != 0)
+static logging_watermark_t lwm;
+#endif
+
+#if (PROFILE_ON != 0) || (ADAPTIVE_ON != 0) || (JSON_ON != 0)
+static const char lvl_names[LOGGING_LEVEL_NUM][4] = {
+  "FTL", "ERR", "WRN", "IPM", "DHL", "DBG", "VER"
+};
+#endif
+
+#if (WATERMARK_ON != 0) && (WATERMARK_STACK_PROBE > 0) \
+  && (defined(__GNUC__) || defined(__clang__))
+#define STACK_PROBE_WORDS   (WATERMARK_STACK_PROBE / sizeof(uint32_t))
+#define STACK_PROBE_PATTERN 0xC0FFEE5Au
+#define STACK_PAINT()       _stack_probe(1)
+#define STACK_CHECK()                                 \
+  do {                                                \
+    uint32_t used__ = _stack_probe(0);                \
+    lwm.stack_peak = MAX(lwm.stack_peak, used__);     \
+  } while (0)
+#else
+#define STACK_PAINT()
+#define STACK_CHECK()
+#endif
 
 /* Static Functions Declaractions ************************************* */
 
+/**
+ * @brief _context_id get the index of the current execution context
+ *
+ * @return index in range [0, LOGGING_CONTEXT_NUM), or above for host threads
+ * beyond LOGGING_CONTEXT_NUM with RTT_PER_CONTEXT
+ */
+static inline unsigned _context_id(void)
+{
+#if defined(LOGGING_CONTEXT_ID)
+  return LOGGING_CONTEXT_ID();
+#elif (defined(__GNUC__) || defined(__clang__))                     \
+  && (defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_7M__)          \
+  || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_BASE__)     \
+  || defined(__ARM_ARCH_8M_MAIN__))
+  uint32_t ipsr;
+
+  __asm volatile ("mrs %0, ipsr" : "=r" (ipsr));
+  return (ipsr != 0 && LOGGING_CONTEXT_NUM > 1) ? 1 : 0;
+#elif (RTT_PER_CONTEXT != 0) && (defined(__GNUC__) || defined(__clang__))
+  /* Every thread is a context, numbered in order of their first log */
+  static unsigned          next;
+  static __thread unsigned id;
+
+  if (!id) {
+    id = __atomic_add_fetch(&next, 1, __ATOMIC_RELAXED);
+  }
+  return id - 1;
+#else
+  return 0;
+#endif
+}
+
+#if (STATS_ON != 0)
+/**
+ * @brief _stats_slot get the counters of the current context for a level
+ *
+ * @param lvl - logging level, out of range values are clamped
+ *
+ * @return pointer to the counters
+ */
+static inline logging_level_stats_t *_stats_slot(int lvl)
+{
+  if (lvl < LOGGING_FATAL) {
+    lvl = LOGGING_FATAL;
+  } else if (lvl > LOGGING_VERBOSE) {
+    lvl = LOGGING_VERBOSE;
+  }
+  return &lstats[MIN(_context_id(), LOGGING_CONTEXT_NUM - 1)].level[lvl];
+}
+#endif
+
+/**
+ * @brief _log2_bucket get the log2 histogram bucket of a value
+ *
+ * @param v - value
+ * @param n - number of buckets
+ *
+ * @return 0 for 0, otherwise the bit width of v, at most n - 1
+ */
+static inline unsigned _log2_bucket(uint32_t v,
+                                    unsigned n)
+{
+  unsigned b;
+
+#if defined(__GNUC__) || defined(__clang__)
+  b = v ? 32 - __builtin_clz(v) : 0;
+#else
+  for (b = 0; v; v >>= 1) {
+    b++;
+  }
+#endif
+  return MIN(b, n - 1);
+}
+
+#if defined(STACK_PROBE_WORDS)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+/**
+ * @brief _stack_probe fill the stack just below the caller with a pattern, or
+ * find how much of it has been overwritten since.
+ *
+ * @note must be called twice from the same frame, first to paint then to
+ * check. It is the same function both times, so the probe covers the same
+ * addresses and only painted words are scanned.
+ *
+ * @param paint - non-zero to paint, zero to check
+ *
+ * @return bytes used, WATERMARK_STACK_PROBE if the whole probe was used, 0
+ * when painting
+ */
+static uint32_t __attribute__((noinline)) _stack_probe(int paint)
+{
+  /* Left uninitialized on purpose, it reads what the callees left behind */
+  volatile uint32_t probe[STACK_PROBE_WORDS];
+  size_t            i;
+
+  if (paint) {
+    for (i = 0; i < STACK_PROBE_WORDS; i++) {
+      probe[i] = STACK_PROBE_PATTERN;
+    }
+    return 0;
+  }
+  /* The stack grows downwards, so the untouched words are the lowest ones */
+  for (i = 0; i < STACK_PROBE_WORDS && probe[i] == STACK_PROBE_PATTERN; i++) {
+  }
+  return (STACK_PROBE_WORDS - i) * sizeof(uint32_t);
+}
+#pragma GCC diagnostic pop
+#endif
+
+#if (WATERMARK_ON != 0)
+/**
+ * @brief _watermark_msg record the size of a rendered message
+ *
+ * @param len - message length before truncation
+ */
+static inline void _watermark_msg(size_t len)
+{
+  lwm.msg_max = MAX(lwm.msg_max, len);
+  lwm.msg_size_hist[_log2_bucket(len, WATERMARK_BUCKET_NUM)]++;
+}
+
+/**
+ * @brief _watermark_rtt sample the fill level of all RTT up-buffers
+ */
+static inline void _watermark_rtt(void)
+{
+#if (LOGGING_INTERFACE & SEGGER_RTT)
+  for (int i = 0; i < SEGGER_RTT_MAX_NUM_UP_BUFFERS; i++) {
+    const SEGGER_RTT_BUFFER_UP *up = &_SEGGER_RTT.aUp[i];
+    unsigned                   rd  = up->RdOff;
+    unsigned                   wr  = up->WrOff;
+    unsigned                   used;
+
+    if (!up->SizeOfBuffer) {
+      continue;
+    }
+    used = wr >= rd ? wr - rd : up->SizeOfBuffer - rd + wr;
+    lwm.rtt_up_peak[i] = MAX(lwm.rtt_up_peak[i], used);
+  }
+#endif
+}
+#define WATERMARK_MSG(len)  _watermark_msg(len)
+#define WATERMARK_RTT()     _watermark_rtt()
+#else
+#define WATERMARK_MSG(len)
+#define WATERMARK_RTT()
+#endif
+
+#if (PROFILE_ON != 0)
+/**
+ * @brief _profile_stage account the cycles since the last mark to a stage
+ *
+ * @param stage - stage of __log() just finished
+ * @param lvl - logging level
+ * @param mark - cycle counter at the end of the previous stage, updated
+ */
+static inline void _profile_stage(unsigned stage,
+                                  int      lvl,
+                                  uint32_t *mark)
+{
+  uint32_t now = PROFILE_CYCLES();
+
+  lvl = lvl < LOGGING_FATAL ? LOGGING_FATAL : MIN(lvl, LOGGING_VERBOSE);
+  lprof[stage][lvl][_log2_bucket(now - *mark, PROFILE_BUCKET_NUM)]++;
+  /* Don't charge the accounting itself to the next stage */
+  *mark = PROFILE_CYCLES();
+}
+#endif
+
+/**
+ * @brief _file_stem find the module name in a file name, which is the file
+ * name without path and extension.
+ *
+ * @param file_name - file name, possibly with path
+ * @param len - output length of the module name
+ *
+ * @return start of the module name
+ */
+static inline const char *_file_stem(const char *file_name,
+                                     size_t     *len)
+{
+  const char *n, *posend;
+
+  n = strrchr(file_name, '/');
+  if (!n) {
+    n = strrchr(file_name, '\\');
+  }
+  n      = (n ? n + 1 : file_name);
+  posend = strchr(n, '.');
+  *len   = posend ? (size_t)(posend - n) : strlen(n);
+  return n;
+}
+
+/* Threshold lowered by the levels shed, never below ADAPTIVE_FLOOR */
+#if (ADAPTIVE_ON != 0)
+#define SHED_LEVEL(min, shed)                                           \
+  ((min) > ADAPTIVE_FLOOR ? MAX((min) - (int)(shed), ADAPTIVE_FLOOR) : (min))
+#define SHED(r)               ((r) ? (r)->shed : 0)
+#else
+#define SHED_LEVEL(min, shed) ((void)(shed), (min))
+#define SHED(r)               0
+#endif
+
+#if (MODULE_FILTER_NUM > 0) || (SITE_FILTER_NUM > 0)
+/**
+ * @brief _hash FNV-1a hash of a block of bytes
+ *
+ * @param h - hash to continue, 2166136261 to start
+ * @param p - bytes
+ * @param len - number of bytes
+ *
+ * @return hash value
+ */
+static uint32_t _hash(uint32_t   h,
+                      const void *p,
+                      size_t     len)
+{
+  const uint8_t *b = p;
+
+  while (len--) {
+    h = (h ^ *b++) * 16777619u;
+  }
+  return h;
+}
+
+/**
+ * @brief _module_hash hash of the module a file belongs to
+ *
+ * @param file_name - file name, possibly with path and extension
+ *
+ * @return hash value
+ */
+static inline uint32_t _module_hash(const char *file_name)
+{
+  size_t     len;
+  const char *stem = _file_stem(file_name ? file_name : "", &len);
+
+  return _hash(2166136261u, stem, len);
+}
+
+/**
+ * @brief _site_hash hash of a call site
+ *
+ * @param module_hash - hash of the module from _module_hash()
+ * @param line - line of the call site
+ *
+ * @return hash value
+ */
+static inline uint32_t _site_hash(uint32_t     module_hash,
+                                  unsigned int line)
+{
+  uint8_t l[4] = { line, line >> 8, line >> 16, line >> 24 };
+
+  return _hash(module_hash, l, sizeof(l));
+}
+
+/**
+ * @brief _filtered check the module and call site filters
+ *
+ * @param file_name - file name of the call site
+ * @param line - line of the call site
+ * @param lvl - logging level
+ * @param shed - levels shed from the threshold, see SHED_LEVEL()
+ *
+ * @return non-zero if the message should be discarded
+ */
+static int _filtered(const char   *file_name,
+                     unsigned int line,
+                     int          lvl,
+                     unsigned     shed)
+{
+  int      min = lcfg.min_level;
+  uint32_t h;
+
+  h = _module_hash(file_name);
+#if (MODULE_FILTER_NUM > 0)
+  for (int i = 0; i < lmodule_num; i++) {
+    if (lmodules[i].hash == h) {
+      min = lmodules[i].level;
+      break;
+    }
+  }
+#endif
+  if (lvl > SHED_LEVEL(min, shed)) {
+    return 1;
+  }
+#if (SITE_FILTER_NUM > 0)
+  if (lsite_num && lvl != LOGGING_FATAL) {
+    h = _site_hash(h, line);
+    for (int i = 0; i < lsite_num; i++) {
+      if (lsites[i] == h) {
+        return 1;
+      }
+    }
+  }
+#else
+  (void)line;
+#endif
+  return 0;
+}
+
+#if (MODULE_FILTER_NUM > 0) && (SITE_FILTER_NUM > 0)
+#define FILTERS_IN_USE()  (lmodule_num || lsite_num)
+#elif (MODULE_FILTER_NUM > 0)
+#define FILTERS_IN_USE()  (lmodule_num)
+#else
+#define FILTERS_IN_USE()  (lsite_num)
+#endif
+
+/* The global threshold alone decides, unless module or site filters are set */
+#define FILTERED(file_name, line, lvl, shed)                            \
+  (FILTERS_IN_USE() ? _filtered((file_name), (line), (lvl), (shed))     \
+   : (lvl) > SHED_LEVEL((int)lcfg.min_level, (shed)))
+#else
+#define FILTERED(file_name, line, lvl, shed)                            \
+  ((lvl) > SHED_LEVEL((int)lcfg.min_level, (shed)))
+#endif
+
+/* The text prefix tags, unless the records are JSON, the flight recorder dump uses them anyway */
+#define TEXT_TAGS             ((JSON_ON == 0) || ((RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)))
+
 #if (TIME_ON != 0)
 #include "sl_sleeptimer.h"
 /* [2020-12-11 12:11:05] */
 #define TIME_SLOT_LEN         21
+#endif
+
+/* Decoration of the time and location fields, none but a space if COMPACT_ON */
+#if (COMPACT_ON != 0)
+#define TAG_OPEN              ""
+#define TAG_CLOSE             " "
+#else
+#define TAG_OPEN              "["
+#define TAG_CLOSE             "]"
+#endif
+
+#if (TIME_ON != 0) && (JSON_ON == 0)
 
 /**
  * @brief _fill_time function to fill the logging buffer with the time
@@ -50,239 +651,1361 @@ static lcfg_t lcfg = { 0 };
  *
  * @note if no wall clock information is available, the time information will
  * be the time since last boot, which is the default state. Otherwise, the real
- * time information will be filled.
+ * time information will be filled. If the wall clock can't be read, the time
+ * since last boot is filled, so the record isn't lost.
  *
- * @return 0 on success, -1 otherwise
+ * @param out - output stream
  */
-static int _fill_time(void)
+static void _fill_time(lfmt_stream_t *out)
 {
-  if (lcfg.time_set) {
-    sl_sleeptimer_date_t dt     = { 0 };
-    sl_status_t          sl_ret = sl_sleeptimer_get_datetime(&dt);
-    if (sl_ret != SL_STATUS_OK) {
-      return -1;
-    }
+  sl_sleeptimer_date_t dt = { 0 };
 
-    int ret = snprintf(lcfg.buf + lcfg.offset,
-                       LOGGING_BUF_LENGTH - lcfg.offset,
-                       "[%04u-%02u-%02u %02u:%02u:%02u]",
-                       dt.year + 1900,
-                       dt.month + 1,
-                       dt.month_day,
-                       dt.hour,
-                       dt.min,
-                       dt.sec);
-    if (ret != -1) {
-      lcfg.offset += ret;
-      return 0;
-    }
-    return -1;
+  if (lcfg.time_set && sl_sleeptimer_get_datetime(&dt) == SL_STATUS_OK) {
+    lfmt_printf(out,
+                TAG_OPEN "%04u-%02u-%02u %02u:%02u:%02u" TAG_CLOSE,
+                dt.year + 1900,
+                dt.month + 1,
+                dt.month_day,
+                dt.hour,
+                dt.min,
+                dt.sec);
+    return;
   }
   sl_sleeptimer_timestamp_t t = sl_sleeptimer_get_time();
 
-  int ret = snprintf(lcfg.buf + lcfg.offset,
-                     LOGGING_BUF_LENGTH - lcfg.offset,
-                     "[RT-%lu:%02lu:%02lu:%02lu]",
-                     t / (24 * 60 * 60),
-                     (t % (24 * 60 * 60)) / (60 * 60),
-                     (t % (60 * 60)) / (60),
-                     t % 60);
-  if (ret != -1) {
-    lcfg.offset += ret;
-    return 0;
-  }
-  return -1;
+  lfmt_printf(out,
+              TAG_OPEN "RT-%lu:%02lu:%02lu:%02lu" TAG_CLOSE,
+              t / (24 * 60 * 60),
+              (t % (24 * 60 * 60)) / (60 * 60),
+              (t % (60 * 60)) / (60),
+              t % 60);
 }
 
-#else // #if (TIME_ON != 0)
+#endif // #if (TIME_ON != 0) && (JSON_ON == 0)
 
-#endif // #if (TIME_ON != 0)
+#if (LOCATION_ON != 0) && TEXT_TAGS
 
-#if (LOCATION_ON != 0)
+/**
+ * @brief _fill_file_line function to fill the logging buffer with location
+ * information which includes the file and line number where the logging
+ * happens.
+ *
+ * @param out - output stream
+ * @param file_name - file name information
+ * @param line - line information
+ */
+static void _fill_file_line(lfmt_stream_t *out,
+                            const char    *file_name,
+                            unsigned int  line)
+{
+  const char *n;
+  size_t     len;
+
+  if (!file_name) {
+    return;
+  }
+
+  n = _file_stem(file_name, &len);
+#if (COMPACT_ON != 0)
+  lfmt_printf(out, "%.*s:%u ", (int)MIN(FILE_NAME_LENGTH, len), n, line);
+#else
+  lfmt_printf(out,
+              "[%10.*s:%-5u]",
+              (int)MIN(FILE_NAME_LENGTH, len),
+              n,
+              line);
+#endif
+}
+
+#endif
+
+#if TEXT_TAGS
+/**
+ * @brief _fill_level fill the logging buffer with level flag.
+ *
+ * @param out - output stream
+ * @param lvl - which level the logging is
+ *
+ * @return 0 on success, -1 otherwise
+ */
+static int _fill_level(lfmt_stream_t *out,
+                       int           lvl)
+{
+  const char *flag;
+  size_t     flaglen;
+
+  switch (lvl) {
+    case LOGGING_FATAL:
+      flag    = FTL_FLAG;
+      flaglen = sizeof(FTL_FLAG);
+      break;
+    case LOGGING_ERROR:
+      flag    = ERR_FLAG;
+      flaglen = sizeof(ERR_FLAG);
+      break;
+    case LOGGING_WARNING:
+      flag    = WRN_FLAG;
+      flaglen = sizeof(WRN_FLAG);
+      break;
+    case LOGGING_IMPORTANT_INFO:
+      flag    = IPM_FLAG;
+      flaglen = sizeof(IPM_FLAG);
+      break;
+    case LOGGING_DEBUG_HIGHTLIGHT:
+      flag    = DHL_FLAG;
+      flaglen = sizeof(DHL_FLAG);
+      break;
+    case LOGGING_DEBUG:
+      flag    = DBG_FLAG;
+      flaglen = sizeof(DBG_FLAG);
+      break;
+    default:
+      flag    = VER_FLAG;
+      flaglen = sizeof(VER_FLAG);
+      break;
+  }
+  LD("%d - %lu\n", lvl, flaglen);
+
+  /* sizeof contains the '\0' */
+  lfmt_write(out, flag, flaglen - 1);
+  return 0;
+}
+#endif // #if TEXT_TAGS
+
+#if (RTT_TRIM_ON != 0)
+/**
+ * @brief _rtt_trim write a chunk of a record to its RTT up-buffer, keeping
+ * room for RTT_TRIM_MARK. If the chunk doesn't fit, as much of it as fits is
+ * written followed by the mark, unless the head of the record doesn't fit,
+ * then nothing is written.
+ *
+ * @param r - record
+ * @param str - chunk
+ * @param len - chunk length in bytes
+ *
+ * @return number of bytes of the chunk written
+ */
+static size_t _rtt_trim(lrec_t     *r,
+                        const char *str,
+                        size_t     len)
+{
+  /* Preceding chunks have all been accepted, or this one would not come */
+  size_t   head  = r->head > r->out.accepted ? r->head - r->out.accepted : 0;
+  unsigned avail = SEGGER_RTT_GetAvailWriteSpace(RTT_CHANNEL(r));
+
+  if ((RTT_UP(r)->Flags & SEGGER_RTT_MODE_MASK) == SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL
+      || len + sizeof(RTT_TRIM_MARK) - 1 <= avail) {
+    return RTT_WRITE(r, str, len);
+  }
+  if (head + sizeof(RTT_TRIM_MARK) - 1 > avail) {
+    return 0;
+  }
+  len = RTT_WRITE(r, str, avail - (sizeof(RTT_TRIM_MARK) - 1));
+  RTT_WRITE(r, RTT_TRIM_MARK, sizeof(RTT_TRIM_MARK) - 1);
+  r->trimmed = 1;
+  return len;
+}
+#define RTT_OUT(r, str, len)  _rtt_trim((r), (str), (len))
+#else
+#define RTT_OUT(r, str, len)  RTT_WRITE((r), (str), (len))
+#endif
+
+/**
+ * @brief _interface_out output bytes according to the LOGGING_INTERFACE
+ * macro definition
+ *
+ * @param r - record being logged
+ * @param str - bytes
+ * @param len - number of bytes
+ *
+ * @return number of bytes accepted by the interface, if both interfaces are
+ * used, len until both of them failed in the record, an interface which failed
+ * isn't written for the rest of the record
+ */
+static size_t _interface_out(lrec_t     *r,
+                             const char *str,
+                             size_t     len)
+{
+  (void)r;
+#if (LOGGING_INTERFACE == SEGGER_RTT)
+  return (lcfg.interfaces & SEGGER_RTT) ? RTT_OUT(r, str, len) : len;
+#elif (LOGGING_INTERFACE == VCOM)
+  return (lcfg.interfaces & VCOM) ? fwrite(str, 1, len, stdout) : len;
+#elif (LOGGING_INTERFACE == INTERFACE_BOTH)
+  uint8_t on = lcfg.interfaces & ~r->failed;
+
+  if ((on & SEGGER_RTT) && RTT_OUT(r, str, len) != len) {
+    r->failed |= SEGGER_RTT;
+  }
+  if ((on & VCOM) && fwrite(str, 1, len, stdout) != len) {
+    r->failed |= VCOM;
+  }
+  /* The record fails only when every interface in use has failed */
+  return (lcfg.interfaces & INTERFACE_BOTH) && !(lcfg.interfaces & ~r->failed & INTERFACE_BOTH) ? 0 : len;
+#else
+  (void)str;
+  return len;
+#endif
+}
+
+#if (COMPRESS_ON != 0)
+/**
+ * @brief _lz_run encode the length of a literal run or back reference beyond
+ * the 15 of its token, as in LZ4 blocks
+ */
+static uint8_t *_lz_run(uint8_t *op,
+                        size_t  n)
+{
+  for (n -= 15; n >= 255; n -= 255) {
+    *op++ = 255;
+  }
+  *op++ = (uint8_t)n;
+  return op;
+}
+
+/**
+ * @brief _lz_seq encode a literal run followed by a back reference, the last
+ * run of a frame has none
+ *
+ * @param op - output position
+ * @param lit - literals
+ * @param lit_len - number of literals
+ * @param off - distance of the reference, 0 if none
+ * @param match_len - bytes of the reference
+ *
+ * @return position after the sequence
+ */
+static uint8_t *_lz_seq(uint8_t       *op,
+                        const uint8_t *lit,
+                        size_t        lit_len,
+                        size_t        off,
+                        size_t        match_len)
+{
+  size_t n = off ? match_len - LZ_MIN_MATCH : 0;
+
+  *op++ = (uint8_t)(MIN(lit_len, 15) << 4 | MIN(n, 15));
+  if (lit_len >= 15) {
+    op = _lz_run(op, lit_len);
+  }
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if (!off) {
+    return op;
+  }
+  *op++ = (uint8_t)off;
+  *op++ = (uint8_t)(off >> 8);
+  return n >= 15 ? _lz_run(op, n) : op;
+}
+
+/**
+ * @brief _lz_len encode a length of a frame head as unsigned LEB128, 2 bytes
+ * at most
+ */
+static uint8_t *_lz_len(uint8_t *op,
+                        size_t  v)
+{
+  if (v >= 0x80) {
+    *op++ = (uint8_t)(v | 0x80);
+    v   >>= 7;
+  }
+  *op++ = (uint8_t)v;
+  return op;
+}
+
+/**
+ * @brief _lz_room check if a frame can be output whole
+ *
+ * @return non-zero if it can
+ */
+static int _lz_room(lrec_t *r,
+                    size_t len)
+{
+#if (LOGGING_INTERFACE & SEGGER_RTT)
+  (void)r;
+  /* The RTT write would drop it in NO_BLOCK_SKIP mode, and cut it in NO_BLOCK_TRIM mode */
+  return !(lcfg.interfaces & SEGGER_RTT)
+         || (RTT_UP(r)->Flags & SEGGER_RTT_MODE_MASK) == SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL
+         || SEGGER_RTT_GetAvailWriteSpace(RTT_CHANNEL(r)) >= len;
+#else
+  (void)r;
+  (void)len;
+  return 1;
+#endif
+}
+
+/**
+ * @brief _lz_flush compress the bytes not compressed yet against the history
+ * and send them in a frame, see logging_lz. A frame which doesn't fit is
+ * taken back out of the history, so the next one still decompresses on the
+ * host. If the interface cuts a frame short, the history is dropped before
+ * the next one.
+ *
+ * @param r - record
+ *
+ * @return number of bytes lost, 0 if the frame has been accepted or there
+ * was nothing to send
+ */
+static size_t _lz_flush(lrec_t *r)
+{
+  size_t        raw = r->zlen - r->zstart, n;
+  const uint8_t *ip, *anchor, *end;
+  uint8_t       *op = r->zout + LZ_HEAD_MAX, *head;
+  int           restart = !r->zframes;
+
+  if (!raw) {
+    return 0;
+  }
+  if (restart) {
+    memmove(r->zhist, r->zhist + r->zstart, raw);
+    memset(r->ztab, 0, sizeof(r->ztab));
+    r->zlen   = (uint16_t)raw;
+    r->zstart = 0;
+  }
+
+  ip     = r->zhist + r->zstart;
+  anchor = ip;
+  end    = r->zhist + r->zlen;
+  while (ip + LZ_MIN_MATCH <= end) {
+    uint32_t      seq, at;
+    unsigned      h;
+    const uint8_t *ref;
+
+    memcpy(&seq, ip, sizeof(seq));
+    h   = LZ_HASH(seq);
+    ref = r->ztab[h] ? r->zhist + r->ztab[h] - 1 : NULL;
+    if (ref) {
+      memcpy(&at, ref, sizeof(at));
+    }
+    if (!ref || at != seq) {
+      ip++;
+      continue;
+    }
+    for (n = LZ_MIN_MATCH; ip + n < end && ip[n] == ref[n]; n++) {
+    }
+    op     = _lz_seq(op, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), n);
+    ip    += n;
+    anchor = ip;
+  }
+  if (anchor < end) {
+    op = _lz_seq(op, anchor, (size_t)(end - anchor), 0, 0);
+  }
+
+  /* The head is put right before the payload, its lengths are LEB128 */
+  n     = (size_t)(op - r->zout - LZ_HEAD_MAX);
+  head  = r->zout + LZ_HEAD_MAX - 4 - (raw >= 0x80) - (n >= 0x80);
+  op    = head;
+  *op++ = LZ_FRAME_START;
+  *op++ = (uint8_t)((r->zseq & 0x7F) | (restart ? LZ_RESTART : 0));
+  op    = _lz_len(op, raw);
+  op    = _lz_len(op, n);
+  op   += n;
+  *op   = lctrl_crc8(0, head + 1, (size_t)(op - head - 1));
+  n     = (size_t)(op + 1 - head);
+
+  if (!_lz_room(r, n)) {
+    r->zlen = r->zstart;
+    return raw;
+  }
+
+  /* Only the bytes the host has are looked up, so a frame dropped leaves no trace */
+  for (ip = r->zhist + r->zstart; ip + LZ_MIN_MATCH <= end; ip++) {
+    uint32_t seq;
+
+    memcpy(&seq, ip, sizeof(seq));
+    r->ztab[LZ_HASH(seq)] = (uint16_t)(ip - r->zhist + 1);
+  }
+  r->zseq++;
+  r->zstart = r->zlen;
+  if (_interface_out(r, (const char *)head, n) != n) {
+    r->zframes = 0;
+    return raw;
+  }
+  r->zframes = (uint16_t)((r->zframes + 1) % COMPRESS_RESTART);
+  return 0;
+}
+
+/**
+ * @brief _lz_put add bytes of a record to the compressor. A frame is only
+ * sent here if the record doesn't fit into half of the window.
+ *
+ * @param r - record
+ * @param str - bytes
+ * @param len - number of bytes
+ *
+ * @return number of bytes taken, less than len if a frame is not accepted
+ */
+static size_t _lz_put(lrec_t     *r,
+                      const char *str,
+                      size_t     len)
+{
+  size_t done = 0, lost;
+
+  while (done < len) {
+    size_t n = MIN(len - done, (size_t)(LZ_PENDING_MAX - (r->zlen - r->zstart)));
+
+    if (r->zlen + n > COMPRESS_WINDOW) {
+      /* Keep the newest half of the window, the bytes not compressed yet included */
+      unsigned d = r->zlen - LZ_PENDING_MAX;
+
+      memmove(r->zhist, r->zhist + d, r->zlen - d);
+      r->zlen   -= d;
+      r->zstart -= d;
+      for (unsigned i = 0; i < (1u << COMPRESS_HASH_BITS); i++) {
+        r->ztab[i] = r->ztab[i] > d ? (uint16_t)(r->ztab[i] - d) : 0;
+      }
+    }
+    memcpy(r->zhist + r->zlen, str + done, n);
+    r->zlen += (uint16_t)n;
+    done    += n;
+    if (r->zlen - r->zstart < LZ_PENDING_MAX || !(lost = _lz_flush(r))) {
+      continue;
+    }
+    /* The bytes of the earlier chunks lost with the frame are taken back */
+    if (lost > done) {
+      r->out.accepted -= lost - done;
+      return 0;
+    }
+    return done - lost;
+  }
+  return len;
+}
+#define LZ_FLUSH(r)           _lz_flush(r)
+#else
+#define LZ_FLUSH(r)           0
+#endif
+
+/**
+ * @brief __logging output function of the record streams, through the
+ * compressor if COMPRESS_ON is set
+ *
+ * @param arg - record being logged
+ * @param str - logging message
+ * @param len - length of the logging message in bytes
+ *
+ * @return number of bytes accepted
+ */
+static size_t __logging(void       *arg,
+                        const char *str,
+                        size_t     len)
+{
+#if (COMPRESS_ON != 0)
+  return _lz_put(arg, str, len);
+#else
+  return _interface_out(arg, str, len);
+#endif
+}
+
+/**
+ * @brief _record_slot get the record state of the current context
+ *
+ * @return record, NULL if the context has no logging buffer
+ */
+static inline lrec_t *_record_slot(void)
+{
+#if (RTT_PER_CONTEXT != 0)
+  unsigned ctx = _context_id();
+
+  return ctx < LOGGING_CONTEXT_NUM ? &lrec[ctx] : NULL;
+#else
+  return &lrec[0];
+#endif
+}
+
+#if (RTT_STALL_WRITES > 0)
+/**
+ * @brief _stalled check if the records of a context should be skipped
+ * because the reader is stalled. The reader is back once the read offset has
+ * moved.
+ *
+ * @param r - record
+ *
+ * @return non-zero if the record should be skipped
+ */
+static inline int _stalled(lrec_t *r)
+{
+  if (!r->stalled) {
+    return 0;
+  }
+  if (RTT_UP(r)->RdOff == r->stall_rd && lcfg.interfaces == SEGGER_RTT) {
+    r->skipped++;
+    return 1;
+  }
+  r->stalled   = 0;
+  r->stall_cnt = 0;
+  return 0;
+}
+
+/**
+ * @brief _stall_check account the result of a record to the stall detection
+ *
+ * @param r - record
+ * @param full - non-zero if the record was not completely accepted
+ */
+static inline void _stall_check(lrec_t *r,
+                                int    full)
+{
+  unsigned rd = RTT_UP(r)->RdOff;
+
+  if (!full || rd != r->stall_rd || lcfg.interfaces != SEGGER_RTT) {
+    r->stall_rd  = rd;
+    r->stall_cnt = 0;
+  } else if (++r->stall_cnt >= RTT_STALL_WRITES) {
+    r->stalled = 1;
+  }
+}
+#define STALLED(r)            _stalled(r)
+#define STALL_CHECK(r, full)  _stall_check((r), (full))
+#else
+#define STALLED(r)            0
+#define STALL_CHECK(r, full)
+#endif
+
+#if (RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)
+/**
+ * @brief _recorder_put capture a record in the flight recorder of its context
+ *
+ * @param r - record
+ * @param file_name - file name of the call site
+ * @param line - line of the call site
+ * @param lvl - logging level
+ * @param fmt - format string
+ * @param ap - parameters, NULL for a constant message
+ */
+static void _recorder_put(lrec_t       *r,
+                          const char   *file_name,
+                          unsigned int line,
+                          int          lvl,
+                          const char   *fmt,
+                          va_list      *ap)
+{
+  lrecorded_t *e = &r->rec[r->rec_head];
+
+  e->file_name = file_name;
+  e->fmt       = fmt;
+  e->line      = line;
+  e->lvl       = lvl;
+  e->len       = ap ? lfmt_vpack(e->args, sizeof(e->args), fmt, *ap) : 0;
+  r->rec_head  = (r->rec_head + 1) % RECORDER_NUM;
+  r->rec_num   = MIN(r->rec_num + 1, RECORDER_NUM);
+}
+#endif
+
+/**
+ * @brief _record_start start streaming a new record to the logging interface
+ * through the logging buffer of a context. With RTT_PER_CONTEXT, the record
+ * starts with a header of its timestamp and sequence number: 0x1E, 16 hex
+ * digits timestamp, '.', 8 hex digits sequence number, 0x1F.
+ *
+ * @param r - record from _record_slot()
+ */
+static inline void _record_start(lrec_t *r)
+{
+  lfmt_init(&r->out, r->buf, LOGGING_BUF_LENGTH, __logging, r);
+#if (LOGGING_INTERFACE == INTERFACE_BOTH)
+  r->failed = 0;
+#endif
+  if (r->resync) {
+    lfmt_putc(&r->out, '\n');
+  }
+#if (RTT_PER_CONTEXT != 0)
+  lfmt_printf(&r->out,
+              "\x1e%016llx.%08lx\x1f",
+              (unsigned long long)RECORD_TIMESTAMP(),
+              (unsigned long)r->seq++);
+#endif
+#if (RTT_STALL_WRITES > 0)
+  if (r->skipped && !r->stalled) {
+    lfmt_printf(&r->out,
+                "--- %lu records skipped while the reader was stalled ---\n",
+                (unsigned long)r->skipped);
+    r->skipped = 0;
+  }
+#endif
+#if (RTT_TRIM_ON != 0)
+  r->head    = r->out.total;
+  r->trimmed = 0;
+#endif
+}
+
+/* The trim mark ends the line */
+#if (RTT_TRIM_ON != 0)
+#define RECORD_TRIMMED(r)     ((r)->trimmed)
+#define RECORD_HEAD(r)        ((r)->head = (r)->out.total)
+#else
+#define RECORD_TRIMMED(r)     0
+#define RECORD_HEAD(r)
+#endif
+
+/**
+ * @brief _record_begin start a new record of the current context, see
+ * _record_start()
+ *
+ * @return record, NULL if the context has no logging buffer or the record is
+ * skipped
+ */
+static inline lrec_t *_record_begin(void)
+{
+  lrec_t *r = _record_slot();
+
+  if (!r || STALLED(r)) {
+    return NULL;
+  }
+  _record_start(r);
+  return r;
+}
+
+/**
+ * @brief _record_end hand the rest of the record over to the logging
+ * interface.
+ *
+ * @param r - record from _record_begin()
+ *
+ * @return 0 if the whole record has been accepted, -1 otherwise
+ */
+static inline int _record_end(lrec_t *r)
+{
+  int    ret  = lfmt_flush(&r->out);
+  size_t lost = ret ? 0 : LZ_FLUSH(r);
+
+  /* A frame of COMPRESS_ON holds what is left of the record */
+  if (lost) {
+    r->out.accepted -= lost;
+    ret              = -1;
+  }
+
+  if (!ret || RECORD_TRIMMED(r)) {
+    r->resync = 0;
+  } else if (r->out.accepted) {
+    /* The rest of the record is discarded, don't glue the next one to it */
+    r->resync = 1;
+  }
+  STALL_CHECK(r, ret);
+  return ret;
+}
+
+#if (ADAPTIVE_ON != 0)
+/**
+ * @brief _adapt shed levels from the threshold of a context as the transport
+ * fills up, or restore them as it drains, and output a marker record on every
+ * change. Level n is shed at ADAPTIVE_HIGH + (n - 1) * ADAPTIVE_STEP percent
+ * and restored ADAPTIVE_HYST percent below, one level at a time at most every
+ * ADAPTIVE_HOLD calls.
+ *
+ * @param r - record
+ */
+static void _adapt(lrec_t *r)
+{
+  unsigned used, size, shed = r->shed;
+  unsigned max = lcfg.min_level > ADAPTIVE_FLOOR ? lcfg.min_level - ADAPTIVE_FLOOR : 0;
+
+#if (RTT_STALL_WRITES > 0)
+  if (r->stalled) {
+    /* Nobody reads, the markers would be lost */
+    return;
+  }
+#endif
+#if defined(LOGGING_TRANSPORT_FILL)
+  used = LOGGING_TRANSPORT_FILL();
+  size = 100;
+#else
+  const SEGGER_RTT_BUFFER_UP *up = RTT_UP(r);
+  unsigned                   rd  = up->RdOff;
+  unsigned                   wr  = up->WrOff;
+
+  size = up->SizeOfBuffer;
+  used = wr >= rd ? wr - rd : size - rd + wr;
+#endif
+
+  /* Compared multiplied out, no division on every call */
+  shed = MIN(shed, max);
+  while (shed < max && used * 100 >= (ADAPTIVE_HIGH + shed * ADAPTIVE_STEP) * size) {
+    shed++;
+  }
+  if (shed > r->shed) {
+    r->hold = ADAPTIVE_HOLD;
+  } else if (r->hold) {
+    r->hold--;
+  } else if (shed
+             && (used * 100 + ADAPTIVE_HYST * size
+                 < (ADAPTIVE_HIGH + (shed - 1) * ADAPTIVE_STEP) * size)) {
+    /* The drain of a probe poll is bursty, so release slowly */
+    shed--;
+    r->hold = ADAPTIVE_HOLD;
+  }
+  if (shed == r->shed) {
+    return;
+  }
+  _record_start(r);
+  lfmt_printf(&r->out,
+              "--- %u%% full, level threshold %s to %s ---\n",
+              size ? used * 100 / size : 0,
+              shed > r->shed ? "lowered" : "restored",
+              lvl_names[SHED_LEVEL((int)lcfg.min_level, shed)]);
+  r->shed = shed;
+  _record_end(r);
+}
+#define ADAPT(r)              do { if (r) { _adapt(r); } } while (0)
+#else
+#define ADAPT(r)
+#endif
+
+#if (JSON_ON != 0)
+#if (KV_ON != 0)
+#error "The KV_ON records are binary, they can't be mixed with JSON_ON"
+#endif
+
+/**
+ * @brief state of the message of a JSON record
+ */
+typedef struct {
+  lfmt_stream_t *out; /**< Stream of the record */
+  uint8_t       nl;   /**< Boolean value indicating if a '\n' is held back, it is dropped at the end of the message */
+}ljson_t;
+
+/**
+ * @brief _json_flush escape a chunk of the message into the record
+ *
+ * @param arg - message state
+ * @param str - chunk
+ * @param len - chunk length in bytes
+ *
+ * @return len, the record stream keeps track of its own failures
+ */
+static size_t _json_flush(void       *arg,
+                          const char *str,
+                          size_t     len)
+{
+  ljson_t *j = arg;
+  size_t  n  = len;
+
+  if (j->nl) {
+    lfmt_write(j->out, "\\n", 2);
+    j->nl = 0;
+  }
+  if (n && str[n - 1] == '\n') {
+    j->nl = 1;
+    n--;
+  }
+  lfmt_write_json(j->out, str, n);
+  return len;
+}
+
+/**
+ * @brief _json_u64 output an unsigned decimal number
+ */
+static void _json_u64(lfmt_stream_t *out,
+                      uint64_t      v)
+{
+  char buf[20], *p = buf + sizeof(buf);
+
+  do {
+    *--p = (char)('0' + v % 10);
+    v   /= 10;
+  } while (v);
+  lfmt_write(out, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+/**
+ * @brief _json_head start a JSON record up to the message string:
+ * {"ts":<timestamp>,"level":"<level>","file":"<file>","line":<line>,"msg":"
+ *
+ * @param out - output stream
+ * @param lvl - logging level, negative for a plain message without level and
+ * location
+ * @param file_name - file name, the path is left out, NULL to leave out the
+ * location
+ * @param line - line
+ */
+static void _json_head(lfmt_stream_t *out,
+                       int           lvl,
+                       const char    *file_name,
+                       unsigned int  line)
+{
+  lfmt_write(out, "{\"ts\":", 6);
+  _json_u64(out, RECORD_TIMESTAMP());
+  if (lvl >= 0) {
+    lfmt_write(out, ",\"level\":\"", 10);
+    lfmt_write(out, lvl_names[MIN(lvl, LOGGING_VERBOSE)], 3);
+    lfmt_write(out, "\"", 1);
+  }
+  if (lvl >= 0 && file_name) {
+    const char *base = file_name;
+
+    for (const char *p = file_name; *p; p++) {
+      if (*p == '/' || *p == '\\') {
+        base = p + 1;
+      }
+    }
+    lfmt_write(out, ",\"file\":\"", 9);
+    lfmt_write_json(out, base, strlen(base));
+    lfmt_write(out, "\",\"line\":", 9);
+    _json_u64(out, line);
+  }
+  lfmt_write(out, ",\"msg\":\"", 8);
+}
+
+/**
+ * @brief _json_msg output the message of a JSON record, escaped and without
+ * its trailing '\n', and end the record
+ *
+ * @param out - output stream
+ * @param fmt - format string, or the message itself if ap is NULL
+ * @param len - length of the message if ap is NULL
+ * @param ap - parameters, NULL for a constant message
+ */
+static void _json_msg(lfmt_stream_t *out,
+                      const char    *fmt,
+                      size_t        len,
+                      va_list       *ap)
+{
+  if (ap) {
+    char          chunk[64];
+    ljson_t       j = { .out = out };
+    lfmt_stream_t msg;
+
+    lfmt_init(&msg, chunk, sizeof(chunk), _json_flush, &j);
+    lfmt_vprintf(&msg, fmt, *ap);
+    lfmt_flush(&msg);
+  } else {
+    len -= len && fmt[len - 1] == '\n';
+    lfmt_write_json(out, fmt, len);
+  }
+  lfmt_write(out, "\"}\n", 3);
+}
+#endif // #if (JSON_ON != 0)
+
+void logging_plain(const char *fmt,
+                   ...)
+{
+  va_list valist;
+  lrec_t  *r = _record_begin();
+
+  if (!r) {
+    return;
+  }
+  va_start(valist, fmt);
+#if (JSON_ON != 0)
+  _json_head(&r->out, -1, NULL, 0);
+  _json_msg(&r->out, fmt, 0, &valist);
+#else
+  lfmt_vprintf(&r->out, fmt, valist);
+#endif
+  va_end(valist);
+  _record_end(r);
+}
+
+/**
+ * @brief _log log a message, see __log()
+ *
+ * @param file_name - file name (location) information
+ * @param line - line (location) information
+ * @param lvl - logging message level information
+ * @param fmt - format string, or the message itself if ap is NULL
+ * @param len - length of the message if ap is NULL
+ * @param ap - parameters, NULL for a constant message which is copied as is
+ *
+ * @return 0 on success, -1 otherwise
+ */
+static int _log(const char   *file_name,
+                unsigned int line,
+                int          lvl,
+                const char   *fmt,
+                size_t       len,
+                va_list      *ap)
+{
+  int    ret;
+  lrec_t *r;
+#if (STATS_ON != 0)
+  logging_level_stats_t *st = _stats_slot(lvl);
+#endif
+  PROFILE_START();
+
+  STATS_ADD(st, calls, 1);
+  r = _record_slot();
+  ADAPT(r);
+  if (FILTERED(file_name, line, lvl, SHED(r))) {
+    STATS_ADD(st, filtered, 1);
+    PROFILE_STAGE(PROFILE_FILTER, lvl);
+    return 0;
+  }
+  PROFILE_STAGE(PROFILE_FILTER, lvl);
+  STACK_PAINT();
+
+  if (!r) {
+    STATS_ADD(st, dropped, 1);
+    return -1;
+  }
+  if (STALLED(r)) {
+    /* Nobody reads, don't spend the time to format it */
+#if (RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)
+    _recorder_put(r, file_name, line, lvl, fmt, ap);
+#endif
+    STATS_ADD(st, dropped, 1);
+    return -1;
+  }
+  _record_start(r);
+
+#if (JSON_ON != 0)
+  _json_head(&r->out, lvl, file_name, line);
+  RECORD_HEAD(r);
+  _json_msg(&r->out, fmt, len, ap);
+#else
+#if (COMPACT_ON != 0)
+  /* The level code leads, so the record is found without parsing the text */
+  _fill_level(&r->out, lvl);
+  PROFILE_STAGE(PROFILE_LEVEL, lvl);
+#endif
+
+#if (TIME_ON != 0)
+  _fill_time(&r->out);
+  PROFILE_STAGE(PROFILE_TIME, lvl);
+#endif
+
+#if (LOCATION_ON != 0)
+  _fill_file_line(&r->out, file_name, line);
+  PROFILE_STAGE(PROFILE_FILE_LINE, lvl);
+#endif
+
+#if (COMPACT_ON == 0)
+  _fill_level(&r->out, lvl);
+  PROFILE_STAGE(PROFILE_LEVEL, lvl);
+
+  /* fill whatever other modules here */
+
+  lfmt_write(&r->out, ": ", 2);
+#endif
+  RECORD_HEAD(r);
+
+  /* Full chunks are handed over to the interface while formatting */
+  if (ap) {
+    lfmt_vprintf(&r->out, fmt, *ap);
+  } else {
+    lfmt_write(&r->out, fmt, len);
+  }
+#endif
+  PROFILE_STAGE(PROFILE_FORMAT, lvl);
+  WATERMARK_MSG(r->out.total);
+
+  ret = _record_end(r);
+  PROFILE_STAGE(PROFILE_OUTPUT, lvl);
+  WATERMARK_RTT();
+  STACK_CHECK();
+  STATS_ADD(st, bytes, r->out.accepted);
+  if (!ret) {
+    STATS_ADD(st, emitted, 1);
+  } else if (r->out.accepted) {
+    STATS_ADD(st, truncated, 1);
+  } else {
+    STATS_ADD(st, dropped, 1);
+  }
+  return ret;
+}
+
+int __log(const char   *file_name,
+          unsigned int line,
+          int          lvl,
+          const char   *fmt,
+          ...)
+{
+  va_list valist;
+  int     ret;
+
+  va_start(valist, fmt);
+  ret = _log(file_name, line, lvl, fmt, 0, &valist);
+  va_end(valist);
+  return ret;
+}
+
+int __log_str(const char   *file_name,
+              unsigned int line,
+              int          lvl,
+              const char   *str,
+              size_t       len)
+{
+  return _log(file_name, line, lvl, str, len, NULL);
+}
 
+#if (KV_ON != 0) || (BINARY_ON != 0)
 /**
- * @brief _fill_file_line function to fill the logging buffer with location
- * information which includes the file and line number where the logging
- * happens.
+ * @brief _kv_head encode the head of a CBOR data item
  *
- * @param file_name - file name information
- * @param line - line information
+ * @param p - output position
+ * @param end - end of the output buffer
+ * @param major - major type
+ * @param v - value or length
  *
- * @return 0 on success, -1 otherwise
+ * @return position after the head, NULL if it doesn't fit
  */
-static int _fill_file_line(const char   *file_name,
-                           unsigned int line)
+static uint8_t *_kv_head(uint8_t  *p,
+                         uint8_t  *end,
+                         uint8_t  major,
+                         uint64_t v)
 {
-  int  ret;
-  char *p, *n, *posend;
-  char tmp[FILE_NAME_LENGTH] = { 0 };
+  unsigned n = v < 24 ? 0 : v <= 0xFF ? 1 : v <= 0xFFFF ? 2 : v <= 0xFFFFFFFFu ? 4 : 8;
 
-  if (!file_name) {
-    return 0;
+  if ((size_t)(end - p) < 1 + n) {
+    return NULL;
   }
-
-  p = lcfg.buf + lcfg.offset;
-
-  n = strrchr(file_name, '/');
-  if (!n) {
-    n = strrchr(file_name, '\\');
+  /* Additional information 24..27 for 1, 2, 4 or 8 bytes following */
+  *p++ = (uint8_t)(major << 5 | (n ? 23 + (n == 8 ? 4 : n == 4 ? 3 : n) : v));
+  while (n--) {
+    *p++ = (uint8_t)(v >> (n * 8));
   }
-  n      = (n ? n + 1 : (char *)file_name);
-  posend = strchr(n, '.');
-
-  memcpy(tmp,
-         n,
-         MIN(FILE_NAME_LENGTH, posend - n));
+  return p;
+}
 
-  ret = snprintf(p,
-                 LOGGING_BUF_LENGTH - lcfg.offset - 1,
-                 "[%10.10s:%-5d]",
-                 tmp,
-                 line);
+/**
+ * @brief _frame_out finish a binary frame, its start byte, payload length and
+ * CRC, and output it as a record
+ *
+ * @param r - record from _record_slot()
+ * @param start - start byte of the frame
+ * @param buf - frame, the payload starts at buf[2]
+ * @param p - end of the payload, room for the CRC is left after it
+ *
+ * @return same as __log()
+ */
+static int _frame_out(lrec_t  *r,
+                      uint8_t start,
+                      uint8_t *buf,
+                      uint8_t *p)
+{
+  buf[0] = start;
+  buf[1] = (uint8_t)(p - buf - 2);
+  *p     = lctrl_crc8(0, buf + 1, (size_t)(p - buf - 1));
 
-  if (ret != -1) {
-    lcfg.offset += ret;
-    return 0;
-  }
-  return -1;
+  _record_start(r);
+  lfmt_write(&r->out, (const char *)buf, (size_t)(p + 1 - buf));
+  /* A frame cut short can't be decoded, don't trim it */
+  RECORD_HEAD(r);
+  return _record_end(r);
 }
 
 #endif
 
+#if (KV_ON != 0)
+#if (KV_BUF_LENGTH > 258) || (KV_BUF_LENGTH < 16)
+#error "KV_BUF_LENGTH must be in range [16, 258]"
+#endif
+
+/* Start of the call site descriptors, provided by the linker, weak as there may be none */
+extern const char __start_logging_kv[] __attribute__((weak));
+
 /**
- * @brief _fill_level fill the logging buffer with level flag.
- *
- * @param lvl - which level the logging is
- *
- * @return 0 on success, -1 otherwise
+ * @brief _kv_int encode a signed integer as a CBOR data item
  */
-static int _fill_level(int lvl)
+static uint8_t *_kv_int(uint8_t *p,
+                        uint8_t *end,
+                        int64_t v)
 {
-  const char *flag;
-  char       *p;
-  size_t     flaglen;
+  return v < 0 ? _kv_head(p, end, 1, (uint64_t)(-1 - v)) : _kv_head(p, end, 0, (uint64_t)v);
+}
 
-  switch (lvl) {
-    case LOGGING_FATAL:
-      flag    = FTL_FLAG;
-      flaglen = sizeof(FTL_FLAG);
-      break;
-    case LOGGING_ERROR:
-      flag    = ERR_FLAG;
-      flaglen = sizeof(ERR_FLAG);
-      break;
-    case LOGGING_WARNING:
-      flag    = WRN_FLAG;
-      flaglen = sizeof(WRN_FLAG);
-      break;
-    case LOGGING_IMPORTANT_INFO:
-      flag    = IPM_FLAG;
-      flaglen = sizeof(IPM_FLAG);
-      break;
-    case LOGGING_DEBUG_HIGHTLIGHT:
-      flag    = DHL_FLAG;
-      flaglen = sizeof(DHL_FLAG);
-      break;
-    case LOGGING_DEBUG:
-      flag    = DBG_FLAG;
-      flaglen = sizeof(DBG_FLAG);
-      break;
-    default:
-      flag    = VER_FLAG;
-      flaglen = sizeof(VER_FLAG);
-      break;
+/**
+ * @brief _kv_data encode a byte or text string as a CBOR data item, cut
+ * short to fit into the output buffer
+ */
+static uint8_t *_kv_data(uint8_t    *p,
+                         uint8_t    *end,
+                         uint8_t    major,
+                         const void *data,
+                         size_t     len)
+{
+  /* A head of 2 bytes at most, the buffer is smaller than 256 bytes */
+  if (end - p < 2) {
+    return NULL;
   }
-  LD("%d - %lu\n", lvl, flaglen);
-
-  p = lcfg.buf + lcfg.offset;
-  /* sizeof contains the '\0' */
-  memcpy(p, flag, flaglen - 1);
-  lcfg.offset += flaglen - 1;
-  return 0;
+  len = MIN(len, (size_t)(end - p) - (len < 24 ? 1 : 2));
+  p   = _kv_head(p, end, major, len);
+  memcpy(p, data, len);
+  return p + len;
 }
 
 /**
- * @brief __logging output function for logging message according to the
- * LOGGING_INTERFACE macro definition
- *
- * @param str - logging message
+ * @brief _kv_double encode a floating point value as a CBOR data item, in
+ * single precision if that is exact
  */
-static inline void __logging(const char *str)
+static uint8_t *_kv_double(uint8_t *p,
+                           uint8_t *end,
+                           double  v)
 {
-#if (LOGGING_INTERFACE == SEGGER_RTT)
-  SEGGER_RTT_printf(0, "%s", str);
-#elif (LOGGING_INTERFACE == VCOM)
-  printf("%s", str);
-#elif (LOGGING_INTERFACE == INTERFACE_BOTH)
-  SEGGER_RTT_printf(0, "%s", str);
-  printf("%s", str);
-#else
-#endif
+  float    f = (float)v;
+  uint64_t bits;
+
+  if ((double)f == v) {
+    uint32_t b;
+
+    memcpy(&b, &f, sizeof(b));
+    if (end - p < 5) {
+      return NULL;
+    }
+    *p++ = 0xFA;
+    for (int i = 3; i >= 0; i--) {
+      *p++ = (uint8_t)(b >> (i * 8));
+    }
+    return p;
+  }
+  memcpy(&bits, &v, sizeof(bits));
+  if (end - p < 9) {
+    return NULL;
+  }
+  *p++ = 0xFB;
+  for (int i = 7; i >= 0; i--) {
+    *p++ = (uint8_t)(bits >> (i * 8));
+  }
+  return p;
 }
 
-void logging_plain(const char *fmt,
-                   ...)
+int __log_kv(const char   *site,
+             unsigned int line,
+             int          lvl,
+             uint32_t     types,
+             ...)
 {
+  uint8_t buf[KV_BUF_LENGTH];
+  uint8_t *p   = buf + 2;
+  uint8_t *end = buf + sizeof(buf) - 1;
   va_list valist;
+  int     ret;
+  lrec_t  *r;
+#if (STATS_ON != 0)
+  logging_level_stats_t *st = _stats_slot(lvl);
+#endif
 
-  lcfg.offset = 0;
-  memset(lcfg.buf, 0, LOGGING_BUF_LENGTH);
-  va_start(valist, fmt);
-  vsnprintf(lcfg.buf + lcfg.offset,
-            LOGGING_BUF_LENGTH - lcfg.offset,
-            fmt,
-            valist);
+  /* The line is only needed by the site filters, the descriptor has it too */
+  (void)line;
+  STATS_ADD(st, calls, 1);
+  r = _record_slot();
+  ADAPT(r);
+  if (FILTERED(site, line, lvl, SHED(r))) {
+    STATS_ADD(st, filtered, 1);
+    return 0;
+  }
+  if (!r || STALLED(r)) {
+    STATS_ADD(st, dropped, 1);
+    return -1;
+  }
+
+  *p++ = (uint8_t)(lvl | ((TIME_ON != 0) << 3));
+  p    = _kv_head(p, end, 0, (uint64_t)(site - __start_logging_kv));
+#if (TIME_ON != 0)
+  p = _kv_head(p, end, 0, sl_sleeptimer_get_time());
+#endif
+  va_start(valist, types);
+  for (; types; types >>= 4) {
+    uint8_t *q;
+
+    switch (types & 0xF) {
+      case LKV_INT:
+        q = _kv_int(p, end, va_arg(valist, int));
+        break;
+      case LKV_UINT:
+        q = _kv_head(p, end, 0, va_arg(valist, unsigned int));
+        break;
+      case LKV_LONG:
+        q = _kv_int(p, end, va_arg(valist, long));
+        break;
+      case LKV_ULONG:
+        q = _kv_head(p, end, 0, va_arg(valist, unsigned long));
+        break;
+      case LKV_LLONG:
+        q = _kv_int(p, end, va_arg(valist, long long));
+        break;
+      case LKV_ULLONG:
+        q = _kv_head(p, end, 0, va_arg(valist, unsigned long long));
+        break;
+      case LKV_DOUBLE:
+        q = _kv_double(p, end, va_arg(valist, double));
+        break;
+      case LKV_STR: {
+        const char *str = va_arg(valist, const char *);
 
-  __logging(lcfg.buf);
+        str = str ? str : "(null)";
+        q   = _kv_data(p, end, 3, str, strlen(str));
+        break;
+      }
+      case LKV_BYTES: {
+        const logging_kv_bytes_t *b = va_arg(valist, const logging_kv_bytes_t *);
+
+        q = _kv_data(p, end, 2, b->data, b->len);
+        break;
+      }
+      default:
+        q = NULL;
+        break;
+    }
+    if (!q) {
+      /* The values left out are missing on the host */
+      break;
+    }
+    p = q;
+  }
+  va_end(valist);
+
+  ret = _frame_out(r, LKV_FRAME_START, buf, p);
+  STATS_ADD(st, bytes, r->out.accepted);
+  if (!ret) {
+    STATS_ADD(st, emitted, 1);
+  } else if (r->out.accepted) {
+    STATS_ADD(st, truncated, 1);
+  } else {
+    STATS_ADD(st, dropped, 1);
+  }
+  return ret;
 }
+#endif // #if (KV_ON != 0)
 
-int __log(const char   *file_name,
-          unsigned int line,
-          int          lvl,
-          const char   *fmt,
-          ...)
+#if (BINARY_ON != 0)
+#if (BINARY_BUF_LENGTH > 258) || (BINARY_BUF_LENGTH < 24)
+#error "BINARY_BUF_LENGTH must be in range [24, 258]"
+#endif
+#if (JSON_ON != 0)
+#error "BINARY_ON and JSON_ON are exclusive"
+#endif
+
+/* File name in a call site descriptor */
+#define BIN_FILE_NAME(site)   ((site) + strlen(site) + 1)
+
+/* Call site descriptors, provided by the linker, weak as there may be none */
+extern const char __start_logging_fmt[] __attribute__((weak));
+extern const char __stop_logging_fmt[] __attribute__((weak));
+
+int __log_bin(const char   *site,
+              unsigned int line,
+              int          lvl,
+              ...)
 {
+  uint8_t buf[BINARY_BUF_LENGTH];
+  uint8_t *p   = buf + 2;
+  uint8_t *end = buf + sizeof(buf) - 1;
   va_list valist;
+  int     ret;
+  lrec_t  *r;
+#if (STATS_ON != 0)
+  logging_level_stats_t *st = _stats_slot(lvl);
+#endif
+  PROFILE_START();
 
-  if (lvl > (int)lcfg.min_level) {
+  /* The line is only needed by the site filters, the descriptor has it too */
+  (void)line;
+  STATS_ADD(st, calls, 1);
+  r = _record_slot();
+  ADAPT(r);
+  /* The file name follows the format string, only looked up if filtering by it */
+  if (FILTERED(BIN_FILE_NAME(site), line, lvl, SHED(r))) {
+    STATS_ADD(st, filtered, 1);
+    PROFILE_STAGE(PROFILE_FILTER, lvl);
     return 0;
   }
+  PROFILE_STAGE(PROFILE_FILTER, lvl);
 
-  lcfg.offset = 0;
-  memset(lcfg.buf, 0, LOGGING_BUF_LENGTH);
-
-#if (TIME_ON != 0)
-  if (0 != _fill_time()) {
+  if (!r) {
+    STATS_ADD(st, dropped, 1);
     return -1;
   }
+  va_start(valist, lvl);
+  if (STALLED(r)) {
+#if (RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)
+    _recorder_put(r, BIN_FILE_NAME(site), line, lvl, site, &valist);
 #endif
-
-#if (LOCATION_ON != 0)
-  if (0 != _fill_file_line(file_name, line)) {
+    va_end(valist);
+    STATS_ADD(st, dropped, 1);
     return -1;
   }
-#endif
 
-  _fill_level(lvl);
+  /* The format string starts the descriptor, the parameters are packed by it */
+  *p++ = (uint8_t)(lvl | 1 << 3);
+  p    = _kv_head(p, end, 0, (uint64_t)(site - __start_logging_fmt));
+  p    = _kv_head(p, end, 0, RECORD_TIMESTAMP());
+  p   += lfmt_vpack(p, (size_t)(end - p), site, valist);
+  va_end(valist);
+  PROFILE_STAGE(PROFILE_FORMAT, lvl);
 
-  /* fill whatever other modules here */
+  ret = _frame_out(r, LBIN_FRAME_START, buf, p);
+  PROFILE_STAGE(PROFILE_OUTPUT, lvl);
+  STATS_ADD(st, bytes, r->out.accepted);
+  if (!ret) {
+    STATS_ADD(st, emitted, 1);
+  } else if (r->out.accepted) {
+    STATS_ADD(st, truncated, 1);
+  } else {
+    STATS_ADD(st, dropped, 1);
+  }
+  return ret;
+}
 
-  lcfg.buf[lcfg.offset++] = ':';
-  lcfg.buf[lcfg.offset++] = ' ';
+int logging_binary_sync(void)
+{
+  static uint64_t id;
+  uint8_t         buf[2 + 1 + 8 + 9 + 1];
+  uint8_t         *p = buf + 2;
+  lrec_t          *r = _record_slot();
 
-  va_start(valist, fmt);
-  vsnprintf(lcfg.buf + lcfg.offset,
-            LOGGING_BUF_LENGTH - lcfg.offset,
-            fmt,
-            valist);
+  if (!r || STALLED(r)) {
+    return -1;
+  }
+  if (!id) {
+    /* FNV-1a of the descriptors, the host hashes the section of the ELF file */
+    id = 0xCBF29CE484222325ull;
+    for (const char *c = __start_logging_fmt; c < __stop_logging_fmt; c++) {
+      id = (id ^ (uint8_t)*c) * 0x100000001B3ull;
+    }
+  }
+  *p++ = LBIN_SYNC;
+  for (int i = 0; i < 8; i++) {
+    *p++ = (uint8_t)(id >> (i * 8));
+  }
+  p = _kv_head(p, buf + sizeof(buf) - 1, 0, LOGGING_TIMESTAMP_HZ);
+  return _frame_out(r, LBIN_FRAME_START, buf, p);
+}
+#endif // #if (BINARY_ON != 0)
 
-  __logging(lcfg.buf);
-  return 0;
+#if (RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)
+int logging_recorder_dump(void)
+{
+  lrec_t *r = _record_slot();
+  int    n  = 0;
+
+  if (!r) {
+    return 0;
+  }
+  for (int c = 0; c < LREC_NUM; c++) {
+    lrec_t *src = &lrec[c];
+
+    /* Stop at the first record not accepted, the rest is kept */
+    for (; src->rec_num; src->rec_num--) {
+      const lrecorded_t *e = &src->rec[(src->rec_head + RECORDER_NUM - src->rec_num)
+                                       % RECORDER_NUM];
+
+      _record_start(r);
+#if (COMPACT_ON != 0)
+      _fill_level(&r->out, e->lvl);
+#if (LOCATION_ON != 0)
+      _fill_file_line(&r->out, e->file_name, e->line);
+#endif
+      lfmt_write(&r->out, "[REC] ", 6);
+#else
+      lfmt_write(&r->out, "[REC]", 5);
+#if (LOCATION_ON != 0)
+      _fill_file_line(&r->out, e->file_name, e->line);
+#endif
+      _fill_level(&r->out, e->lvl);
+      lfmt_write(&r->out, ": ", 2);
+#endif
+      lfmt_unpack(&r->out, e->fmt, e->args, e->len);
+      if (_record_end(r)) {
+        return n;
+      }
+      n++;
+    }
+  }
+  return n;
 }
+#endif
 
 void log_n(void)
 {
-  __logging("\n");
+  logging_plain("\n");
 }
 
 /**
@@ -290,23 +2013,22 @@ void log_n(void)
  */
 static void __logging_welcome(void)
 {
-  char buf[100] = { 0 };
-
-  snprintf(buf, 100,
-           "\r\n"
-           RTT_CTRL_BG_BRIGHT_BLUE
-           "*** Project Boots Up. Compiled @ [%s - %s] ***"
-           RTT_CTRL_RESET
-           "\n",
-           __DATE__,
-           __TIME__);
-  __logging(buf);
+  logging_plain("\r\n"
+                RTT_CTRL_BG_BRIGHT_BLUE
+                "*** Project Boots Up. Compiled @ [%s - %s] ***"
+                RTT_CTRL_RESET
+                "\n",
+                __DATE__,
+                __TIME__);
 }
 
 void logging_init(uint8_t level_threshold)
 {
   memset(&lcfg, 0, sizeof(lcfg_t));
-  lcfg.min_level = MIN(level_threshold, LOGGING_VERBOSE);
+  memset(lrec, 0, sizeof(lrec));
+  lcfg.min_level  = MIN(level_threshold, LOGGING_VERBOSE);
+  lcfg.interfaces = LOGGING_INTERFACE;
+  CLOCK_INIT();
 
 #if (TIME_ON != 0)
   if (SL_STATUS_OK != sl_sleeptimer_init()) {
@@ -319,8 +2041,21 @@ void logging_init(uint8_t level_threshold)
 #elif (LOGGING_INTERFACE == INTERFACE_BOTH)
   SEGGER_RTT_Init();
 #else
+#endif
+#if (RTT_PER_CONTEXT != 0)
+  for (int i = 1; i < LOGGING_CONTEXT_NUM; i++) {
+    lrec[i].channel = RTT_CONTEXT_CHANNEL + i - 1;
+    SEGGER_RTT_ConfigUpBuffer(lrec[i].channel, "Log", lrec_rtt[i - 1],
+                              RTT_CONTEXT_BUF_SIZE, SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+  }
+#endif
+#if (CTRL_ON != 0)
+  logging_ctrl_init();
 #endif
   __logging_welcome();
+#if (BINARY_ON != 0)
+  logging_binary_sync();
+#endif
 }
 
 void logging_level_threshold_set(uint8_t l)
@@ -329,32 +2064,276 @@ void logging_level_threshold_set(uint8_t l)
   lcfg.min_level = MIN(l, LOGGING_VERBOSE);
 }
 
+uint8_t logging_level_threshold_get(void)
+{
+  return lcfg.min_level;
+}
+
+void logging_interface_set(uint8_t interfaces)
+{
+  lcfg.interfaces = interfaces & LOGGING_INTERFACE;
+}
+
+uint8_t logging_interface_get(void)
+{
+  return lcfg.interfaces;
+}
+
+#if (MODULE_FILTER_NUM > 0)
+int logging_module_threshold_set(const char *module,
+                                 uint8_t    l)
+{
+  uint32_t h = _module_hash(module);
+  int      i;
+
+  for (i = 0; i < lmodule_num && lmodules[i].hash != h; i++) {
+  }
+  if (l == 0xFF) {
+    if (i < lmodule_num) {
+      /* Keep the in-use slots contiguous */
+      lmodules[i] = lmodules[--lmodule_num];
+    }
+    return 0;
+  }
+  if (i == MODULE_FILTER_NUM) {
+    return -1;
+  }
+  lmodules[i].hash  = h;
+  lmodules[i].level = MIN(l, LOGGING_VERBOSE);
+  if (i == lmodule_num) {
+    lmodule_num++;
+  }
+  return 0;
+}
+#endif
+
+#if (SITE_FILTER_NUM > 0)
+int logging_site_set(const char   *module,
+                     unsigned int line,
+                     uint8_t      enable)
+{
+  uint32_t h = _site_hash(_module_hash(module), line);
+  int      i;
+
+  for (i = 0; i < lsite_num && lsites[i] != h; i++) {
+  }
+  if (enable) {
+    if (i < lsite_num) {
+      lsites[i] = lsites[--lsite_num];
+    }
+    return 0;
+  }
+  if (i == SITE_FILTER_NUM) {
+    return -1;
+  }
+  lsites[i] = h;
+  if (i == lsite_num) {
+    lsite_num++;
+  }
+  return 0;
+}
+#endif
+
 void hex_dump(const uint8_t *array_base,
               size_t        len,
               uint8_t       align,
               uint8_t       reverse)
 {
+  static const char hex[] = "0123456789ABCDEF";
+  lrec_t            *r;
+
   if (!align) {
     align = 16;
   }
 
-  lcfg.offset = 0;
-  memset(lcfg.buf, 0, LOGGING_BUF_LENGTH);
+  r = _record_begin();
+  if (!r) {
+    return;
+  }
+#if (JSON_ON != 0)
+  _json_head(&r->out, -1, NULL, 0);
+#endif
   for (size_t i = 0; i < len; i++) {
-    int r = snprintf(lcfg.buf + lcfg.offset,
-                     LOGGING_BUF_LENGTH - lcfg.offset,
-                     (i + 1) % align ? "%02X " : "%02X\n",
-                     reverse ? array_base[len - i - 1] : array_base[i]);
-    if (r == -1) {
-      return;
-    }
-    lcfg.offset += r;
+    uint8_t b    = reverse ? array_base[len - i - 1] : array_base[i];
+    char    e[3] = { hex[b >> 4], hex[b & 0x0F], (i + 1) % align ? ' ' : '\n' };
+
+#if (JSON_ON != 0)
+    lfmt_write_json(&r->out, e, i + 1 < len ? sizeof(e) : 2);
+#else
+    lfmt_write(&r->out, e, sizeof(e));
+#endif
   }
-  __logging(lcfg.buf);
+#if (JSON_ON != 0)
+  /* The dump is a single record */
+  lfmt_write(&r->out, "\"}\n", 3);
+  _record_end(r);
+#else
+  _record_end(r);
   log_n();
+#endif
+}
+
+#if (STATS_ON != 0)
+void logging_stats_get(logging_stats_t *stats)
+{
+  if (!stats) {
+    return;
+  }
+
+  memset(stats, 0, sizeof(logging_stats_t));
+  for (int c = 0; c < LOGGING_CONTEXT_NUM; c++) {
+    for (int l = 0; l < LOGGING_LEVEL_NUM; l++) {
+      const logging_level_stats_t *src = &lstats[c].level[l];
+      logging_level_stats_t       *dst = &stats->level[l];
+
+      dst->calls     += src->calls;
+      dst->filtered  += src->filtered;
+      dst->emitted   += src->emitted;
+      dst->bytes     += src->bytes;
+      dst->truncated += src->truncated;
+      dst->dropped   += src->dropped;
+    }
+  }
+}
+
+void logging_stats_reset(void)
+{
+  memset(lstats, 0, sizeof(lstats));
+}
+#endif // #if (STATS_ON != 0)
+
+#if (WATERMARK_ON != 0)
+void logging_watermark_get(logging_watermark_t *wm)
+{
+  if (wm) {
+    memcpy(wm, &lwm, sizeof(logging_watermark_t));
+  }
+}
+
+void logging_watermark_reset(void)
+{
+  memset(&lwm, 0, sizeof(lwm));
+}
+#endif // #if (WATERMARK_ON != 0)
+
+#if (PROFILE_ON != 0)
+void logging_profile_dump(void)
+{
+  /* " 2147483648:4294967295" at most per bucket */
+  char line[32 + PROFILE_BUCKET_NUM * 22];
+
+  logging_plain("[PROF] <stage> <level> n=<samples> <cycles from>:<samples> ...\n");
+  for (int s = 0; s < PROFILE_STAGE_NUM; s++) {
+    for (int l = 0; l < LOGGING_LEVEL_NUM; l++) {
+      int      n   = 0;
+      uint32_t sum = 0;
+
+      for (int b = 0; b < PROFILE_BUCKET_NUM; b++) {
+        sum += lprof[s][l][b];
+      }
+      if (!sum) {
+        continue;
+      }
+      n += snprintf(line + n, sizeof(line) - n, "[PROF] %-9s %s n=%lu",
+                    profile_stage_names[s], lvl_names[l], (unsigned long)sum);
+      for (int b = 0; b < PROFILE_BUCKET_NUM && n < (int)sizeof(line); b++) {
+        if (!lprof[s][l][b]) {
+          continue;
+        }
+        n += snprintf(line + n, sizeof(line) - n, " %lu:%lu",
+                      b ? 1ul << (b - 1) : 0ul,
+                      (unsigned long)lprof[s][l][b]);
+      }
+      logging_plain("%s\n", line);
+    }
+  }
+}
+
+void logging_profile_reset(void)
+{
+  memset(lprof, 0, sizeof(lprof));
 }
+#endif // #if (PROFILE_ON != 0)
 #endif // #if (LOGGING_CONFIG > LIGHT_WEIGHT)
 
+#if (LOGGING_CONFIG == LIGHT_WEIGHT) && (LOGGING_INTERFACE == INTERFACE_BOTH)
+/**
+ * @brief _lw_both output a chunk to both interfaces
+ *
+ * @param arg - unused
+ * @param str - chunk
+ * @param len - chunk length in bytes
+ *
+ * @return len, a full RTT buffer doesn't stop the output to VCOM
+ */
+static size_t _lw_both(void       *arg,
+                       const char *str,
+                       size_t     len)
+{
+  (void)arg;
+  fwrite(str, 1, len, stdout);
+  SEGGER_RTT_Write(0, str, len);
+  return len;
+}
+
+static void _lw_vplain(const char *fmt,
+                       va_list    valist)
+{
+  char          buf[LW_CHUNK_LENGTH];
+  lfmt_stream_t out;
+
+  lfmt_init(&out, buf, sizeof(buf), _lw_both, NULL);
+  lfmt_vprintf(&out, fmt, valist);
+  lfmt_flush(&out);
+}
+
+void logging_lw_plain(const char *fmt,
+                      ...)
+{
+  va_list valist;
+
+  va_start(valist, fmt);
+  _lw_vplain(fmt, valist);
+  va_end(valist);
+}
+#endif
+
+#if (LOGGING_CONFIG == LIGHT_WEIGHT) && (LW_THUNK_ON != 0)
+#if (LOGGING_INTERFACE == SEGGER_RTT)
+#define LW_VPLAIN(fmt, valist)        SEGGER_RTT_vprintf(0, (fmt), &(valist))
+#elif (LOGGING_INTERFACE == VCOM)
+#define LW_VPLAIN(fmt, valist)        vprintf((fmt), (valist))
+#elif (LOGGING_INTERFACE == INTERFACE_BOTH)
+#define LW_VPLAIN(fmt, valist)        _lw_vplain((fmt), (valist))
+#else
+#define LW_VPLAIN(fmt, valist)
+#endif
+
+void __lw_log(const char   *file_name,
+              unsigned int line,
+              uint8_t      lvl,
+              const char   *fmt,
+              ...)
+{
+  static const char *const flags[] = {
+    FTL_FLAG, ERR_FLAG, WRN_FLAG, IPM_FLAG, DHL_FLAG, DBG_FLAG, VER_FLAG
+  };
+  const char *flag = flags[lvl < LOGGING_LEVEL_NUM ? lvl : LOGGING_VERBOSE];
+  char       ln[10], *p = ln + sizeof(ln);
+  va_list    valist;
+
+  do {
+    *--p  = '0' + line % 10;
+    line /= 10;
+  } while (line);
+  __lw_header(file_name, MIN(FILE_NAME_LENGTH, strcspn(file_name, ".")),
+              p, (size_t)(ln + sizeof(ln) - p), flag, strlen(flag));
+  va_start(valist, fmt);
+  LW_VPLAIN(fmt, valist);
+  va_end(valist);
+}
+#endif
+
 void logging_demo(uint8_t lvl)
 {
   const char *msg[] = {
@@ -70,11 +70,17 @@ extern "C"
     LOGI("Project Boots, Compiled at %s - %s.\n", __DATE__, __TIME__); \
   }while (0)
 #elif (LOGGING_INTERFACE == INTERFACE_BOTH)
-#define LOG_PLAIN(...)                 \
-  do {                                 \
-    printf(__VA_ARGS__);               \
-    SEGGER_RTT_printf(0, __VA_ARGS__); \
-  } while (0)
+/**
+ * @brief logging_lw_plain format a message once, chunk by chunk through a
+ * LW_CHUNK_LENGTH bytes buffer on the stack, and output every chunk to both
+ * interfaces.
+ *
+ * @param fmt - format string
+ * @param ... - parameters
+ */
+void logging_lw_plain(const char *fmt,
+                      ...);
+#define LOG_PLAIN(...)                logging_lw_plain(__VA_ARGS__)
 
 #define INIT_LOG(x)                                                    \
   do{                                                                  \
@@ -87,39 +93,152 @@ extern "C"
 #define INIT_LOG(x)
 #endif
 
-static inline void __fill_file_line(char         *in,
-                                    uint8_t      in_len,
-                                    const char   *file_name,
-                                    unsigned int line)
-{
-  char *p, *n, *posend;
-  char tmp[FILE_NAME_LENGTH] = { 0 };
+#if (LOGGING_INTERFACE == SEGGER_RTT)
+#define LW_WRITE(str, len)            SEGGER_RTT_Write(0, (str), (len))
+#elif (LOGGING_INTERFACE == VCOM)
+#define LW_WRITE(str, len)            fwrite((str), 1, (len), stdout)
+#elif (LOGGING_INTERFACE == INTERFACE_BOTH)
+#define LW_WRITE(str, len)                \
+  do {                                    \
+    fwrite((str), 1, (len), stdout);      \
+    SEGGER_RTT_Write(0, (str), (len));    \
+  } while (0)
+#else
+#define LW_WRITE(str, len)
+#endif
 
-  if (!file_name || !in) {
-    return;
-  }
+/*
+ * File name without path and the length of the module name in it, the
+ * compiler folds both to constants with the builtins enabled.
+ */
+#define LW_BASENAME_(f, c)            (strrchr((f), (c)) ? strrchr((f), (c)) + 1 : (f))
+#if defined(__FILE_NAME__)
+#define LW_FILE_NAME                  __FILE_NAME__
+#else
+#define LW_FILE_NAME                  LW_BASENAME_(LW_BASENAME_(__FILE__, '/'), '\\')
+#endif
+#define LW_STEM_LEN                   MIN(FILE_NAME_LENGTH, strcspn(LW_FILE_NAME, "."))
+#define LW_STR_(x)                    #x
+#define LW_STR(x)                     LW_STR_(x)
 
-  p = in;
+/*
+ * [RT-dddd:hh:mm:ss][  filename:line ] + level flag + ": ", or with COMPACT_ON
+ * level code + "RT-d:hh:mm:ss " + "filename:line "
+ */
+#define LW_HEADER_LEN                 (19 + FILE_LINE_LENGTH + 24 + 2)
+
+/**
+ * @brief __lw_header emit the header of a message in a single pass, with a
+ * single write to the interface.
+ *
+ * @note the time fields are split with a single division, the others are done
+ * by multiplications with the reciprocals, exact in their ranges.
+ *
+ * @param stem - module name, not '\0' terminated
+ * @param stem_len - length of the module name
+ * @param line - line as a string
+ * @param line_len - length of the line string
+ * @param flag - level flag, the level code if COMPACT_ON
+ * @param flag_len - length of the level flag
+ */
+static inline void __lw_header(const char *stem,
+                               size_t     stem_len,
+                               const char *line,
+                               size_t     line_len,
+                               const char *flag,
+                               size_t     flag_len)
+{
+  char   hdr[LW_HEADER_LEN];
+  char   *p = hdr;
+  size_t n;
 
-  n = strrchr(file_name, '/');
-  if (!n) {
-    n = strrchr(file_name, '\\');
+#if (COMPACT_ON != 0)
+  *p++ = *flag;
+  (void)flag_len;
+#endif
+#if (TIME_ON != 0)
+  uint32_t t = TIME_GET();
+  uint32_t d = t / (24 * 60 * 60);
+  uint32_t r = t - d * (24 * 60 * 60);
+  uint32_t h = (r * 37283u) >> 27;  /* r / 3600 for r < 86400 */
+  uint32_t m;
+  char     *q;
+
+  r -= h * 3600u;
+  m  = (r * 34953u) >> 21;          /* r / 60 for r < 3600 */
+  r -= m * 60u;
+#if (COMPACT_ON != 0)
+  /* Days without padding */
+  memcpy(p, "RT-", 3);
+  q = p + 4;
+  for (uint32_t x = d / 10; x; x /= 10) {
+    q++;
   }
-  n      = (n ? n + 1 : (char *)file_name);
-  posend = strchr(n, '.');
-
-  memcpy(tmp,
-         n,
-         MIN(FILE_NAME_LENGTH, posend - n));
-
-  snprintf(p,
-           in_len,
-           "[%10.10s:%-5d]",
-           tmp,
-           line);
-  return;
+  *q = ':';
+  p  = q + 1;
+#else
+  memcpy(p, "[RT-    :", 9);
+  /* Days right aligned in 4 digits, or more */
+  q  = p + (d > 9999 ? 9 : 8);
+  *q = ':';
+  p  = q + 1;
+#endif
+  do {
+    *--q = '0' + d % 10;
+    d   /= 10;
+  } while (d);
+  *p++ = '0' + ((h * 205u) >> 11);  /* x / 10 for x < 1029 */
+  *p++ = '0' + h - ((h * 205u) >> 11) * 10;
+  *p++ = ':';
+  *p++ = '0' + ((m * 205u) >> 11);
+  *p++ = '0' + m - ((m * 205u) >> 11) * 10;
+  *p++ = ':';
+  *p++ = '0' + ((r * 205u) >> 11);
+  *p++ = '0' + r - ((r * 205u) >> 11) * 10;
+#if (COMPACT_ON != 0)
+  *p++ = ' ';
+#else
+  *p++ = ']';
+#endif
+#endif
+
+#if (COMPACT_ON != 0)
+  memcpy(p, stem, stem_len);
+  p   += stem_len;
+  *p++ = ':';
+  n    = MIN(line_len, LINE_NAME_LENGTH);
+  memcpy(p, line, n);
+  p   += n;
+  *p++ = ' ';
+#else
+  *p++ = '[';
+  memset(p, ' ', FILE_NAME_LENGTH - stem_len);
+  p += FILE_NAME_LENGTH - stem_len;
+  memcpy(p, stem, stem_len);
+  p   += stem_len;
+  *p++ = ':';
+  n    = MIN(line_len, LINE_NAME_LENGTH);
+  memcpy(p, line, n);
+  memset(p + n, ' ', LINE_NAME_LENGTH - n);
+  p   += LINE_NAME_LENGTH;
+  *p++ = ']';
+  n    = MIN(flag_len, (size_t)(hdr + sizeof(hdr) - 2 - p));
+  memcpy(p, flag, n);
+  p   += n;
+  *p++ = ':';
+  *p++ = ' ';
+#endif
+  LW_WRITE(hdr, (unsigned)(p - hdr));
 }
 
+#define LOG_HEADER_(flag, flag_len)                    \
+  __lw_header(LW_FILE_NAME, LW_STEM_LEN,               \
+              LW_STR(__LINE__), sizeof(LW_STR(__LINE__)) - 1, \
+              (flag), (flag_len))
+
+/* The flag must be a string literal */
+#define LOG_HEADER(flag)              LOG_HEADER_(flag, sizeof(flag) - 1)
+
 #define HEX_DUMP(array_base, array_size, align, reverse)                                                                       \
   do {                                                                                                                         \
     for (int i_log_exlusive = 0; i_log_exlusive < (array_size); i_log_exlusive++) {                                            \
@@ -132,88 +251,100 @@ static inline void __fill_file_line(char         *in,
 #define HEX_DUMP_16(array_base, len)  HEX_DUMP((array_base), (len), 16, 0)
 #define HEX_DUMP_32(array_base, len)  HEX_DUMP((array_base), (len), 32, 0)
 
-#define LOG_FILL_HEADER(flag)                                            \
-  char exclusive_buf__[PREF_LEN] = { 0 };                                \
-  char     exclusive_buf__1[FILE_LINE_LEN] = { 0 };                      \
-  uint32_t t                               = TIME_GET();                 \
-  __fill_file_line(exclusive_buf__1, FILE_LINE_LEN, __FILE__, __LINE__); \
-  sprintf(exclusive_buf__, FMT_PREF,                                     \
-          t / (24 * 60 * 60),                                            \
-          (t % (24 * 60 * 60)) / (60 * 60),                              \
-          (t % (60 * 60)) / (60),                                        \
-          t % 60,                                                        \
-          exclusive_buf__1,                                              \
-          (flag)                                                         \
-          );                                                             \
-
-#define LOG(lvl, fmt, ...)                                           \
-  do {                                                               \
-    if (LOGGING_LEVEL > (lvl)) {                                     \
-      LOG_FILL_HEADER((lvl) == LOGGING_FATAL ? FTL_FLAG              \
-                      : (lvl) == LOGGING_ERROR ? ERR_FLAG            \
-                      : (lvl) == LOGGING_WARNING ? WRN_FLAG          \
-                      : (lvl) == LOGGING_IMPORTANT_INFO ? IPM_FLAG   \
-                      : (lvl) == LOGGING_DEBUG_HIGHTLIGHT ? DHL_FLAG \
-                      : (lvl) == LOGGING_DEBUG ? DBG_FLAG            \
-                      : VER_FLAG);                                   \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__);       \
-    }                                                                \
+#define LW_FLAG(lvl)                                \
+  ((lvl) == LOGGING_FATAL ? FTL_FLAG                \
+   : (lvl) == LOGGING_ERROR ? ERR_FLAG              \
+   : (lvl) == LOGGING_WARNING ? WRN_FLAG            \
+   : (lvl) == LOGGING_IMPORTANT_INFO ? IPM_FLAG     \
+   : (lvl) == LOGGING_DEBUG_HIGHTLIGHT ? DHL_FLAG   \
+   : (lvl) == LOGGING_DEBUG ? DBG_FLAG              \
+   : VER_FLAG)
+
+#if (LW_THUNK_ON != 0)
+/**
+ * @brief __lw_log emit the header and the message of a call site out of line,
+ * so a call site is only the call with its parameters.
+ *
+ * @param file_name - file name without path
+ * @param line - line of the call site
+ * @param lvl - logging message level
+ * @param fmt - format string
+ * @param ... - parameters
+ */
+void __lw_log(const char   *file_name,
+              unsigned int line,
+              uint8_t      lvl,
+              const char   *fmt,
+              ...);
+
+#define LW_LOG_(lvl, flag, flag_len, __fmt__, ...) \
+  __lw_log(LW_FILE_NAME, __LINE__, (lvl), __fmt__, ##__VA_ARGS__)
+#else
+#define LW_LOG_(lvl, flag, flag_len, __fmt__, ...) \
+  do {                                             \
+    LOG_HEADER_(flag, flag_len);                   \
+    LOG_PLAIN(__fmt__, ##__VA_ARGS__);             \
+  } while (0)
+#endif
+
+/* The flag must be a string literal */
+#define LW_LOG(lvl, flag, __fmt__, ...) \
+  LW_LOG_(lvl, flag, sizeof(flag) - 1, __fmt__, ##__VA_ARGS__)
+
+#define LOG(lvl, __fmt__, ...)                                                  \
+  do {                                                                          \
+    if (LOGGING_LEVEL >= (lvl)) {                                               \
+      LW_LOG_(lvl, LW_FLAG(lvl), strlen(LW_FLAG(lvl)), __fmt__, ##__VA_ARGS__); \
+    }                                                                           \
   }while(0)
 
-#define LOGF(__fmt__, ...)                                   \
-  do {                                                       \
-    LOG_FILL_HEADER(FTL_FLAG);                               \
-    LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-    ABORT();                                                 \
+#define LOGF(__fmt__, ...)                                    \
+  do {                                                        \
+    LW_LOG(LOGGING_FATAL, FTL_FLAG, __fmt__, ##__VA_ARGS__);  \
+    ABORT();                                                  \
+  } while (0)
+
+#define LOGE(__fmt__, ...)                                      \
+  do {                                                          \
+    if (LOGGING_LEVEL >=  LOGGING_ERROR) {                      \
+      LW_LOG(LOGGING_ERROR, ERR_FLAG, __fmt__, ##__VA_ARGS__);  \
+      ERR_ABORT();                                              \
+    }                                                           \
   } while (0)
 
-#define LOGE(__fmt__, ...)                                     \
-  do {                                                         \
-    if (LOGGING_LEVEL >=  LOGGING_ERROR) {                     \
-      LOG_FILL_HEADER(ERR_FLAG);                               \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-      ERR_ABORT();
-}\
-}while (0)
-
-#define LOGW(__fmt__, ...)                                     \
-  do {                                                         \
-    if (LOGGING_LEVEL >=  LOGGING_WARNING) {                   \
-      LOG_FILL_HEADER(WRN_FLAG);                               \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-    }                                                          \
+#define LOGW(__fmt__, ...)                                        \
+  do {                                                            \
+    if (LOGGING_LEVEL >=  LOGGING_WARNING) {                      \
+      LW_LOG(LOGGING_WARNING, WRN_FLAG, __fmt__, ##__VA_ARGS__);  \
+    }                                                             \
   } while (0)
 
-#define LOGI(__fmt__, ...)                                     \
-  do {                                                         \
-    if (LOGGING_LEVEL >=  LOGGING_IMPORTANT_INFO) {            \
-      LOG_FILL_HEADER(IPM_FLAG);                               \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-    }                                                          \
+#define LOGI(__fmt__, ...)                                               \
+  do {                                                                   \
+    if (LOGGING_LEVEL >=  LOGGING_IMPORTANT_INFO) {                      \
+      LW_LOG(LOGGING_IMPORTANT_INFO, IPM_FLAG, __fmt__, ##__VA_ARGS__);  \
+    }                                                                    \
   } while (0)
 
-#define LOGH(__fmt__, ...)                                     \
-  do {                                                         \
-    if (LOGGING_LEVEL >=  LOGGING_DEBUG_HIGHTLIGHT) {          \
-      LOG_FILL_HEADER(DHL_FLAG);                               \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-    }                                                          \
+#define LOGH(__fmt__, ...)                                                 \
+  do {                                                                     \
+    if (LOGGING_LEVEL >=  LOGGING_DEBUG_HIGHTLIGHT) {                      \
+      LW_LOG(LOGGING_DEBUG_HIGHTLIGHT, DHL_FLAG, __fmt__, ##__VA_ARGS__);  \
+    }                                                                      \
   } while (0)
 
-#define LOGD(__fmt__, ...)                                     \
-  do {                                                         \
-    if (LOGGING_LEVEL >=  LOGGING_DEBUG) {                     \
-      LOG_FILL_HEADER(DBG_FLAG);                               \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-    }                                                          \
+#define LOGD(__fmt__, ...)                                      \
+  do {                                                          \
+    if (LOGGING_LEVEL >=  LOGGING_DEBUG) {                      \
+      LW_LOG(LOGGING_DEBUG, DBG_FLAG, __fmt__, ##__VA_ARGS__);  \
+    }                                                           \
   } while (0)
 
-#define LOGV(__fmt__, ...)                                     \
-  do {                                                         \
-    if (LOGGING_LEVEL >=  LOGGING_VERBOSE) {                   \
-      LOG_FILL_HEADER(VER_FLAG);                               \
-      LOG_PLAIN("%s" __fmt__, exclusive_buf__, ##__VA_ARGS__); \
-    }                                                          \
+#define LOGV(__fmt__, ...)                                        \
+  do {                                                            \
+    if (LOGGING_LEVEL >=  LOGGING_VERBOSE) {                      \
+      LW_LOG(LOGGING_VERBOSE, VER_FLAG, __fmt__, ##__VA_ARGS__);  \
+    }                                                             \
   } while (0)
 
 /* Light weight mode end */
@@ -249,6 +380,61 @@ void log_n(void);
  */
 void logging_level_threshold_set(uint8_t l);
 
+/**
+ * @brief logging_level_threshold_get get the logging level threshold
+ *
+ * @return current level threshold
+ */
+uint8_t logging_level_threshold_get(void);
+
+/**
+ * @brief logging_interface_set select which of the built-in logging
+ * interfaces the messages are sent to at runtime
+ *
+ * @param interfaces - bitmask of SEGGER_RTT and VCOM, bits not in
+ * LOGGING_INTERFACE are ignored, 0 mutes the logging
+ */
+void logging_interface_set(uint8_t interfaces);
+
+/**
+ * @brief logging_interface_get get the logging interfaces in use
+ *
+ * @return bitmask of SEGGER_RTT and VCOM
+ */
+uint8_t logging_interface_get(void);
+
+#if (MODULE_FILTER_NUM > 0)
+/**
+ * @brief logging_module_threshold_set set the level threshold of a single
+ * module, overriding the global one in either direction
+ *
+ * @param module - module name, which is the source file name without path and
+ * extension, e.g. "gatt" for "src/gatt.c", path and extension are stripped if
+ * given
+ * @param l - new level, 0xFF to remove the override
+ *
+ * @return 0 on success, -1 if all MODULE_FILTER_NUM slots are in use
+ */
+int logging_module_threshold_set(const char *module,
+                                 uint8_t    l);
+#endif
+
+#if (SITE_FILTER_NUM > 0)
+/**
+ * @brief logging_site_set enable or disable a single logging call site, fatal
+ * messages cannot be disabled
+ *
+ * @param module - module name, see logging_module_threshold_set()
+ * @param line - line of the call site
+ * @param enable - 0 to disable, 1 to enable again
+ *
+ * @return 0 on success, -1 if all SITE_FILTER_NUM slots are in use
+ */
+int logging_site_set(const char   *module,
+                     unsigned int line,
+                     uint8_t      enable);
+#endif
+
 /**
  * @brief __log function to wrap a logging message with all prefix tags and put
  * them altogether to the logging buffer.
@@ -259,7 +445,8 @@ void logging_level_threshold_set(uint8_t l);
  * @param fmt - format string
  * @param ... - parameters
  *
- * @return 0 on success, -1 otherwise
+ * @return 0 on success, -1 if the message was not completely accepted by the
+ * logging interface or the prefix tags failed
  */
 int  __log(const char   *file_name,
            unsigned int line,
@@ -267,6 +454,25 @@ int  __log(const char   *file_name,
            const char   *fmt,
            ...);
 
+/**
+ * @brief __log_str log a constant message, with the same prefix tags as
+ * __log(). The message is copied as is, without being parsed as a format
+ * string.
+ *
+ * @param file_name - file name (location) information
+ * @param line - line (location) information
+ * @param lvl - logging message level information
+ * @param str - message
+ * @param len - length of the message
+ *
+ * @return same as __log()
+ */
+int  __log_str(const char   *file_name,
+               unsigned int line,
+               int          lvl,
+               const char   *str,
+               size_t       len);
+
 /**
  * @brief hex_dump function to dump an array of content which is not printable
  * string.
@@ -305,9 +511,420 @@ void logging_demo(uint8_t lvl);
 void test_hex_dump(void);
 /**  @} logging_func */
 
+#if (STATS_ON != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_stats
+ * @brief logging statistics for the full featured mode.
+ *
+ ******************************************************************
+ * @{ */
+
+/**
+ * @brief counters of a single logging level
+ */
+typedef struct {
+  uint32_t calls;     /**< Logging calls made, filtered ones included */
+  uint32_t filtered;  /**< Calls discarded by the level threshold */
+  uint32_t emitted;   /**< Records completely accepted by the interface */
+  uint32_t bytes;     /**< Bytes accepted by the interface */
+  uint32_t truncated; /**< Records cut short by the interface after being partially accepted */
+  uint32_t dropped;   /**< Records not accepted by the interface at all */
+}logging_level_stats_t;
+
+/**
+ * @brief logging statistics, indexed by logging level
+ */
+typedef struct {
+  logging_level_stats_t level[LOGGING_LEVEL_NUM];
+}logging_stats_t;
+
+/**
+ * @brief logging_stats_get get the statistics summed over all execution
+ * contexts since boot or the last logging_stats_reset().
+ *
+ * @param stats - output statistics
+ */
+void logging_stats_get(logging_stats_t *stats);
+
+/**
+ * @brief logging_stats_reset clear all the statistics counters.
+ */
+void logging_stats_reset(void);
+/**  @} logging_stats */
+#endif // #if (STATS_ON != 0)
+
+#if (PROFILE_ON != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_profile
+ * @brief cycle profiler of the __log() stages for the full featured mode.
+ *
+ ******************************************************************
+ * @{ */
+
+/**
+ * @brief logging_profile_dump output the latency histograms of every stage
+ * and level which has samples, one line each, through logging_plain().
+ */
+void logging_profile_dump(void);
+
+/**
+ * @brief logging_profile_reset clear all the latency histograms.
+ */
+void logging_profile_reset(void);
+/**  @} logging_profile */
+#endif // #if (PROFILE_ON != 0)
+
+#if (WATERMARK_ON != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_watermark
+ * @brief memory high-water marks for sizing the buffers in the full featured
+ * mode.
+ *
+ ******************************************************************
+ * @{ */
+
+/**
+ * @brief memory high-water marks
+ */
+typedef struct {
+  uint32_t msg_max;                                    /**< Longest message rendered by __log() in bytes, prefix tags included */
+  uint32_t msg_size_hist[WATERMARK_BUCKET_NUM];        /**< Rendered message sizes, bucket n counts [2^(n-1), 2^n) bytes */
+  uint32_t stack_peak;                                 /**< Peak stack used below __log() in bytes, 0 if not probed */
+#if (LOGGING_INTERFACE & SEGGER_RTT)
+  uint32_t rtt_up_peak[SEGGER_RTT_MAX_NUM_UP_BUFFERS]; /**< Peak fill of each RTT up-buffer in bytes, sampled after every write */
+#endif
+}logging_watermark_t;
+
+/**
+ * @brief logging_watermark_get get the high-water marks since boot or the last
+ * logging_watermark_reset().
+ *
+ * @param wm - output high-water marks
+ */
+void logging_watermark_get(logging_watermark_t *wm);
+
+/**
+ * @brief logging_watermark_reset clear all the high-water marks.
+ */
+void logging_watermark_reset(void);
+/**  @} logging_watermark */
+#endif // #if (WATERMARK_ON != 0)
+
+#if (RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_recorder
+ * @brief flight recorder of the records skipped while the RTT reader is
+ * stalled, see RTT_STALL_WRITES.
+ *
+ ******************************************************************
+ * @{ */
+
+/**
+ * @brief logging_recorder_dump format the records in the flight recorder of
+ * every context, oldest first, and output them prefixed by "[REC]". The
+ * records output are removed from the recorder, it stops at the first one not
+ * accepted by the interface.
+ *
+ * @return number of records output
+ */
+int logging_recorder_dump(void);
+/**  @} logging_recorder */
+#endif
+
+#if (KV_ON != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_kv
+ * @brief structured key/value logging, e.g.
+ *
+ *   LOGI_KV("conn", "handle", h, "rssi", rssi);
+ *
+ * The event name and the keys must be string literals. They are interned at
+ * compile time into a call site descriptor in the logging_kv section, so only
+ * the offset of the descriptor goes out with the values. Up to 8 values of
+ * integer, floating point or string type, or KV_BYTES(), are encoded as CBOR
+ * data items into a frame:
+ *
+ *   0x1D, payload length, payload, CRC-8 of the length and payload
+ *
+ * The payload is the level (bits 0-2) and a time flag (bit 3) in one byte, the
+ * descriptor offset, the time in seconds if flagged and the values. The frames
+ * are mixed with the text records in order, tools/logkv.c decodes them with
+ * the descriptors from the ELF file.
+ *
+ ******************************************************************
+ * @{ */
+
+#define LKV_FRAME_START               0x1D
+#define LKV_SECTION                   "logging_kv"
+
+/* Types of the values as passed to __log_kv() */
+#define LKV_INT                       1
+#define LKV_UINT                      2
+#define LKV_LONG                      3
+#define LKV_ULONG                     4
+#define LKV_LLONG                     5
+#define LKV_ULLONG                    6
+#define LKV_DOUBLE                    7
+#define LKV_STR                       8
+#define LKV_BYTES                     9
+
+/**
+ * @brief raw bytes value, see KV_BYTES()
+ */
+typedef struct {
+  const void *data; /**< Bytes */
+  size_t     len;   /**< Number of bytes */
+}logging_kv_bytes_t;
+
+#define KV_BYTES(p, n)                (&(const logging_kv_bytes_t){ (p), (n) })
+
+/* Values of other types don't compile */
+#define LKV_TYPE(v)                              \
+  _Generic((v),                                  \
+           _Bool: LKV_INT,                       \
+           char: LKV_INT,                        \
+           signed char: LKV_INT,                 \
+           unsigned char: LKV_INT,               \
+           short: LKV_INT,                       \
+           unsigned short: LKV_INT,              \
+           int: LKV_INT,                         \
+           unsigned int: LKV_UINT,               \
+           long: LKV_LONG,                       \
+           unsigned long: LKV_ULONG,             \
+           long long: LKV_LLONG,                 \
+           unsigned long long: LKV_ULLONG,       \
+           float: LKV_DOUBLE,                    \
+           double: LKV_DOUBLE,                   \
+           char *: LKV_STR,                      \
+           const char *: LKV_STR,                \
+           const logging_kv_bytes_t *: LKV_BYTES)
+
+/* Number of key/value pairs, an odd number of parameters doesn't compile */
+#define LKV_PAIRS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, \
+                   _13, _14, _15, _16, n, ...)                        n
+#define LKV_PAIRS(...)                                                       \
+  LKV_PAIRS_(_, ##__VA_ARGS__, 8, x, 7, x, 6, x, 5, x, 4, x, 3, x, 2, x, 1, \
+             x, 0)
+#define LKV_CAT_(a, b)                a ## b
+#define LKV_CAT(a, b)                 LKV_CAT_(a, b)
+#define LKV_MAP_(m, n, ...)           LKV_CAT(LKV_ ## m, n)(__VA_ARGS__)
+#define LKV_MAP(m, ...)               LKV_MAP_(m, LKV_PAIRS(__VA_ARGS__), ##__VA_ARGS__)
+
+/* Keys, '\0' separated */
+#define LKV_K0()
+#define LKV_K1(k, v)                  k "\0"
+#define LKV_K2(k, v, ...)             k "\0" LKV_K1(__VA_ARGS__)
+#define LKV_K3(k, v, ...)             k "\0" LKV_K2(__VA_ARGS__)
+#define LKV_K4(k, v, ...)             k "\0" LKV_K3(__VA_ARGS__)
+#define LKV_K5(k, v, ...)             k "\0" LKV_K4(__VA_ARGS__)
+#define LKV_K6(k, v, ...)             k "\0" LKV_K5(__VA_ARGS__)
+#define LKV_K7(k, v, ...)             k "\0" LKV_K6(__VA_ARGS__)
+#define LKV_K8(k, v, ...)             k "\0" LKV_K7(__VA_ARGS__)
+
+/* Types, 4 bits each from the first value on */
+#define LKV_T0()                      0u
+#define LKV_T1(k, v)                  ((uint32_t)LKV_TYPE(v))
+#define LKV_T2(k, v, ...)             (LKV_T1(k, v) | LKV_T1(__VA_ARGS__) << 4)
+#define LKV_T3(k, v, ...)             (LKV_T1(k, v) | LKV_T2(__VA_ARGS__) << 4)
+#define LKV_T4(k, v, ...)             (LKV_T1(k, v) | LKV_T3(__VA_ARGS__) << 4)
+#define LKV_T5(k, v, ...)             (LKV_T1(k, v) | LKV_T4(__VA_ARGS__) << 4)
+#define LKV_T6(k, v, ...)             (LKV_T1(k, v) | LKV_T5(__VA_ARGS__) << 4)
+#define LKV_T7(k, v, ...)             (LKV_T1(k, v) | LKV_T6(__VA_ARGS__) << 4)
+#define LKV_T8(k, v, ...)             (LKV_T1(k, v) | LKV_T7(__VA_ARGS__) << 4)
+
+/* Values, each with a leading comma */
+#define LKV_V0()
+#define LKV_V1(k, v)                  , (v)
+#define LKV_V2(k, v, ...)             , (v) LKV_V1(__VA_ARGS__)
+#define LKV_V3(k, v, ...)             , (v) LKV_V2(__VA_ARGS__)
+#define LKV_V4(k, v, ...)             , (v) LKV_V3(__VA_ARGS__)
+#define LKV_V5(k, v, ...)             , (v) LKV_V4(__VA_ARGS__)
+#define LKV_V6(k, v, ...)             , (v) LKV_V5(__VA_ARGS__)
+#define LKV_V7(k, v, ...)             , (v) LKV_V6(__VA_ARGS__)
+#define LKV_V8(k, v, ...)             , (v) LKV_V7(__VA_ARGS__)
+
+#define LKV_STR_(x)                   #x
+#define LKV_LINE(x)                   LKV_STR_(x)
+
+/**
+ * @brief __log_kv encode a key/value record and put it to the logging buffer,
+ * use the LOGx_KV() macros instead.
+ *
+ * @param site - call site descriptor in the logging_kv section, starting with
+ * the file name
+ * @param line - line of the call site
+ * @param lvl - logging message level information
+ * @param types - LKV_xxx type of each value, 4 bits each
+ * @param ... - values
+ *
+ * @return same as __log()
+ */
+int __log_kv(const char   *site,
+             unsigned int line,
+             int          lvl,
+             uint32_t     types,
+             ...);
+
+/* Descriptor: file name, line, event name and keys, '\0' separated */
+#define LOG_KV(lvl, event, ...)                                                \
+  do {                                                                         \
+    static const char lkv_site__[] __attribute__((section(LKV_SECTION), used)) \
+      = __FILE__ "\0" LKV_LINE(__LINE__) "\0" event "\0"                       \
+        LKV_MAP(K, ##__VA_ARGS__);                                             \
+    __log_kv(lkv_site__, __LINE__, (lvl),                                      \
+             LKV_MAP(T, ##__VA_ARGS__) LKV_MAP(V, ##__VA_ARGS__));             \
+  } while (0)
+
+#define LOGF_KV(event, ...) \
+  do { LOG_KV(LOGGING_FATAL, event, ##__VA_ARGS__); ABORT(); } while (0)
+#define LOGE_KV(event, ...) \
+  do { LOG_KV(LOGGING_ERROR, event, ##__VA_ARGS__); ERR_ABORT(); } while (0)
+#define LOGW_KV(event, ...)           LOG_KV(LOGGING_WARNING, event, ##__VA_ARGS__)
+#define LOGI_KV(event, ...)           LOG_KV(LOGGING_IMPORTANT_INFO, event, ##__VA_ARGS__)
+#define LOGH_KV(event, ...)           LOG_KV(LOGGING_DEBUG_HIGHTLIGHT, event, ##__VA_ARGS__)
+#define LOGD_KV(event, ...)           LOG_KV(LOGGING_DEBUG, event, ##__VA_ARGS__)
+#define LOGV_KV(event, ...)           LOG_KV(LOGGING_VERBOSE, event, ##__VA_ARGS__)
+/**  @} logging_kv */
+#endif // #if (KV_ON != 0)
+
+#if (BINARY_ON != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_bin
+ * @brief binary records of the LOGx() macros, see BINARY_ON. The format
+ * string, file name and line of every call site are interned at compile time
+ * into a descriptor in the logging_fmt section, '\0' separated, and a record
+ * only carries the offset of the descriptor with the parameters, in a frame
+ * like the ones of LOGx_KV():
+ *
+ *   0x1C, payload length, payload, CRC-8 of the length and payload
+ *
+ * The payload is the level (bits 0-2) and a time flag (bit 3) in one byte, the
+ * descriptor offset and the timestamp of LOGGING_TIMESTAMP() as CBOR unsigned
+ * integers, and the parameters packed by lfmt_vpack(), in the native sizes and
+ * byte order of the target.
+ *
+ * A sync record has bit 7 set in its first byte, followed by the build ID, a
+ * 64-bit FNV-1a hash of the logging_fmt section little endian, and
+ * LOGGING_TIMESTAMP_HZ as a CBOR unsigned integer. tools/logdec.c checks the
+ * build ID against the ELF file it decodes the records with.
+ *
+ ******************************************************************
+ * @{ */
+
+#define LBIN_FRAME_START              0x1C
+#define LBIN_SECTION                  "logging_fmt"
+#define LBIN_SYNC                     0x80
+
+#define LBIN_STR_(x)                  #x
+#define LBIN_LINE(x)                  LBIN_STR_(x)
+
+/**
+ * @brief __log_bin pack the parameters of a message and put the record to the
+ * logging buffer, use the LOGx() macros instead.
+ *
+ * @param site - call site descriptor in the logging_fmt section, starting with
+ * the format string
+ * @param line - line of the call site
+ * @param lvl - logging message level information
+ * @param ... - parameters
+ *
+ * @return same as __log()
+ */
+int __log_bin(const char   *site,
+              unsigned int line,
+              int          lvl,
+              ...);
+
+/**
+ * @brief logging_binary_sync output a sync record, with the build ID and the
+ * timestamp rate. Done by logging_init(), call it periodically so captures
+ * started later can be checked against the ELF file too.
+ *
+ * @return same as __log()
+ */
+int logging_binary_sync(void);
+/**  @} logging_bin */
+#endif // #if (BINARY_ON != 0)
+
+#if (COMPRESS_ON != 0)
+/**
+ * ******************************************************************
+ * @defgroup logging_lz
+ * @brief compressed output, see COMPRESS_ON. Everything the full featured
+ * mode outputs, the text and the binary frames, goes out in frames:
+ *
+ *   0x1A, flags, raw length, payload length, payload, CRC-8 of the flags,
+ *   lengths and payload
+ *
+ * The flags are a 7-bit sequence number, and bit 7 if the history has been
+ * dropped before the frame. The lengths are unsigned LEB128, the raw length
+ * at most COMPRESS_WINDOW / 2. The payload is the sequences of literal runs
+ * and back references of LZ4 blocks, the references may reach back into the
+ * frames before, up to COMPRESS_WINDOW bytes. A frame which doesn't fit into
+ * the RTT up-buffer is dropped and taken back out of the history, it has no
+ * sequence number. tools/logunz.c decompresses the frames from a restart on,
+ * and again from the next restart if one is missing or corrupt.
+ *
+ ******************************************************************
+ * @{ */
+
+#define LZ_FRAME_START                0x1A
+#define LZ_RESTART                    0x80
+/**  @} logging_lz */
+#endif // #if (COMPRESS_ON != 0)
+
+#if (CTRL_ON != 0)
+#include "logging_ctrl.h"
+#endif
+
 #define INIT_LOG(x)                   logging_init(x)
 
-#define LOG(lvl, fmt, ...)            __log(__FILE__, __LINE__, (lvl), (fmt), ##__VA_ARGS__)
+/*
+ * LOG_ARGS_() expands to 1 if there are parameters after the format string,
+ * up to 24 of them, 0 otherwise.
+ */
+#define LOG_ARGS_N_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12,  \
+                    _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, \
+                    _24, n, ...)                                            n
+#define LOG_ARGS_(...)                                                 \
+  LOG_ARGS_N_(_, ##__VA_ARGS__, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, \
+              1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0)
+#define LOG_CAT_(a, b)                a ## b
+#define LOG_SEL_(n)                   LOG_CAT_(LOG_, n)
+
+/*
+ * A message without parameters is copied as a constant, with its length known
+ * at compile time, unless it has a '%' in it or isn't a literal. Other
+ * compilers can't tell, so it is formatted.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_0(lvl, fmt)                                                \
+  ((__builtin_constant_p(strchr((fmt), '%') == NULL)                    \
+    && strchr((fmt), '%') == NULL)                                      \
+   ? __log_str(__FILE__, __LINE__, (lvl), (fmt), strlen(fmt))           \
+   : __log(__FILE__, __LINE__, (lvl), (fmt)))
+#else
+#define LOG_0(lvl, fmt)               __log(__FILE__, __LINE__, (lvl), (fmt))
+#endif
+#define LOG_1(lvl, fmt, ...)          __log(__FILE__, __LINE__, (lvl), (fmt), __VA_ARGS__)
+
+#if (BINARY_ON != 0)
+/* Descriptor: format string, file name and line, '\0' separated */
+#define LOG(lvl, fmt, ...)                                                       \
+  ({                                                                             \
+    static const char lbin_site__[] __attribute__((section(LBIN_SECTION), used)) \
+      = fmt "\0" __FILE__ "\0" LBIN_LINE(__LINE__);                              \
+    __log_bin(lbin_site__, __LINE__, (lvl), ##__VA_ARGS__);                      \
+  })
+#else
+#define LOG(lvl, fmt, ...)            LOG_SEL_(LOG_ARGS_(__VA_ARGS__))((lvl), (fmt), ##__VA_ARGS__)
+#endif
 #define LOGN()                        log_n()
 
 #define HEX_DUMP_8(array_base, len)   hex_dump((array_base), (len), 8, 0)
@@ -318,14 +935,14 @@ void test_hex_dump(void);
  * Below 7 LOGx macros are used for logging data in specific level.
  */
 #define LOGF(fmt, ...) \
-  do { LOG(LOGGING_FATAL, (fmt), ##__VA_ARGS__); ABORT(); } while (0)
+  do { LOG(LOGGING_FATAL, fmt, ##__VA_ARGS__); ABORT(); } while (0)
 #define LOGE(fmt, ...) \
-  do { LOG(LOGGING_ERROR, (fmt), ##__VA_ARGS__); ERR_ABORT(); } while(0)
-#define LOGW(fmt, ...)                LOG(LOGGING_WARNING, (fmt), ##__VA_ARGS__)
-#define LOGI(fmt, ...)                LOG(LOGGING_IMPORTANT_INFO, (fmt), ##__VA_ARGS__)
-#define LOGH(fmt, ...)                LOG(LOGGING_DEBUG_HIGHTLIGHT, (fmt), ##__VA_ARGS__)
-#define LOGD(fmt, ...)                LOG(LOGGING_DEBUG, (fmt), ##__VA_ARGS__)
-#define LOGV(fmt, ...)                LOG(LOGGING_VERBOSE, (fmt), ##__VA_ARGS__)
+  do { LOG(LOGGING_ERROR, fmt, ##__VA_ARGS__); ERR_ABORT(); } while(0)
+#define LOGW(fmt, ...)                LOG(LOGGING_WARNING, fmt, ##__VA_ARGS__)
+#define LOGI(fmt, ...)                LOG(LOGGING_IMPORTANT_INFO, fmt, ##__VA_ARGS__)
+#define LOGH(fmt, ...)                LOG(LOGGING_DEBUG_HIGHTLIGHT, fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...)                LOG(LOGGING_DEBUG, fmt, ##__VA_ARGS__)
+#define LOGV(fmt, ...)                LOG(LOGGING_VERBOSE, fmt, ##__VA_ARGS__)
 #define LOG_PLAIN(fmt, ...)           logging_plain((fmt), ##__VA_ARGS__)
 
 #define LOGBGE(what, err)             LOGE(what " returns Error[0x%04x]\n", (err))
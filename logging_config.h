@@ -21,8 +21,13 @@ extern "C"
 #define ERROR_ABORT         1
 #endif
 
+/*
+ * Size of the buffer that messages are streamed through in the full featured
+ * mode. Longer messages are handed over to the interface chunk by chunk, so it
+ * only trades interface calls for RAM.
+ */
 #ifndef LOGGING_BUF_LENGTH
-#define LOGGING_BUF_LENGTH  1024
+#define LOGGING_BUF_LENGTH  128
 #endif
 
 #define SEGGER_RTT          1
@@ -60,7 +65,8 @@ enum {
   LOGGING_IMPORTANT_INFO,
   LOGGING_DEBUG_HIGHTLIGHT,
   LOGGING_DEBUG,
-  LOGGING_VERBOSE
+  LOGGING_VERBOSE,
+  LOGGING_LEVEL_NUM
 };
 
 /*
@@ -85,6 +91,24 @@ enum {
 #define TIME_ON             1
 #endif
 
+/*
+ * Size of the stack buffer a message is formatted through with
+ * INTERFACE_BOTH, so it is formatted once for both interfaces.
+ */
+#ifndef LW_CHUNK_LENGTH
+#define LW_CHUNK_LENGTH     32
+#endif
+
+/*
+ * Set to non-zero to make each call site a single call to a shared routine in
+ * logging.c, which emits the header and formats the message, instead of
+ * expanding them inline. Saves flash with many call sites at the cost of one
+ * call per message.
+ */
+#ifndef LW_THUNK_ON
+#define LW_THUNK_ON         0
+#endif
+
 #ifndef LOGGING_LEVEL
 #define LOGGING_LEVEL       LOGGING_VERBOSE
 #endif
@@ -98,6 +122,348 @@ enum {
 #error "TIME_ON NOT Defined"
 #endif
 
+/*
+ * Instrumentation Items:
+ *   STATS_ON - If to keep per-level counters of logging calls, see
+ *     logging_stats_get()
+ */
+#ifndef STATS_ON
+#define STATS_ON            0
+#endif
+
+/*
+ *   PROFILE_ON - If to time every stage of __log() in CPU cycles and keep log2
+ *     bucketed latency histograms, see logging_profile_dump(). The cycle
+ *     counter is DWT CYCCNT on Cortex-M3 and above, the TSC on x86 hosts and
+ *     clock_gettime() in nanoseconds elsewhere, or LOGGING_CYCLES() if defined.
+ *   PROFILE_BUCKET_NUM - Number of histogram buckets, bucket n counts the
+ *     latencies in [2^(n-1), 2^n), the last one counts all above.
+ */
+#ifndef PROFILE_ON
+#define PROFILE_ON          0
+#endif
+
+#ifndef PROFILE_BUCKET_NUM
+#define PROFILE_BUCKET_NUM  16
+#endif
+
+/*
+ *   WATERMARK_ON - If to record memory high-water marks, see
+ *     logging_watermark_get()
+ *   WATERMARK_BUCKET_NUM - Number of message size histogram buckets, bucket n
+ *     counts the sizes in [2^(n-1), 2^n), the last one counts all above.
+ *   WATERMARK_STACK_PROBE - Bytes of stack below __log() painted and checked
+ *     on every call to find its peak stack usage, 0 to disable.
+ */
+#ifndef WATERMARK_ON
+#define WATERMARK_ON        0
+#endif
+
+#ifndef WATERMARK_BUCKET_NUM
+#define WATERMARK_BUCKET_NUM  12
+#endif
+
+#ifndef WATERMARK_STACK_PROBE
+#define WATERMARK_STACK_PROBE 512
+#endif
+
+/*
+ * Runtime Control Items:
+ *   CTRL_ON - If to accept commands from the host on an RTT down-buffer, see
+ *     logging_ctrl.h. Requires SEGGER_RTT in LOGGING_INTERFACE.
+ *   CTRL_CHANNEL - RTT channel used by the control commands and responses.
+ *   CTRL_DOWN_SIZE, CTRL_UP_SIZE - Sizes of the control channel RTT buffers.
+ *     With STATS_ON, CTRL_UP_SIZE must be at least 175 bytes to hold the
+ *     statistics response.
+ *   MODULE_FILTER_NUM - Number of modules which can have their own level
+ *     threshold, see logging_module_threshold_set(). 0 to disable.
+ *   SITE_FILTER_NUM - Number of logging call sites which can be disabled
+ *     individually, see logging_site_set(). 0 to disable.
+ */
+#ifndef CTRL_ON
+#define CTRL_ON             0
+#endif
+
+#ifndef CTRL_CHANNEL
+#define CTRL_CHANNEL        1
+#endif
+
+#ifndef CTRL_DOWN_SIZE
+#define CTRL_DOWN_SIZE      64
+#endif
+
+#ifndef CTRL_UP_SIZE
+#define CTRL_UP_SIZE        256
+#endif
+
+#ifndef MODULE_FILTER_NUM
+#define MODULE_FILTER_NUM   ((CTRL_ON != 0) ? 8 : 0)
+#endif
+
+#ifndef SITE_FILTER_NUM
+#define SITE_FILTER_NUM     ((CTRL_ON != 0) ? 8 : 0)
+#endif
+
+/*
+ * RTT_SINGLE_PRODUCER - If to write the RTT terminal buffer without locking,
+ *   interrupts are then never masked while a message is copied. Only set it if
+ *   the logging is used from a single context, e.g. only the main loop or a
+ *   single logging task, see SEGGER_RTT_WriteSingleProducer().
+ */
+#ifndef RTT_SINGLE_PRODUCER
+#define RTT_SINGLE_PRODUCER 0
+#endif
+
+/*
+ * RTT_TRIM_ON - If a record which doesn't fit into the RTT up-buffer is
+ *   trimmed instead of dropped: its head, i.e. time, location and level, and
+ *   as much of the message as fits are written, followed by RTT_TRIM_MARK. If
+ *   not even the head fits, the record is dropped. Applies to the buffers not
+ *   in SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL mode.
+ * RTT_TRIM_MARK - String ending a trimmed record, room for it is kept in the
+ *   up-buffer.
+ */
+#ifndef RTT_TRIM_ON
+#define RTT_TRIM_ON         0
+#endif
+
+#ifndef RTT_TRIM_MARK
+#define RTT_TRIM_MARK       "~[cut]\n"
+#endif
+
+/*
+ * Per-Context Output Items:
+ *   RTT_PER_CONTEXT - If every execution context, see LOGGING_CONTEXT_ID(),
+ *     logs through its own buffer to its own RTT up-buffer without locking, so
+ *     the contexts, e.g. the cores of a multi-core part or the threads of a
+ *     host build, don't serialize on a single ring. Every record then starts
+ *     with a header of its timestamp and a per-context sequence number, and
+ *     tools/logmerge.c merges the captures of the up-buffers into one ordered
+ *     log. Each context must not preempt itself, e.g. interrupts of different
+ *     priorities need their own contexts. Requires SEGGER_RTT in
+ *     LOGGING_INTERFACE.
+ *   RTT_CONTEXT_CHANNEL - RTT up-buffer of context 1, context n uses
+ *     RTT_CONTEXT_CHANNEL + n - 1, context 0 uses the terminal buffer 0.
+ *   RTT_CONTEXT_BUF_SIZE - Size of the RTT up-buffers of contexts 1 and above.
+ *   LOGGING_TIMESTAMP() - Expression returning a timestamp common to all the
+ *     contexts, at most 64 bits. If not defined, the DWT cycle counter is used
+ *     on Cortex-M3 and above, which wraps around within a minute, and the
+ *     monotonic clock in nanoseconds on hosts.
+ */
+#ifndef RTT_PER_CONTEXT
+#define RTT_PER_CONTEXT     0
+#endif
+
+#ifndef RTT_CONTEXT_CHANNEL
+#define RTT_CONTEXT_CHANNEL ((CTRL_ON != 0) ? CTRL_CHANNEL + 1 : 1)
+#endif
+
+#ifndef RTT_CONTEXT_BUF_SIZE
+#define RTT_CONTEXT_BUF_SIZE 1024
+#endif
+
+/*
+ * Stalled Reader Items:
+ *   RTT_STALL_WRITES - Number of records in a row which find the RTT up-buffer
+ *     full while its read offset doesn't move, after which the reader, i.e.
+ *     the debug probe, is taken as stalled or absent. The records are then
+ *     only counted, or captured by the flight recorder, without being
+ *     formatted, until the read offset moves again. A marker with the number
+ *     of records skipped is output when the reader is back. Only applies while
+ *     SEGGER_RTT is the only interface in use. Set it above the number of
+ *     records logged within a polling period of the probe. 0 to disable.
+ *   RTT_STALL_RECORDER - If to capture the records skipped while the reader is
+ *     stalled in the flight recorder, see logging_recorder_dump().
+ *   RECORDER_NUM - Number of records the flight recorder keeps per context,
+ *     the oldest ones are overwritten.
+ *   RECORDER_ARG_SIZE - Bytes of packed parameters kept per record, see
+ *     lfmt_vpack(), the parameters which don't fit are left out.
+ */
+#ifndef RTT_STALL_WRITES
+#define RTT_STALL_WRITES    0
+#endif
+
+#ifndef RTT_STALL_RECORDER
+#define RTT_STALL_RECORDER  0
+#endif
+
+#ifndef RECORDER_NUM
+#define RECORDER_NUM        16
+#endif
+
+#ifndef RECORDER_ARG_SIZE
+#define RECORDER_ARG_SIZE   16
+#endif
+
+/*
+ * Adaptive Verbosity Items:
+ *   ADAPTIVE_ON - If to lower the level threshold of a context while the
+ *     transport fills up, shedding the least important levels first, e.g.
+ *     VERBOSE, then DEBUG, so the important messages keep getting through
+ *     under load. The threshold is restored as the transport drains. A
+ *     marker record is output on every change.
+ *   ADAPTIVE_HIGH - Fill in percent at which the first level is shed.
+ *   ADAPTIVE_STEP - Fill in percent above ADAPTIVE_HIGH for every further
+ *     level shed.
+ *   ADAPTIVE_HYST - How far in percent the fill must drop below the mark of a
+ *     level before the level is restored.
+ *   ADAPTIVE_HOLD - Logging calls of the context after a change before a
+ *     level can be restored, levels are restored one by one.
+ *   ADAPTIVE_FLOOR - Level the threshold is never lowered below, by default
+ *     IMPORTANT_INFO, so the warnings and important messages are never shed.
+ *   LOGGING_TRANSPORT_FILL() - Expression returning the fill of the transport
+ *     in percent, e.g. of a UART transmit queue. If not defined, the fill of
+ *     the RTT up-buffer of the context is used.
+ */
+#ifndef ADAPTIVE_ON
+#define ADAPTIVE_ON         0
+#endif
+
+#ifndef ADAPTIVE_HIGH
+#define ADAPTIVE_HIGH       50
+#endif
+
+#ifndef ADAPTIVE_STEP
+#define ADAPTIVE_STEP       10
+#endif
+
+#ifndef ADAPTIVE_HYST
+#define ADAPTIVE_HYST       20
+#endif
+
+#ifndef ADAPTIVE_HOLD
+#define ADAPTIVE_HOLD       64
+#endif
+
+#ifndef ADAPTIVE_FLOOR
+#define ADAPTIVE_FLOOR      LOGGING_IMPORTANT_INFO
+#endif
+
+/*
+ * Structured Logging Items:
+ *   KV_ON - If to provide the LOGx_KV() key/value logging, see logging.h. The
+ *     records are binary frames in the logging stream, decoded on the host by
+ *     tools/logkv.c. Full featured mode only.
+ *   KV_BUF_LENGTH - Size of the stack buffer a record is encoded in, at most
+ *     258. Values which don't fit are cut short or left out.
+ */
+#ifndef KV_ON
+#define KV_ON               0
+#endif
+
+#ifndef KV_BUF_LENGTH
+#define KV_BUF_LENGTH       64
+#endif
+
+/*
+ * JSON Lines Items:
+ *   JSON_ON - If to emit every record as a JSON line instead of the colored
+ *     text, e.g. for host builds feeding log pipelines:
+ *     {"ts":<timestamp>,"level":"IPM","file":"main.c","line":12,"msg":"..."}
+ *     The timestamp is LOGGING_TIMESTAMP(), see RTT_PER_CONTEXT. The message
+ *     is escaped and its trailing '\n' is left out, LOG_PLAIN() and
+ *     HEX_DUMP_xx() records only have "ts" and "msg". The marker lines of
+ *     RTT_STALL_WRITES, RTT_TRIM_ON and ADAPTIVE_ON stay text. Full featured
+ *     mode only, not with KV_ON.
+ */
+#ifndef JSON_ON
+#define JSON_ON             0
+#endif
+
+/*
+ * Binary Logging Items:
+ *   BINARY_ON - If to emit the LOGx() records as binary frames, with the
+ *     parameters packed as they are, instead of formatting them, see
+ *     logging.h. The format strings, file names and lines are kept in the
+ *     logging_fmt section of the ELF file, tools/logdec.c formats the
+ *     records with them on the host. The format strings must be literals.
+ *     Full featured mode only, not with JSON_ON.
+ *   BINARY_BUF_LENGTH - Size of the stack buffer a record is encoded in, in
+ *     range [24, 258]. The parameters which don't fit are left out.
+ *   LOGGING_TIMESTAMP_HZ - Ticks per second of LOGGING_TIMESTAMP(), see
+ *     RTT_PER_CONTEXT, sent to the host so it shows the record time, e.g.
+ *     SystemCoreClock for the DWT cycle counter. If not defined, 1000000000
+ *     for the monotonic clock on hosts, 0 otherwise, the host then shows the
+ *     ticks.
+ */
+#ifndef BINARY_ON
+#define BINARY_ON           0
+#endif
+
+#ifndef BINARY_BUF_LENGTH
+#define BINARY_BUF_LENGTH   64
+#endif
+
+/*
+ * Compression Items:
+ *   COMPRESS_ON - If to compress the output of the full featured mode with a
+ *     small-window LZ, see logging.h. A frame is flushed at the end of every
+ *     record, and the history is kept across records, so the headers and
+ *     messages repeated take a few bytes each. tools/logunz.c decompresses
+ *     the frames on the host. Not with RTT_TRIM_ON, a frame is sent whole or
+ *     not at all.
+ *   COMPRESS_WINDOW - Bytes of history, in range [64, 16384]. A logging
+ *     buffer takes about 1.5 times as much RAM, plus the hash table. Records
+ *     longer than half of it are sent in several frames.
+ *   COMPRESS_HASH_BITS - Bits of the hash table finding the repeated bytes, in
+ *     range [4, 14], 2 bytes of RAM per entry.
+ *   COMPRESS_RESTART - Frames after which the history is dropped, so a host
+ *     attaching late can decompress the frames after the next restart.
+ */
+#ifndef COMPRESS_ON
+#define COMPRESS_ON         0
+#endif
+
+#ifndef COMPRESS_WINDOW
+#define COMPRESS_WINDOW     1024
+#endif
+
+#ifndef COMPRESS_HASH_BITS
+#define COMPRESS_HASH_BITS  8
+#endif
+
+#ifndef COMPRESS_RESTART
+#define COMPRESS_RESTART    256
+#endif
+
+/*
+ * Execution contexts:
+ *   LOGGING_CONTEXT_NUM - Number of execution contexts keeping their own
+ *     instrumentation counters, the counters are summed on read.
+ *   LOGGING_CONTEXT_ID() - Expression returning the current context index in
+ *     range [0, LOGGING_CONTEXT_NUM). If not defined, thread mode is 0 and
+ *     interrupt handlers are 1 on Cortex-M, other targets always use 0.
+ */
+#ifndef LOGGING_CONTEXT_NUM
+#define LOGGING_CONTEXT_NUM 2
+#endif
+
+/*
+ * Wire Format Items:
+ *   COMPACT_ON - If to emit the level of a record as a single byte code,
+ *     LEVEL_CODE(lvl), instead of the colored flag, and the time and location
+ *     without brackets and padding, e.g. "\x13RT-0:00:01:05 main:12 msg\n".
+ *     The level code comes first and every field is followed by a space.
+ *     tools/logrender.c restores the colors and the alignment on the host.
+ *     Not with JSON_ON.
+ */
+#ifndef COMPACT_ON
+#define COMPACT_ON          0
+#endif
+
+/* Level codes of COMPACT_ON, control characters not used by the terminals */
+#define LEVEL_CODE_BASE     0x10
+#define LEVEL_CODE(lvl)     (LEVEL_CODE_BASE + (lvl))
+
+#if (COMPACT_ON != 0)
+#define FTL_FLAG            "\x10"
+#define ERR_FLAG            "\x11"
+#define WRN_FLAG            "\x12"
+#define IPM_FLAG            "\x13"
+#define DHL_FLAG            "\x14"
+#define DBG_FLAG            "\x15"
+#define VER_FLAG            "\x16"
+#else
 #define FTL_FLAG            "[" RTT_CTRL_BG_BRIGHT_RED "FTL" RTT_CTRL_RESET "]"
 #define ERR_FLAG            "[" RTT_CTRL_TEXT_BRIGHT_RED "ERR" RTT_CTRL_RESET "]"
 #define WRN_FLAG            "[" RTT_CTRL_BG_BRIGHT_MAGENTA "WRN" RTT_CTRL_RESET "]"
@@ -105,10 +471,7 @@ enum {
 #define DHL_FLAG            "[" RTT_CTRL_TEXT_BRIGHT_YELLOW "DHL" RTT_CTRL_RESET "]"
 #define DBG_FLAG            "[" RTT_CTRL_TEXT_BRIGHT_GREEN "DBG" RTT_CTRL_RESET "]"
 #define VER_FLAG            "[VER]"
-
-#define PREF_LEN            (64)
-#define FILE_LINE_LEN       (20)
-#define FMT_PREF            "[RT-%4lu:%02lu:%02lu:%02lu]%s%s: "
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,283 @@
+/*************************************************************************
+ *  @file logging_ctrl.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <string.h>
+#include "logging.h"
+#include "logging_ctrl.h"
+
+#if (LOGGING_CONFIG > LIGHT_WEIGHT) && (CTRL_ON != 0)
+
+#if !(LOGGING_INTERFACE & SEGGER_RTT)
+#error "CTRL_ON requires SEGGER_RTT in LOGGING_INTERFACE"
+#endif
+
+#if (CTRL_CHANNEL == 0) || (CTRL_CHANNEL >= SEGGER_RTT_MAX_NUM_UP_BUFFERS) \
+  || (CTRL_CHANNEL >= SEGGER_RTT_MAX_NUM_DOWN_BUFFERS)
+#error "CTRL_CHANNEL must be an RTT channel other than 0"
+#endif
+
+#if (STATS_ON != 0)
+/* The LCTRL_GET_STATS response is the longest, the up-buffer holds one byte less than its size */
+_Static_assert(CTRL_UP_SIZE >= 6 + 4 * 6 * LOGGING_LEVEL_NUM + 1,
+               "CTRL_UP_SIZE too small for the LCTRL_GET_STATS response");
+#endif
+
+/* Defines  *********************************************************** */
+#define MODULE_NAME_MAX         32
+
+/**
+ * @brief states of the command frame parser
+ */
+enum {
+  RX_SYNC,
+  RX_OP,
+  RX_SEQ,
+  RX_LEN,
+  RX_PAYLOAD,
+  RX_CRC
+};
+
+/**
+ * @brief command frame parser
+ */
+typedef struct {
+  uint8_t state;                        /**< Parser state */
+  uint8_t op;                           /**< Command op */
+  uint8_t seq;                          /**< Command sequence number, echoed in the response */
+  uint8_t len;                          /**< Payload length */
+  uint8_t got;                          /**< Payload bytes received */
+  uint8_t payload[LCTRL_PAYLOAD_MAX];   /**< Command payload */
+}lctrl_rx_t;
+
+/* Static Variables *************************************************** */
+static char       down_buf[CTRL_DOWN_SIZE];
+static char       up_buf[CTRL_UP_SIZE];
+static lctrl_rx_t rx;
+
+/* Static Functions Declaractions ************************************* */
+static void _respond(uint8_t       status,
+                     const uint8_t *payload,
+                     uint8_t       len);
+static void _handle(void);
+
+void logging_ctrl_init(void)
+{
+  memset(&rx, 0, sizeof(rx));
+  SEGGER_RTT_ConfigDownBuffer(CTRL_CHANNEL, "LogCtrl", down_buf,
+                              sizeof(down_buf), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+  /* A response is written as a whole or not at all */
+  SEGGER_RTT_ConfigUpBuffer(CTRL_CHANNEL, "LogCtrl", up_buf,
+                            sizeof(up_buf), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+}
+
+void logging_ctrl_poll(void)
+{
+  uint8_t  chunk[16];
+  unsigned n;
+
+  while ((n = SEGGER_RTT_Read(CTRL_CHANNEL, chunk, sizeof(chunk))) > 0) {
+    for (unsigned i = 0; i < n; i++) {
+      uint8_t c = chunk[i];
+
+      switch (rx.state) {
+        case RX_SYNC:
+          if (c == LCTRL_SYNC) {
+            rx.state = RX_OP;
+          }
+          break;
+        case RX_OP:
+          rx.op    = c;
+          rx.state = RX_SEQ;
+          break;
+        case RX_SEQ:
+          rx.seq   = c;
+          rx.state = RX_LEN;
+          break;
+        case RX_LEN:
+          if (c > LCTRL_PAYLOAD_MAX) {
+            rx.state = RX_SYNC;
+            break;
+          }
+          rx.len   = c;
+          rx.got   = 0;
+          rx.state = c ? RX_PAYLOAD : RX_CRC;
+          break;
+        case RX_PAYLOAD:
+          rx.payload[rx.got++] = c;
+          if (rx.got == rx.len) {
+            rx.state = RX_CRC;
+          }
+          break;
+        case RX_CRC:
+        {
+          uint8_t hdr[3] = { rx.op, rx.seq, rx.len };
+          uint8_t crc    = lctrl_crc8(0, hdr, sizeof(hdr));
+
+          /* Frames with a bad crc are dropped silently, the host times out */
+          if (lctrl_crc8(crc, rx.payload, rx.len) == c) {
+            _handle();
+          }
+          rx.state = RX_SYNC;
+          break;
+        }
+        default:
+          rx.state = RX_SYNC;
+          break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief _respond send the response to the command being handled
+ *
+ * @param status - response status
+ * @param payload - response payload
+ * @param len - payload length
+ */
+static void _respond(uint8_t       status,
+                     const uint8_t *payload,
+                     uint8_t       len)
+{
+  uint8_t frame[6 + 4 * 6 * LOGGING_LEVEL_NUM];
+  uint8_t *p = frame;
+
+  *p++ = LCTRL_SYNC;
+  *p++ = rx.op | LCTRL_RSP;
+  *p++ = rx.seq;
+  *p++ = len + 1;
+  *p++ = status;
+  if (len) {
+    memcpy(p, payload, len);
+    p += len;
+  }
+  *p   = lctrl_crc8(0, frame + 1, (size_t)(p - frame - 1));
+  p++;
+  SEGGER_RTT_Write(CTRL_CHANNEL, frame, (unsigned)(p - frame));
+}
+
+#if (MODULE_FILTER_NUM > 0) || (SITE_FILTER_NUM > 0)
+/**
+ * @brief _module_name copy the module name at the end of the payload to a '\0'
+ * terminated string
+ *
+ * @param name - output string, MODULE_NAME_MAX bytes
+ * @param offset - offset of the module name in the payload
+ *
+ * @return 0 on success, -1 if the name is empty or too long
+ */
+static int _module_name(char    *name,
+                        uint8_t offset)
+{
+  size_t len;
+
+  if (rx.len <= offset || rx.len - offset >= MODULE_NAME_MAX) {
+    return -1;
+  }
+  len = rx.len - offset;
+  memcpy(name, rx.payload + offset, len);
+  name[len] = '\0';
+  return 0;
+}
+#endif
+
+/**
+ * @brief _handle execute the command in the parser and respond to it
+ */
+static void _handle(void)
+{
+  uint8_t status = LCTRL_OK;
+#if (MODULE_FILTER_NUM > 0) || (SITE_FILTER_NUM > 0)
+  char    name[MODULE_NAME_MAX];
+#endif
+
+  switch (rx.op) {
+    case LCTRL_PING:
+      break;
+    case LCTRL_SET_LEVEL:
+      if (rx.len != 1) {
+        status = LCTRL_BAD_ARG;
+        break;
+      }
+      logging_level_threshold_set(rx.payload[0]);
+      break;
+#if (MODULE_FILTER_NUM > 0)
+    case LCTRL_SET_MODULE_LEVEL:
+      if (_module_name(name, 1)) {
+        status = LCTRL_BAD_ARG;
+      } else if (logging_module_threshold_set(name, rx.payload[0])) {
+        status = LCTRL_NO_ROOM;
+      }
+      break;
+#endif
+#if (SITE_FILTER_NUM > 0)
+    case LCTRL_SET_SITE:
+      if (_module_name(name, 3)) {
+        status = LCTRL_BAD_ARG;
+      } else if (logging_site_set(name,
+                                  rx.payload[1] | (rx.payload[2] << 8),
+                                  rx.payload[0])) {
+        status = LCTRL_NO_ROOM;
+      }
+      break;
+#endif
+    case LCTRL_SET_INTERFACES:
+    {
+      uint8_t in_use;
+
+      if (rx.len != 1) {
+        status = LCTRL_BAD_ARG;
+        break;
+      }
+      logging_interface_set(rx.payload[0]);
+      in_use = logging_interface_get();
+      _respond(LCTRL_OK, &in_use, 1);
+      return;
+    }
+#if (RTT_STALL_WRITES > 0) && (RTT_STALL_RECORDER != 0)
+    case LCTRL_DUMP_RECORDER:
+    {
+      int     n      = logging_recorder_dump();
+      uint8_t out[2] = { n, n >> 8 };
+
+      _respond(LCTRL_OK, out, sizeof(out));
+      return;
+    }
+#endif
+#if (STATS_ON != 0)
+    case LCTRL_GET_STATS:
+    {
+      logging_stats_t st;
+      uint8_t         out[4 * 6 * LOGGING_LEVEL_NUM], *p = out;
+
+      logging_stats_get(&st);
+      for (int i = 0; i < LOGGING_LEVEL_NUM; i++) {
+        const uint32_t c[6] = { st.level[i].calls, st.level[i].filtered,
+                                st.level[i].emitted, st.level[i].bytes,
+                                st.level[i].truncated, st.level[i].dropped };
+        for (int j = 0; j < 6; j++) {
+          *p++ = c[j];
+          *p++ = c[j] >> 8;
+          *p++ = c[j] >> 16;
+          *p++ = c[j] >> 24;
+        }
+      }
+      _respond(LCTRL_OK, out, sizeof(out));
+      return;
+    }
+    case LCTRL_RESET_STATS:
+      logging_stats_reset();
+      break;
+#endif
+    default:
+      status = LCTRL_UNSUPPORTED;
+      break;
+  }
+  _respond(status, NULL, 0);
+}
+#endif // #if (LOGGING_CONFIG > LIGHT_WEIGHT) && (CTRL_ON != 0)
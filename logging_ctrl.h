@@ -0,0 +1,94 @@
+/*************************************************************************
+ *  @file logging_ctrl.h
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Runtime control of the logging from the host over an RTT
+ *  down-buffer. The protocol definitions are shared with tools/logctl.c.
+ *
+ *  Command frame, host to target on RTT down-buffer CTRL_CHANNEL:
+ *    | 0xA5 | op | seq | len | payload[len] | crc8 |
+ *  Response frame, target to host on RTT up-buffer CTRL_CHANNEL:
+ *    | 0xA5 | op + 0x80 | seq | len | status | payload[len - 1] | crc8 |
+ *
+ *  crc8 is CRC-8 with polynomial 0x07 over all bytes after 0xA5. Multi-byte
+ *  integers are little endian.
+ ************************************************************************/
+
+#ifndef LOGGING_CTRL_H
+#define LOGGING_CTRL_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Defines  *********************************************************** */
+#define LCTRL_SYNC              0xA5 /**< First byte of every frame */
+#define LCTRL_RSP               0x80 /**< Set in the op of the responses */
+#define LCTRL_PAYLOAD_MAX       48   /**< Maximum payload of a command */
+
+/**
+ * @brief control commands
+ */
+enum {
+  LCTRL_PING = 1,         /**< No payload, responds with no payload */
+  LCTRL_SET_LEVEL,        /**< [level] */
+  LCTRL_SET_MODULE_LEVEL, /**< [level][module name], level 0xFF removes the override */
+  LCTRL_SET_SITE,         /**< [enable][line, 2 bytes][module name] */
+  LCTRL_SET_INTERFACES,   /**< [interface bitmask], responds with [interfaces in use] */
+  LCTRL_DUMP_RECORDER,    /**< No payload, dumps the flight recorder to the terminal, responds with [records dumped, 2 bytes] */
+  LCTRL_GET_STATS,        /**< No payload, responds with the 6 counters of every level, 4 bytes each */
+  LCTRL_RESET_STATS,      /**< No payload */
+};
+
+/**
+ * @brief response status
+ */
+enum {
+  LCTRL_OK = 0,      /**< Command done */
+  LCTRL_UNSUPPORTED, /**< Unknown op or feature not compiled in */
+  LCTRL_BAD_ARG,     /**< Malformed payload */
+  LCTRL_NO_ROOM,     /**< Filter table full */
+};
+
+/**
+ * @brief lctrl_crc8 CRC-8 (polynomial 0x07) of a block of bytes, also used by
+ * the binary, key/value and compressed frames of logging.c
+ *
+ * @param crc - crc to continue, 0 to start
+ * @param p - bytes
+ * @param len - number of bytes
+ *
+ * @return crc value
+ */
+static inline uint8_t lctrl_crc8(uint8_t       crc,
+                                 const uint8_t *p,
+                                 size_t        len)
+{
+  while (len--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/**
+ * @brief logging_ctrl_init set up the control channel RTT buffers, called by
+ * logging_init()
+ */
+void logging_ctrl_init(void);
+
+/**
+ * @brief logging_ctrl_poll process the commands received from the host. Call
+ * it periodically from a context which is allowed to log, e.g. the main loop.
+ */
+void logging_ctrl_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //LOGGING_CTRL_H
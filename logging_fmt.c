@@ -0,0 +1,949 @@
+/*************************************************************************
+ *  @file logging_fmt.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <string.h>
+#include "logging_config.h"
+#include "logging_fmt.h"
+
+/* The light weight mode only formats through it with INTERFACE_BOTH */
+#if (LOGGING_CONFIG > LIGHT_WEIGHT) || (LOGGING_INTERFACE == INTERFACE_BOTH)
+
+/* Defines  *********************************************************** */
+#ifndef   MIN
+  #define MIN(a, b)     (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef   MAX
+  #define MAX(a, b)     (((a) > (b)) ? (a) : (b))
+#endif
+
+#define FLAG_LEFT       0x01 /**< '-' */
+#define FLAG_PLUS       0x02 /**< '+' */
+#define FLAG_SPACE      0x04 /**< ' ' */
+#define FLAG_ALT        0x08 /**< '#' */
+#define FLAG_ZERO       0x10 /**< '0' */
+#define FLAG_UPPER      0x20 /**< Upper case digits */
+
+/* Length modifiers */
+enum {
+  LEN_NONE,
+  LEN_HH,
+  LEN_H,
+  LEN_L,
+  LEN_LL,
+  LEN_J,
+  LEN_Z,
+  LEN_T,
+  LEN_BIG_L
+};
+
+/* Room for one floating point conversion and its format spec */
+#define FLOAT_BUF_LEN   48
+#define FLOAT_SPEC_LEN  24
+
+#ifndef   LFMT_USE_AVX2
+  #if (defined __AVX2__)
+    #define LFMT_USE_AVX2 1
+  #else
+    #define LFMT_USE_AVX2 0
+  #endif
+#endif
+
+#ifndef   LFMT_USE_SSE2
+  #if (defined __SSE2__) || (defined _M_X64)
+    #define LFMT_USE_SSE2 1
+  #else
+    #define LFMT_USE_SSE2 0
+  #endif
+#endif
+
+#if LFMT_USE_AVX2
+  #include <immintrin.h>
+#elif LFMT_USE_SSE2
+  #include <emmintrin.h>
+#endif
+
+/* Bytes escaped in a JSON string */
+#define JSON_ESCAPED(c) ((uint8_t)(c) < 0x20 || (c) == '"' || (c) == '\\')
+
+/* Static Functions Declaractions ************************************* */
+
+/**
+ * @brief _pad output a character repeatedly
+ *
+ * @param s - stream
+ * @param c - padding character
+ * @param n - count, nothing is output if not positive
+ */
+static void _pad(lfmt_stream_t *s,
+                 char          c,
+                 int           n)
+{
+  while (n-- > 0) {
+    lfmt_putc(s, c);
+  }
+}
+
+/**
+ * @brief _out_str output a string with width and precision
+ *
+ * @param s - stream
+ * @param str - string
+ * @param flags - FLAG_* conversion flags
+ * @param width - minimal field width
+ * @param prec - maximal number of characters, negative for unlimited
+ */
+static void _out_str(lfmt_stream_t *s,
+                     const char    *str,
+                     unsigned      flags,
+                     int           width,
+                     int           prec)
+{
+  size_t len;
+
+  if (!str) {
+    str = "(null)";
+  }
+  if (prec >= 0) {
+    const char *end = memchr(str, '\0', (size_t)prec);
+    len = end ? (size_t)(end - str) : (size_t)prec;
+  } else {
+    len = strlen(str);
+  }
+
+  if (!(flags & FLAG_LEFT)) {
+    _pad(s, ' ', width - (int)len);
+  }
+  lfmt_write(s, str, len);
+  if (flags & FLAG_LEFT) {
+    _pad(s, ' ', width - (int)len);
+  }
+}
+
+/**
+ * @brief _out_num output an integer
+ *
+ * @param s - stream
+ * @param v - absolute value
+ * @param neg - non-zero if the value is negative
+ * @param base - 8, 10 or 16
+ * @param flags - FLAG_* conversion flags
+ * @param width - minimal field width
+ * @param prec - minimal number of digits, negative if not given
+ */
+static void _out_num(lfmt_stream_t *s,
+                     uintmax_t     v,
+                     int           neg,
+                     unsigned      base,
+                     unsigned      flags,
+                     int           width,
+                     int           prec)
+{
+  const char *tab = (flags & FLAG_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+  char       digits[24]; /* 64-bit octal takes 22 */
+  char       prefix[2];
+  int        n = 0, plen = 0, zeros, fill;
+  int        zero_fill = (flags & (FLAG_ZERO | FLAG_LEFT)) == FLAG_ZERO && prec < 0;
+
+  if (v <= UINT32_MAX) {
+    /* Avoid the 64-bit division helpers on 32-bit targets */
+    uint32_t v32 = (uint32_t)v;
+    if (base == 10) {
+      while (v32) {
+        digits[n++] = tab[v32 % 10];
+        v32        /= 10;
+      }
+    } else {
+      unsigned shift = base == 16 ? 4 : 3;
+      while (v32) {
+        digits[n++] = tab[v32 & (base - 1)];
+        v32       >>= shift;
+      }
+    }
+  } else {
+    while (v) {
+      digits[n++] = tab[v % base];
+      v          /= base;
+    }
+  }
+  /* Zero is printed as "0", unless the precision is explicitly 0 */
+  if (!n && prec != 0) {
+    digits[n++] = '0';
+  }
+
+  if (neg) {
+    prefix[plen++] = '-';
+  } else if (flags & FLAG_PLUS) {
+    prefix[plen++] = '+';
+  } else if (flags & FLAG_SPACE) {
+    prefix[plen++] = ' ';
+  } else if (flags & FLAG_ALT) {
+    if (base == 16 && n && digits[n - 1] != '0') {
+      prefix[plen++] = '0';
+      prefix[plen++] = (flags & FLAG_UPPER) ? 'X' : 'x';
+    } else if (base == 8 && (!n || digits[n - 1] != '0')) {
+      prec = MAX(prec, n + 1);
+    }
+  }
+
+  zeros = prec > n ? prec - n : 0;
+  fill  = width - plen - zeros - n;
+  if (zero_fill && fill > 0) {
+    zeros += fill;
+    fill   = 0;
+  }
+
+  if (!(flags & FLAG_LEFT)) {
+    _pad(s, ' ', fill);
+  }
+  lfmt_write(s, prefix, plen);
+  _pad(s, '0', zeros);
+  while (n) {
+    lfmt_putc(s, digits[--n]);
+  }
+  if (flags & FLAG_LEFT) {
+    _pad(s, ' ', fill);
+  }
+}
+
+/**
+ * @brief _out_float output a floating point number through snprintf()
+ *
+ * @param s - stream
+ * @param v - value
+ * @param conv - conversion character
+ * @param flags - FLAG_* conversion flags
+ * @param width - minimal field width
+ * @param prec - precision, negative if not given
+ */
+static void _out_float(lfmt_stream_t *s,
+                       double        v,
+                       char          conv,
+                       unsigned      flags,
+                       int           width,
+                       int           prec)
+{
+  char spec[FLOAT_SPEC_LEN], *p = spec;
+  char out[FLOAT_BUF_LEN];
+  int  n;
+
+  *p++ = '%';
+  if (flags & FLAG_LEFT) {
+    *p++ = '-';
+  }
+  if (flags & FLAG_PLUS) {
+    *p++ = '+';
+  }
+  if (flags & FLAG_SPACE) {
+    *p++ = ' ';
+  }
+  if (flags & FLAG_ALT) {
+    *p++ = '#';
+  }
+  if (flags & FLAG_ZERO) {
+    *p++ = '0';
+  }
+  *p++ = '*';
+  *p++ = '.';
+  *p++ = '*';
+  *p++ = conv;
+  *p   = '\0';
+
+  n = snprintf(out, sizeof(out), spec, width, prec, v);
+  if (n > 0) {
+    lfmt_write(s, out, MIN((size_t)n, sizeof(out) - 1));
+  }
+}
+
+/**
+ * @brief conversion specification
+ */
+typedef struct {
+  unsigned flags;     /**< FLAG_* conversion flags */
+  unsigned length;    /**< LEN_* length modifier */
+  int      width;     /**< Minimal field width */
+  int      prec;      /**< Precision, negative if not given */
+  uint8_t  width_arg; /**< Width is given by a parameter, '*' */
+  uint8_t  prec_arg;  /**< Precision is given by a parameter, '*' */
+  char     conv;      /**< Conversion character, '\0' if the format ended */
+}spec_t;
+
+/**
+ * @brief source of the parameters, a va_list or parameters packed by
+ * lfmt_vpack()
+ */
+typedef struct {
+  va_list       ap;  /**< Parameters, if not packed */
+  const uint8_t *p;  /**< Next packed parameter, NULL if not packed */
+  const uint8_t *end;/**< End of the packed parameters */
+}args_t;
+
+/**
+ * @brief _parse_spec parse a conversion specification, without the '%'
+ *
+ * @param fmt - first character after the '%'
+ * @param sp - output specification
+ *
+ * @return first character after the specification
+ */
+static const char *_parse_spec(const char *fmt,
+                               spec_t     *sp)
+{
+  sp->flags     = 0;
+  sp->length    = LEN_NONE;
+  sp->width     = 0;
+  sp->prec      = -1;
+  sp->width_arg = 0;
+  sp->prec_arg  = 0;
+
+  /* Literal text up to the next conversion is skipped */
+  while (*fmt && *fmt != '%') {
+    fmt++;
+  }
+  if (!*fmt) {
+    sp->conv = '\0';
+    return fmt;
+  }
+  fmt++;
+
+  /* Flags */
+  for (;; fmt++) {
+    if (*fmt == '-') {
+      sp->flags |= FLAG_LEFT;
+    } else if (*fmt == '+') {
+      sp->flags |= FLAG_PLUS;
+    } else if (*fmt == ' ') {
+      sp->flags |= FLAG_SPACE;
+    } else if (*fmt == '#') {
+      sp->flags |= FLAG_ALT;
+    } else if (*fmt == '0') {
+      sp->flags |= FLAG_ZERO;
+    } else {
+      break;
+    }
+  }
+
+  /* Width */
+  if (*fmt == '*') {
+    sp->width_arg = 1;
+    fmt++;
+  } else {
+    while (*fmt >= '0' && *fmt <= '9') {
+      sp->width = sp->width * 10 + (*fmt++ - '0');
+    }
+  }
+
+  /* Precision */
+  if (*fmt == '.') {
+    fmt++;
+    if (*fmt == '*') {
+      sp->prec_arg = 1;
+      fmt++;
+    } else {
+      sp->prec = 0;
+      while (*fmt >= '0' && *fmt <= '9') {
+        sp->prec = sp->prec * 10 + (*fmt++ - '0');
+      }
+    }
+  }
+
+  /* Length modifier */
+  switch (*fmt) {
+    case 'h':
+      sp->length = (*++fmt == 'h') ? (fmt++, LEN_HH) : LEN_H;
+      break;
+    case 'l':
+      sp->length = (*++fmt == 'l') ? (fmt++, LEN_LL) : LEN_L;
+      break;
+    case 'j':
+      sp->length = LEN_J;
+      fmt++;
+      break;
+    case 'z':
+      sp->length = LEN_Z;
+      fmt++;
+      break;
+    case 't':
+      sp->length = LEN_T;
+      fmt++;
+      break;
+    case 'L':
+      sp->length = LEN_BIG_L;
+      fmt++;
+      break;
+    default:
+      break;
+  }
+
+  sp->conv = *fmt;
+  return sp->conv ? fmt + 1 : fmt;
+}
+
+/**
+ * @brief _pack append bytes to a packed parameter buffer
+ *
+ * @param p - write position
+ * @param end - end of the buffer
+ * @param v - bytes
+ * @param n - number of bytes
+ *
+ * @return new write position, end if the bytes don't fit
+ */
+static uint8_t *_pack(uint8_t    *p,
+                      uint8_t    *end,
+                      const void *v,
+                      size_t     n)
+{
+  if ((size_t)(end - p) < n) {
+    return end;
+  }
+  memcpy(p, v, n);
+  return p + n;
+}
+
+/**
+ * @brief _unpack take the next packed parameter
+ *
+ * @param a - parameters
+ * @param v - output value
+ * @param n - size of the value
+ *
+ * @note a missing parameter reads as zero
+ */
+static void _unpack(args_t *a,
+                    void   *v,
+                    size_t n)
+{
+  if ((size_t)(a->end - a->p) < n) {
+    memset(v, 0, n);
+    a->p = a->end;
+    return;
+  }
+  memcpy(v, a->p, n);
+  a->p += n;
+}
+
+/* Takes the next parameter of a type from either source */
+#define ARG(a, type, v)              \
+  do {                               \
+    if ((a)->p) {                    \
+      _unpack((a), &(v), sizeof(v)); \
+    } else {                         \
+      (v) = va_arg((a)->ap, type);   \
+    }                                \
+  } while (0)
+
+/**
+ * @brief _arg_int take the next integer parameter
+ *
+ * @param a - parameters
+ * @param length - LEN_* length modifier
+ * @param is_signed - non-zero for the signed conversions
+ *
+ * @return value converted as the length modifier asks, sign extended if
+ * signed
+ */
+static uintmax_t _arg_int(args_t   *a,
+                          unsigned length,
+                          int      is_signed)
+{
+  switch (length) {
+    case LEN_L: {
+      unsigned long v;
+      ARG(a, unsigned long, v);
+      return is_signed ? (uintmax_t)(intmax_t)(long)v : v;
+    }
+    case LEN_LL: {
+      unsigned long long v;
+      ARG(a, unsigned long long, v);
+      return is_signed ? (uintmax_t)(intmax_t)(long long)v : v;
+    }
+    case LEN_J: {
+      uintmax_t v;
+      ARG(a, uintmax_t, v);
+      return v;
+    }
+    case LEN_Z:
+    case LEN_T: {
+      size_t v;
+      ARG(a, size_t, v);
+      return is_signed ? (uintmax_t)(intmax_t)(ptrdiff_t)v : v;
+    }
+    default: {
+      unsigned int v;
+      ARG(a, unsigned int, v);
+      if (length == LEN_HH) {
+        return is_signed ? (uintmax_t)(intmax_t)(signed char)v : (unsigned char)v;
+      }
+      if (length == LEN_H) {
+        return is_signed ? (uintmax_t)(intmax_t)(short)v : (unsigned short)v;
+      }
+      return is_signed ? (uintmax_t)(intmax_t)(int)v : v;
+    }
+  }
+}
+
+/**
+ * @brief _format format a message from either parameter source
+ *
+ * @param s - stream
+ * @param fmt - format string
+ * @param a - parameters
+ */
+static void _format(lfmt_stream_t *s,
+                    const char    *fmt,
+                    args_t        *a)
+{
+  const char *lit;
+
+  while (*fmt && !s->failed) {
+    unsigned base = 10;
+    spec_t   sp;
+
+    /* Literal text up to the next conversion */
+    lit = fmt;
+    while (*fmt && *fmt != '%') {
+      fmt++;
+    }
+    if (fmt != lit) {
+      lfmt_write(s, lit, fmt - lit);
+    }
+    fmt = _parse_spec(fmt, &sp);
+    if (!sp.conv) {
+      break;
+    }
+    if (sp.width_arg) {
+      int v;
+      ARG(a, int, v);
+      if (v < 0) {
+        sp.flags |= FLAG_LEFT;
+        v         = -v;
+      }
+      sp.width = v;
+    }
+    if (sp.prec_arg) {
+      int v;
+      ARG(a, int, v);
+      sp.prec = v < 0 ? -1 : v;
+    }
+
+    switch (sp.conv) {
+      case 'd':
+      case 'i': {
+        intmax_t v = (intmax_t)_arg_int(a, sp.length, 1);
+
+        _out_num(s,
+                 v < 0 ? -(uintmax_t)v : (uintmax_t)v,
+                 v < 0,
+                 10,
+                 sp.flags & ~FLAG_ALT,
+                 sp.width,
+                 sp.prec);
+        break;
+      }
+      case 'X':
+      case 'x':
+      case 'o':
+      case 'u': {
+        uintmax_t v = _arg_int(a, sp.length, 0);
+
+        if (sp.conv == 'o') {
+          base = 8;
+        } else if (sp.conv != 'u') {
+          base      = 16;
+          sp.flags |= sp.conv == 'X' ? FLAG_UPPER : 0;
+        }
+        _out_num(s, v, 0, base, sp.flags & ~(FLAG_PLUS | FLAG_SPACE), sp.width, sp.prec);
+        break;
+      }
+      case 'p': {
+        /* Always with the "0x" prefix, NULL included */
+        uintptr_t v;
+        int       n = 1;
+
+        if (a->p) {
+          _unpack(a, &v, sizeof(v));
+        } else {
+          v = (uintptr_t)va_arg(a->ap, void *);
+        }
+        while (n < (int)(2 * sizeof(void *)) && (v >> (4 * n))) {
+          n++;
+        }
+        if (!(sp.flags & FLAG_LEFT)) {
+          _pad(s, ' ', sp.width - 2 - n);
+        }
+        lfmt_write(s, "0x", 2);
+        _out_num(s, v, 0, 16, 0, 0, -1);
+        if (sp.flags & FLAG_LEFT) {
+          _pad(s, ' ', sp.width - 2 - n);
+        }
+        break;
+      }
+      case 'c': {
+        char c = (char)_arg_int(a, LEN_NONE, 0);
+
+        if (!(sp.flags & FLAG_LEFT)) {
+          _pad(s, ' ', sp.width - 1);
+        }
+        lfmt_putc(s, c);
+        if (sp.flags & FLAG_LEFT) {
+          _pad(s, ' ', sp.width - 1);
+        }
+        break;
+      }
+      case 's':
+        if (a->p) {
+          /* Length prefixed and not terminated */
+          uint8_t n = 0;
+
+          _unpack(a, &n, 1);
+          n = (uint8_t)MIN(n, (size_t)(a->end - a->p));
+          _out_str(s, (const char *)a->p, sp.flags, sp.width, n);
+          a->p += n;
+        } else {
+          _out_str(s, va_arg(a->ap, const char *), sp.flags, sp.width, sp.prec);
+        }
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        double v;
+
+        if (a->p) {
+          _unpack(a, &v, sizeof(v));
+        } else {
+          v = sp.length == LEN_BIG_L ? (double)va_arg(a->ap, long double) : va_arg(a->ap, double);
+        }
+        _out_float(s, v, sp.conv, sp.flags, sp.width, sp.prec);
+        break;
+      }
+      case 'n':
+        if (!a->p) {
+          (void)va_arg(a->ap, void *);
+        }
+        break;
+      case '%':
+        lfmt_putc(s, '%');
+        break;
+      default:
+        /* Unknown conversion, output it as is */
+        lfmt_putc(s, '%');
+        lfmt_putc(s, sp.conv);
+        break;
+    }
+  }
+}
+
+/**
+ * @brief _json_scan find the first byte to escape in a JSON string
+ *
+ * @param p - start of the bytes
+ * @param end - end of the bytes
+ *
+ * @return first byte to escape, end if none
+ */
+static inline const char *_json_scan(const char *p,
+                                     const char *end)
+{
+#if LFMT_USE_AVX2
+  const __m256i q32 = _mm256_set1_epi8('"');
+  const __m256i b32 = _mm256_set1_epi8('\\');
+  const __m256i c32 = _mm256_set1_epi8(0x1F);
+
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    /* v <= 0x1F unsigned as max(v, 0x1F) == 0x1F */
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, q32),
+                                                 _mm256_cmpeq_epi8(v, b32)),
+                                _mm256_cmpeq_epi8(_mm256_max_epu8(v, c32), c32));
+    unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+
+    if (bits) {
+      return p + __builtin_ctz(bits);
+    }
+  }
+#endif
+#if LFMT_USE_SSE2 || LFMT_USE_AVX2
+  const __m128i q16 = _mm_set1_epi8('"');
+  const __m128i b16 = _mm_set1_epi8('\\');
+  const __m128i c16 = _mm_set1_epi8(0x1F);
+
+  for (; end - p >= 16; p += 16) {
+    __m128i  v = _mm_loadu_si128((const __m128i *)p);
+    __m128i  m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, q16), _mm_cmpeq_epi8(v, b16)),
+                              _mm_cmpeq_epi8(_mm_max_epu8(v, c16), c16));
+    unsigned bits = (unsigned)_mm_movemask_epi8(m);
+
+    if (bits) {
+      return p + __builtin_ctz(bits);
+    }
+  }
+#endif
+  while (p < end && !JSON_ESCAPED(*p)) {
+    p++;
+  }
+  return p;
+}
+
+/* Public Functions *************************************************** */
+
+void lfmt_init(lfmt_stream_t *s,
+               char          *buf,
+               size_t        size,
+               lfmt_flush_t  flush,
+               void          *arg)
+{
+  s->buf      = buf;
+  s->size     = size;
+  s->len      = 0;
+  s->total    = 0;
+  s->accepted = 0;
+  s->flush    = flush;
+  s->arg      = arg;
+  s->failed   = 0;
+}
+
+int lfmt_flush(lfmt_stream_t *s)
+{
+  if (s->len && !s->failed) {
+    size_t r = s->flush(s->arg, s->buf, s->len);
+    s->accepted += r;
+    if (r < s->len) {
+      s->failed = 1;
+    }
+  }
+  s->len = 0;
+  return s->failed ? -1 : 0;
+}
+
+void lfmt_write(lfmt_stream_t *s,
+                const char    *str,
+                size_t        len)
+{
+  size_t n;
+
+  s->total += len;
+  if (s->failed) {
+    return;
+  }
+
+  while (len) {
+    if (s->len == s->size) {
+      if (lfmt_flush(s)) {
+        return;
+      }
+    }
+    n = MIN(len, s->size - s->len);
+    if (!s->len && n == s->size) {
+      /* Whole chunks go out straight from the source */
+      size_t r = s->flush(s->arg, str, n);
+      s->accepted += r;
+      if (r < n) {
+        s->failed = 1;
+        return;
+      }
+    } else {
+      memcpy(s->buf + s->len, str, n);
+      s->len += n;
+    }
+    str += n;
+    len -= n;
+  }
+}
+
+void lfmt_vprintf(lfmt_stream_t *s,
+                  const char    *fmt,
+                  va_list       ap)
+{
+  args_t a = { .p = NULL };
+
+  va_copy(a.ap, ap);
+  _format(s, fmt, &a);
+  va_end(a.ap);
+}
+
+void lfmt_unpack(lfmt_stream_t *s,
+                 const char    *fmt,
+                 const uint8_t *args,
+                 size_t        len)
+{
+  args_t a = { .p = args, .end = args + len };
+
+  _format(s, fmt, &a);
+}
+
+size_t lfmt_vpack(uint8_t    *buf,
+                  size_t     size,
+                  const char *fmt,
+                  va_list    ap)
+{
+  uint8_t *p = buf, *end = buf + size;
+  va_list aq;
+
+  va_copy(aq, ap);
+  while (*fmt) {
+    spec_t sp;
+
+    fmt = _parse_spec(fmt, &sp);
+    if (!sp.conv) {
+      break;
+    }
+    if (sp.width_arg) {
+      int v = va_arg(aq, int);
+      p = _pack(p, end, &v, sizeof(v));
+    }
+    if (sp.prec_arg) {
+      int v = va_arg(aq, int);
+      p = _pack(p, end, &v, sizeof(v));
+      sp.prec = v < 0 ? -1 : v;
+    }
+
+    switch (sp.conv) {
+      case 'd':
+      case 'i':
+      case 'X':
+      case 'x':
+      case 'o':
+      case 'u':
+        switch (sp.length) {
+          case LEN_L: {
+            unsigned long v = va_arg(aq, unsigned long);
+            p = _pack(p, end, &v, sizeof(v));
+            break;
+          }
+          case LEN_LL: {
+            unsigned long long v = va_arg(aq, unsigned long long);
+            p = _pack(p, end, &v, sizeof(v));
+            break;
+          }
+          case LEN_J: {
+            uintmax_t v = va_arg(aq, uintmax_t);
+            p = _pack(p, end, &v, sizeof(v));
+            break;
+          }
+          case LEN_Z:
+          case LEN_T: {
+            size_t v = va_arg(aq, size_t);
+            p = _pack(p, end, &v, sizeof(v));
+            break;
+          }
+          default: {
+            unsigned int v = va_arg(aq, unsigned int);
+            p = _pack(p, end, &v, sizeof(v));
+            break;
+          }
+        }
+        break;
+      case 'c': {
+        /* Whatever the length, promoted to int or wint_t, as _format() reads it */
+        unsigned int v = va_arg(aq, unsigned int);
+        p = _pack(p, end, &v, sizeof(v));
+        break;
+      }
+      case 'p': {
+        uintptr_t v = (uintptr_t)va_arg(aq, void *);
+        p = _pack(p, end, &v, sizeof(v));
+        break;
+      }
+      case 's': {
+        /* Copied, the string may be gone by the time it is unpacked */
+        const char *str = va_arg(aq, const char *);
+        size_t     max  = sp.prec >= 0 ? MIN((size_t)sp.prec, 255) : 255, n;
+
+        str = str ? str : "(null)";
+        for (n = 0; n < max && str[n]; n++) {
+        }
+        if (p < end) {
+          n    = MIN(n, (size_t)(end - p - 1));
+          *p++ = (uint8_t)n;
+          p    = _pack(p, end, str, n);
+        }
+        break;
+      }
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        double v = sp.length == LEN_BIG_L ? (double)va_arg(aq, long double) : va_arg(aq, double);
+        p = _pack(p, end, &v, sizeof(v));
+        break;
+      }
+      case 'n':
+        (void)va_arg(aq, void *);
+        break;
+      default:
+        break;
+    }
+  }
+  va_end(aq);
+  return (size_t)(p - buf);
+}
+
+void lfmt_printf(lfmt_stream_t *s,
+                 const char    *fmt,
+                 ...)
+{
+  va_list valist;
+
+  va_start(valist, fmt);
+  lfmt_vprintf(s, fmt, valist);
+  va_end(valist);
+}
+
+void lfmt_write_json(lfmt_stream_t *s,
+                     const char    *str,
+                     size_t        len)
+{
+  static const char hex[] = "0123456789abcdef";
+  const char        *end  = str + len;
+
+  while (str < end) {
+    const char *p = _json_scan(str, end);
+    char       e[6];
+
+    /* Runs without anything to escape are copied as a whole */
+    lfmt_write(s, str, (size_t)(p - str));
+    if (p == end) {
+      return;
+    }
+    e[0] = '\\';
+    switch (*p) {
+      case '\n':
+        e[1] = 'n';
+        break;
+      case '\r':
+        e[1] = 'r';
+        break;
+      case '\t':
+        e[1] = 't';
+        break;
+      case '"':
+      case '\\':
+        e[1] = *p;
+        break;
+      default:
+        memcpy(e + 1, "u00", 3);
+        e[4] = hex[(uint8_t)*p >> 4];
+        e[5] = hex[*p & 0x0F];
+        break;
+    }
+    lfmt_write(s, e, e[1] == 'u' ? 6 : 2);
+    str = p + 1;
+  }
+}
+#endif // #if (LOGGING_CONFIG > LIGHT_WEIGHT) || (LOGGING_INTERFACE == INTERFACE_BOTH)
@@ -0,0 +1,185 @@
+/*************************************************************************
+ *  @file logging_fmt.h
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Streaming printf-style formatter, used by the full featured mode to
+ *  emit messages of any length from a small fixed-size buffer.
+ ************************************************************************/
+
+#ifndef LOGGING_FMT_H
+#define LOGGING_FMT_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief lfmt_flush_t function to hand a chunk of output over to the logging
+ * interface
+ *
+ * @param arg - argument given to lfmt_init()
+ * @param str - chunk, not '\0' terminated
+ * @param len - chunk length in bytes
+ *
+ * @return number of bytes accepted
+ */
+typedef size_t (*lfmt_flush_t)(void       *arg,
+                               const char *str,
+                               size_t     len);
+
+/**
+ * @brief output stream of the formatter
+ */
+typedef struct {
+  char         *buf;     /**< Chunk buffer */
+  size_t       size;     /**< Chunk buffer size in bytes */
+  size_t       len;      /**< Bytes pending in the chunk buffer */
+  size_t       total;    /**< Bytes produced since lfmt_init() */
+  size_t       accepted; /**< Bytes accepted by the flush function */
+  lfmt_flush_t flush;    /**< Flush function */
+  void         *arg;     /**< Argument of the flush function */
+  uint8_t      failed;   /**< Set once a flush is not completely accepted, any further output is discarded */
+}lfmt_stream_t;
+
+/**
+ * @brief lfmt_init initialize an output stream
+ *
+ * @param s - stream
+ * @param buf - chunk buffer
+ * @param size - chunk buffer size in bytes
+ * @param flush - function called with every full chunk and by lfmt_flush()
+ * @param arg - argument of the flush function
+ */
+void lfmt_init(lfmt_stream_t *s,
+               char          *buf,
+               size_t        size,
+               lfmt_flush_t  flush,
+               void          *arg);
+
+/**
+ * @brief lfmt_write output a block of bytes
+ *
+ * @param s - stream
+ * @param str - bytes to output
+ * @param len - number of bytes
+ */
+void lfmt_write(lfmt_stream_t *s,
+                const char    *str,
+                size_t        len);
+
+/**
+ * @brief lfmt_putc output a single character
+ *
+ * @param s - stream
+ * @param c - character
+ */
+static inline void lfmt_putc(lfmt_stream_t *s,
+                             char          c)
+{
+  if (s->len < s->size) {
+    s->buf[s->len++] = c;
+    s->total++;
+  } else {
+    lfmt_write(s, &c, 1);
+  }
+}
+
+/**
+ * @brief lfmt_vprintf format a message to the stream.
+ *
+ * @note supports the flags, width, precision and length modifiers of C99
+ * printf. Integers, characters, strings and pointers are formatted in place,
+ * floating point conversions are delegated to snprintf() one at a time and
+ * are limited to 48 characters each. %n is not supported, its argument is
+ * skipped.
+ *
+ * @param s - stream
+ * @param fmt - format string
+ * @param ap - parameters
+ */
+void lfmt_vprintf(lfmt_stream_t *s,
+                  const char    *fmt,
+                  va_list       ap);
+
+/**
+ * @brief lfmt_printf format a message to the stream, see lfmt_vprintf()
+ *
+ * @param s - stream
+ * @param fmt - format string
+ * @param ... - parameters
+ */
+void lfmt_printf(lfmt_stream_t *s,
+                 const char    *fmt,
+                 ...);
+
+/**
+ * @brief lfmt_vpack store the parameters of a message in a compact binary
+ * form, so the message can be formatted later by lfmt_unpack() at a fraction
+ * of the cost of formatting it now.
+ *
+ * @note integers, characters and pointers are stored in their native size and
+ * byte order, floating point numbers as double, and strings are copied, at
+ * most 255 characters each. The packed form is only meant for the same build.
+ *
+ * @param buf - output buffer
+ * @param size - output buffer size in bytes, the parameters which don't fit
+ * are left out, see lfmt_unpack()
+ * @param fmt - format string, must stay valid until it is unpacked
+ * @param ap - parameters
+ *
+ * @return number of bytes stored
+ */
+size_t lfmt_vpack(uint8_t    *buf,
+                  size_t     size,
+                  const char *fmt,
+                  va_list    ap);
+
+/**
+ * @brief lfmt_unpack format a message to the stream from the parameters
+ * packed by lfmt_vpack()
+ *
+ * @note missing parameters are formatted as 0 or the empty string
+ *
+ * @param s - stream
+ * @param fmt - format string given to lfmt_vpack()
+ * @param args - packed parameters
+ * @param len - number of bytes packed
+ */
+void lfmt_unpack(lfmt_stream_t *s,
+                 const char    *fmt,
+                 const uint8_t *args,
+                 size_t        len);
+
+/**
+ * @brief lfmt_write_json output a block of bytes escaped as the contents of a
+ * JSON string: '"', '\\' and the control characters are escaped, the other
+ * bytes are copied as they are.
+ *
+ * @note the bytes to escape are searched for 32 bytes at a time with AVX2 or
+ * 16 bytes at a time with SSE2 if the compiler targets them.
+ *
+ * @param s - stream
+ * @param str - bytes to output
+ * @param len - number of bytes
+ */
+void lfmt_write_json(lfmt_stream_t *s,
+                     const char    *str,
+                     size_t        len);
+
+/**
+ * @brief lfmt_flush hand the pending bytes over to the flush function
+ *
+ * @param s - stream
+ *
+ * @return 0 if all the output so far has been accepted, -1 otherwise
+ */
+int lfmt_flush(lfmt_stream_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //LOGGING_FMT_H
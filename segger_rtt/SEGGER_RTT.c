@@ -136,10 +136,30 @@
   #define STRLEN(a)                                       strlen((a))
 #endif
 
+//
+// SEGGER_RTT_WAIT_HOOK can name a function called while a blocking
+// write waits for the host to read, e.g. to let a host-side simulation
+// of the debug probe make progress.
+//
+#ifdef    SEGGER_RTT_WAIT_HOOK
+  extern void SEGGER_RTT_WAIT_HOOK(void);
+  #define _RTT_WAIT()                                     SEGGER_RTT_WAIT_HOOK()
+#else
+  #define _RTT_WAIT()
+#endif
+
 #ifndef   SEGGER_RTT_MEMCPY_USE_BYTELOOP
   #define SEGGER_RTT_MEMCPY_USE_BYTELOOP                   0
 #endif
 
+#ifndef   SEGGER_RTT_MEMCPY_USE_RINGCOPY
+  #if SEGGER_RTT_MEMCPY_USE_BYTELOOP || (defined SEGGER_RTT_MEMCPY) || (defined MEMCPY)
+    #define SEGGER_RTT_MEMCPY_USE_RINGCOPY                 0              // Keep the copy method chosen by the configuration
+  #else
+    #define SEGGER_RTT_MEMCPY_USE_RINGCOPY                 1
+  #endif
+#endif
+
 #ifndef   SEGGER_RTT_MEMCPY
   #ifdef  MEMCPY
     #define SEGGER_RTT_MEMCPY(pDest, pSrc, NumBytes)      MEMCPY((pDest), (pSrc), (NumBytes))
@@ -148,6 +168,61 @@
   #endif
 #endif
 
+#if SEGGER_RTT_MEMCPY_USE_RINGCOPY
+  #define _RTT_MEMCPY(pDest, pSrc, NumBytes)              _RingCopy((char*)(pDest), (const char*)(pSrc), (NumBytes))
+#else
+  #define _RTT_MEMCPY(pDest, pSrc, NumBytes)              SEGGER_RTT_MEMCPY((pDest), (pSrc), (NumBytes))
+#endif
+
+//
+// Word-at-a-time copies of misaligned data need hardware support for
+// unaligned LDR/STR (Cortex-M3 and above, x86).
+//
+#ifndef   _RTT_UNALIGNED_OK
+  #if (defined __ARM_FEATURE_UNALIGNED) || (defined __i386__) || (defined __x86_64__) || (defined _M_IX86) || (defined _M_X64)
+    #define _RTT_UNALIGNED_OK                             1
+  #else
+    #define _RTT_UNALIGNED_OK                             0
+  #endif
+#endif
+
+#ifndef   _RTT_USE_SSE2
+  #if (defined __SSE2__) || (defined _M_X64)
+    #define _RTT_USE_SSE2                                 1
+  #else
+    #define _RTT_USE_SSE2                                 0
+  #endif
+#endif
+
+#if SEGGER_RTT_MEMCPY_USE_RINGCOPY && _RTT_USE_SSE2
+  #include <emmintrin.h>
+#endif
+
+//
+// Lock-free single producer writes need acquire/release fences, from
+// C11 atomics or the GCC builtins.
+//
+#ifndef   SEGGER_RTT_USE_LOCK_FREE
+  #if ((defined __STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !(defined __STDC_NO_ATOMICS__)) || (defined __GNUC__)
+    #define SEGGER_RTT_USE_LOCK_FREE                      1
+  #else
+    #define SEGGER_RTT_USE_LOCK_FREE                      0
+  #endif
+#endif
+
+#if SEGGER_RTT_USE_LOCK_FREE
+  #if (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !(defined __STDC_NO_ATOMICS__)
+    #include <stdatomic.h>
+    #define _RTT_ACQUIRE()                                atomic_thread_fence(memory_order_acquire)
+    #define _RTT_RELEASE()                                atomic_thread_fence(memory_order_release)
+  #elif (defined __GNUC__)
+    #define _RTT_ACQUIRE()                                __atomic_thread_fence(__ATOMIC_ACQUIRE)
+    #define _RTT_RELEASE()                                __atomic_thread_fence(__ATOMIC_RELEASE)
+  #else
+    #error "SEGGER_RTT_USE_LOCK_FREE needs C11 atomics or GCC atomic builtins."
+  #endif
+#endif
+
 #ifndef   MIN
   #define MIN(a, b)                                       (((a) < (b)) ? (a) : (b))
 #endif
@@ -308,6 +383,199 @@ static void _DoInit(void)
   p->acID[6] = ' ';
 }
 
+#if SEGGER_RTT_MEMCPY_USE_RINGCOPY
+/*********************************************************************
+ *
+ *       _LoadU32() / _StoreU32()
+ *
+ *  Function description
+ *    Word access without alignment requirement. The compiler turns the
+ *    fixed-size memcpy() into a single LDR/STR where unaligned access
+ *    is supported.
+ */
+static inline unsigned _LoadU32(const char* p) {
+  unsigned v;
+
+  memcpy(&v, p, 4u);
+  return v;
+}
+
+static inline void _StoreU32(char* p, unsigned v) {
+  memcpy(p, &v, 4u);
+}
+
+/*********************************************************************
+ *
+ *       _RingCopy()
+ *
+ *  Function description
+ *    Copies a block into an RTT ring buffer or out of it. Tuned for the
+ *    short (10 to 150 bytes) and often misaligned blocks RTT sees,
+ *    dispatched on the size class:
+ *      < 8 bytes: Byte loop, call overhead of memcpy() dominates. With
+ *        unaligned access 4..7 bytes as 2 overlapping word moves.
+ *      SSE2 (host): 8..15 bytes as 2 overlapping 8 byte moves, 16..32
+ *        bytes as 2 overlapping 16 byte moves, larger blocks in 32 byte
+ *        steps with an overlapping last step.
+ *      Cortex-M3 and above: Align destination, then 16 and 4 byte
+ *        steps with unaligned source loads, byte tail.
+ *      Cortex-M0: Word steps if source and destination are equally
+ *        aligned, byte loop unrolled by 4 otherwise.
+ *
+ *  Parameters
+ *    pDst         Destination, must not overlap the source.
+ *    pSrc         Source.
+ *    NumBytes     Number of bytes to copy.
+ */
+static void _RingCopy(char* pDst, const char* pSrc, unsigned NumBytes) {
+#if _RTT_UNALIGNED_OK
+  if (NumBytes < 4u) {
+    while (NumBytes--) {
+      *pDst++ = *pSrc++;
+    }
+    return;
+  }
+  if (NumBytes < 8u) {
+    unsigned v0 = _LoadU32(pSrc);
+    unsigned v1 = _LoadU32(pSrc + NumBytes - 4u);
+
+    _StoreU32(pDst, v0);
+    _StoreU32(pDst + NumBytes - 4u, v1);
+    return;
+  }
+#else
+  if (NumBytes < 8u) {
+    while (NumBytes--) {
+      *pDst++ = *pSrc++;
+    }
+    return;
+  }
+#endif
+#if _RTT_USE_SSE2
+  if (NumBytes < 16u) {
+    unsigned long long v0;
+    unsigned long long v1;
+
+    memcpy(&v0, pSrc, 8u);
+    memcpy(&v1, pSrc + NumBytes - 8u, 8u);
+    memcpy(pDst, &v0, 8u);
+    memcpy(pDst + NumBytes - 8u, &v1, 8u);
+  } else if (NumBytes <= 32u) {
+    __m128i v0 = _mm_loadu_si128((const __m128i*)pSrc);
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(pSrc + NumBytes - 16u));
+
+    _mm_storeu_si128((__m128i*)pDst, v0);
+    _mm_storeu_si128((__m128i*)(pDst + NumBytes - 16u), v1);
+  } else {
+    __m128i     Last0;
+    __m128i     Last1;
+    char*       pDstLast;
+    //
+    // 32 bytes per step, the last (partial) step is an overlapping
+    // 32 byte move loaded up front.
+    //
+    Last0    = _mm_loadu_si128((const __m128i*)(pSrc + NumBytes - 32u));
+    Last1    = _mm_loadu_si128((const __m128i*)(pSrc + NumBytes - 16u));
+    pDstLast = pDst + NumBytes - 32u;
+    do {
+      __m128i v0 = _mm_loadu_si128((const __m128i*)pSrc);
+      __m128i v1 = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+
+      _mm_storeu_si128((__m128i*)pDst, v0);
+      _mm_storeu_si128((__m128i*)(pDst + 16), v1);
+      pDst     += 32;
+      pSrc     += 32;
+      NumBytes -= 32u;
+    } while (NumBytes > 32u);
+    _mm_storeu_si128((__m128i*)pDstLast, Last0);
+    _mm_storeu_si128((__m128i*)(pDstLast + 16), Last1);
+  }
+#else
+#if (_RTT_UNALIGNED_OK == 0)
+  if (((unsigned long)pDst ^ (unsigned long)pSrc) & 3u) {
+    while (NumBytes >= 4u) {
+      pDst[0]   = pSrc[0];
+      pDst[1]   = pSrc[1];
+      pDst[2]   = pSrc[2];
+      pDst[3]   = pSrc[3];
+      pDst     += 4;
+      pSrc     += 4;
+      NumBytes -= 4u;
+    }
+    while (NumBytes--) {
+      *pDst++ = *pSrc++;
+    }
+    return;
+  }
+#endif
+  //
+  // Align the destination, stores of the ring buffer are then aligned
+  // and with _RTT_UNALIGNED_OK == 0 so are the loads.
+  //
+  while ((unsigned long)pDst & 3u) {
+    *pDst++ = *pSrc++;
+    NumBytes--;
+  }
+  while (NumBytes >= 16u) {
+    unsigned v0 = _LoadU32(pSrc);
+    unsigned v1 = _LoadU32(pSrc + 4);
+    unsigned v2 = _LoadU32(pSrc + 8);
+    unsigned v3 = _LoadU32(pSrc + 12);
+
+    _StoreU32(pDst, v0);
+    _StoreU32(pDst + 4, v1);
+    _StoreU32(pDst + 8, v2);
+    _StoreU32(pDst + 12, v3);
+    pDst     += 16;
+    pSrc     += 16;
+    NumBytes -= 16u;
+  }
+  while (NumBytes >= 4u) {
+    _StoreU32(pDst, _LoadU32(pSrc));
+    pDst     += 4;
+    pSrc     += 4;
+    NumBytes -= 4u;
+  }
+  while (NumBytes--) {
+    *pDst++ = *pSrc++;
+  }
+#endif
+}
+#endif
+
+#if SEGGER_RTT_MEMCPY_USE_RINGCOPY || SEGGER_RTT_USE_LOCK_FREE
+/*********************************************************************
+ *
+ *       _RingWrite()
+ *
+ *  Function description
+ *    Copies a block to the ring buffer at the given write offset,
+ *    wrapping around at the end of the buffer. The caller makes sure
+ *    the block fits.
+ *
+ *  Parameters
+ *    pRing        Ring buffer to post to.
+ *    WrOff        Offset to write at.
+ *    pData        Data to post.
+ *    NumBytes     Number of bytes to post, at most SizeOfBuffer.
+ *
+ *  Return value
+ *    Write offset after the block.
+ */
+static unsigned _RingWrite(SEGGER_RTT_BUFFER_UP* pRing, unsigned WrOff, const char* pData, unsigned NumBytes) {
+  unsigned Rem;
+
+  Rem = pRing->SizeOfBuffer - WrOff;
+  if (Rem > NumBytes) {
+    _RTT_MEMCPY(pRing->pBuffer + WrOff, pData, NumBytes);
+    return WrOff + NumBytes;
+  }
+  _RTT_MEMCPY(pRing->pBuffer + WrOff, pData, Rem);
+  _RTT_MEMCPY(pRing->pBuffer, pData + Rem, NumBytes - Rem);
+  return NumBytes - Rem;
+}
+#endif
+
 /*********************************************************************
  *
  *       _WriteBlocking()
@@ -352,6 +620,9 @@ static unsigned _WriteBlocking(SEGGER_RTT_BUFFER_UP* pRing,
     }
     NumBytesToWrite = MIN(NumBytesToWrite, (pRing->SizeOfBuffer - WrOff)); // Number of bytes that can be written until buffer wrap-around
     NumBytesToWrite = MIN(NumBytesToWrite, NumBytes);
+    if (NumBytesToWrite == 0u) {
+      _RTT_WAIT();
+    }
 #if SEGGER_RTT_MEMCPY_USE_BYTELOOP
     pDst             = pRing->pBuffer + WrOff;
     NumBytesWritten += NumBytesToWrite;
@@ -362,7 +633,7 @@ static unsigned _WriteBlocking(SEGGER_RTT_BUFFER_UP* pRing,
     }
     ;
 #else
-    SEGGER_RTT_MEMCPY(pRing->pBuffer + WrOff, pBuffer, NumBytesToWrite);
+    _RTT_MEMCPY(pRing->pBuffer + WrOff, pBuffer, NumBytesToWrite);
     NumBytesWritten += NumBytesToWrite;
     pBuffer         += NumBytesToWrite;
     NumBytes        -= NumBytesToWrite;
@@ -399,14 +670,19 @@ static void _WriteNoCheck(SEGGER_RTT_BUFFER_UP* pRing,
                           const char          * pData,
                           unsigned            NumBytes)
 {
-  unsigned NumBytesAtOnce;
   unsigned WrOff;
+#if (SEGGER_RTT_MEMCPY_USE_RINGCOPY == 0)
+  unsigned NumBytesAtOnce;
   unsigned Rem;
+#endif
 #if SEGGER_RTT_MEMCPY_USE_BYTELOOP
   char*    pDst;
 #endif
 
   WrOff = pRing->WrOff;
+#if SEGGER_RTT_MEMCPY_USE_RINGCOPY
+  pRing->WrOff = _RingWrite(pRing, WrOff, pData, NumBytes);
+#else
   Rem   = pRing->SizeOfBuffer - WrOff;
   if (Rem > NumBytes) {
     //
@@ -450,6 +726,7 @@ static void _WriteNoCheck(SEGGER_RTT_BUFFER_UP* pRing,
     pRing->WrOff = NumBytesAtOnce;
 #endif
   }
+#endif
 }
 
 /*********************************************************************
@@ -567,7 +844,7 @@ unsigned SEGGER_RTT_ReadNoLock(unsigned BufferIndex,
     }
     ;
 #else
-    SEGGER_RTT_MEMCPY(pBuffer, pRing->pBuffer + RdOff, NumBytesRem);
+    _RTT_MEMCPY(pBuffer, pRing->pBuffer + RdOff, NumBytesRem);
     NumBytesRead += NumBytesRem;
     pBuffer      += NumBytesRem;
     BufferSize   -= NumBytesRem;
@@ -596,7 +873,7 @@ unsigned SEGGER_RTT_ReadNoLock(unsigned BufferIndex,
     }
     ;
 #else
-    SEGGER_RTT_MEMCPY(pBuffer, pRing->pBuffer + RdOff, NumBytesRem);
+    _RTT_MEMCPY(pBuffer, pRing->pBuffer + RdOff, NumBytesRem);
     NumBytesRead += NumBytesRem;
     pBuffer      += NumBytesRem;
     BufferSize   -= NumBytesRem;
@@ -718,7 +995,7 @@ void SEGGER_RTT_WriteWithOverwriteNoLock(unsigned  BufferIndex,
       ;
       pRing->WrOff += Avail;
 #else
-      SEGGER_RTT_MEMCPY(pRing->pBuffer + pRing->WrOff, pData, NumBytes);
+      _RTT_MEMCPY(pRing->pBuffer + pRing->WrOff, pData, NumBytes);
       pRing->WrOff += NumBytes;
 #endif
       break;
@@ -735,7 +1012,7 @@ void SEGGER_RTT_WriteWithOverwriteNoLock(unsigned  BufferIndex,
       ;
       pRing->WrOff = 0;
 #else
-      SEGGER_RTT_MEMCPY(pRing->pBuffer + pRing->WrOff, pData, Avail);
+      _RTT_MEMCPY(pRing->pBuffer + pRing->WrOff, pData, Avail);
       pData       += Avail;
       pRing->WrOff = 0;
       NumBytes    -= Avail;
@@ -801,14 +1078,14 @@ unsigned SEGGER_RTT_WriteSkipNoLock(unsigned  BufferIndex,
     Avail = pRing->SizeOfBuffer - WrOff - 1u;           // Space until wrap-around (assume 1 byte not usable for case that RdOff == 0)
     if (Avail >= NumBytes) {                            // Case 1)?
       CopyStraight:
-      memcpy(pRing->pBuffer + WrOff, pData, NumBytes);
+      _RTT_MEMCPY(pRing->pBuffer + WrOff, pData, NumBytes);
       pRing->WrOff = WrOff + NumBytes;
       return 1;
     }
     Avail += RdOff;                                     // Space incl. wrap-around
     if (Avail >= NumBytes) {                            // Case 2? => If not, we have case 3) (does not fit)
       Rem = pRing->SizeOfBuffer - WrOff;                // Space until end of buffer
-      memcpy(pRing->pBuffer + WrOff, pData, Rem);       // Copy 1st chunk
+      _RTT_MEMCPY(pRing->pBuffer + WrOff, pData, Rem);  // Copy 1st chunk
       NumBytes -= Rem;
       //
       // Special case: First check that assumed RdOff == 0 calculated that last element before wrap-around could not be used
@@ -817,7 +1094,7 @@ unsigned SEGGER_RTT_WriteSkipNoLock(unsigned  BufferIndex,
       // Therefore, check if 2nd memcpy is necessary at all
       //
       if (NumBytes) {
-        memcpy(pRing->pBuffer, pData + Rem, NumBytes);
+        _RTT_MEMCPY(pRing->pBuffer, pData + Rem, NumBytes);
       }
       pRing->WrOff = NumBytes;
       return 1;
@@ -910,6 +1187,73 @@ unsigned SEGGER_RTT_WriteNoLock(unsigned  BufferIndex,
   return Status;
 }
 
+#if SEGGER_RTT_USE_LOCK_FREE
+/*********************************************************************
+ *
+ *       SEGGER_RTT_WriteSingleProducer
+ *
+ *  Function description
+ *    Stores a specified number of characters in SEGGER RTT
+ *    control block which is then read by the host, without locking.
+ *    Interrupts are never masked, the data is published to the host
+ *    with a release fence before the write offset is updated, and the
+ *    read offset of the host is loaded with an acquire fence after it.
+ *
+ *  Parameters
+ *    BufferIndex  Index of "Up"-buffer to be used (e.g. 0 for "Terminal").
+ *    pBuffer      Pointer to character array. Does not need to point to a \0 terminated string.
+ *    NumBytes     Number of bytes to be stored in the SEGGER RTT control block.
+ *
+ *  Return value
+ *    Number of bytes which have been stored in the "Up"-buffer.
+ *
+ *  Notes
+ *    (1) Data is stored according to buffer flags.
+ *    (2) Only safe if this is the only function writing to the buffer
+ *        and it is called from a single context (thread, interrupt or
+ *        core) at a time. Do not mix with the other write functions
+ *        on the same buffer.
+ *    (3) For performance reasons this function does not call Init()
+ *        and may only be called after RTT has been initialized.
+ */
+unsigned SEGGER_RTT_WriteSingleProducer(unsigned  BufferIndex,
+                                        const void* pBuffer,
+                                        unsigned  NumBytes)
+{
+  const char            *           pData;
+  SEGGER_RTT_BUFFER_UP  * pRing;
+  unsigned              NumBytesWritten;
+  unsigned              Avail;
+  unsigned              RdOff;
+  unsigned              WrOff;
+
+  pData           = (const char *)pBuffer;
+  pRing           = &_SEGGER_RTT.aUp[BufferIndex];
+  NumBytesWritten = 0u;
+  WrOff           = pRing->WrOff;                      // Only written by us, no ordering needed
+  do {
+    RdOff = pRing->RdOff;
+    _RTT_ACQUIRE();                                    // Host is done reading the space we are about to overwrite
+    Avail = (RdOff > WrOff) ? RdOff - WrOff - 1u : pRing->SizeOfBuffer - 1u - WrOff + RdOff;
+    if ((Avail < NumBytes) && (pRing->Flags == SEGGER_RTT_MODE_NO_BLOCK_SKIP)) {
+      break;                                           // All or nothing
+    }
+    Avail = MIN(Avail, NumBytes);
+    if (Avail) {
+      WrOff = _RingWrite(pRing, WrOff, pData, Avail);
+      _RTT_RELEASE();                                  // Data is visible before the new write offset
+      *(volatile unsigned*)&pRing->WrOff = WrOff;
+      pData           += Avail;
+      NumBytes        -= Avail;
+      NumBytesWritten += Avail;
+    } else if (pRing->Flags == SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL) {
+      _RTT_WAIT();
+    }
+  } while (NumBytes && pRing->Flags == SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL);
+  return NumBytesWritten;
+}
+#endif
+
 /*********************************************************************
  *
  *       SEGGER_RTT_Write
@@ -1280,6 +1624,24 @@ unsigned SEGGER_RTT_HasDataUp(unsigned BufferIndex)
   return pRing->WrOff - v;
 }
 
+/*********************************************************************
+ *
+ *       SEGGER_RTT_GetAvailWriteSpace
+ *
+ *  Function description
+ *    Returns the number of bytes available in the up-buffer.
+ *
+ *  Parameters
+ *    BufferIndex  Index of the up buffer.
+ *
+ *  Return value
+ *    Number of bytes that can be written without blocking or skipping.
+ */
+unsigned SEGGER_RTT_GetAvailWriteSpace(unsigned BufferIndex)
+{
+  return _GetAvailWriteSpace(&_SEGGER_RTT.aUp[BufferIndex]);
+}
+
 /*********************************************************************
  *
  *       SEGGER_RTT_AllocDownBuffer
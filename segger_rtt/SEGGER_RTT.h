@@ -175,6 +175,7 @@ int          SEGGER_RTT_GetKey                  (void);
 unsigned     SEGGER_RTT_HasData                 (unsigned BufferIndex);
 int          SEGGER_RTT_HasKey                  (void);
 unsigned     SEGGER_RTT_HasDataUp               (unsigned BufferIndex);
+unsigned     SEGGER_RTT_GetAvailWriteSpace      (unsigned BufferIndex);
 void         SEGGER_RTT_Init                    (void);
 unsigned     SEGGER_RTT_Read                    (unsigned BufferIndex,
                                                  void     * pBuffer,
@@ -197,6 +198,9 @@ unsigned     SEGGER_RTT_Write                   (unsigned  BufferIndex,
 unsigned     SEGGER_RTT_WriteNoLock             (unsigned  BufferIndex,
                                                  const void* pBuffer,
                                                  unsigned  NumBytes);
+unsigned     SEGGER_RTT_WriteSingleProducer     (unsigned  BufferIndex,
+                                                 const void* pBuffer,
+                                                 unsigned  NumBytes);
 unsigned     SEGGER_RTT_WriteSkipNoLock         (unsigned  BufferIndex,
                                                  const void* pBuffer,
                                                  unsigned  NumBytes);
@@ -0,0 +1,288 @@
+/*************************************************************************
+ *  @file lfmt_check.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Checks the formatter of logging_fmt.c against vsnprintf() of the C
+ *  library: every valid combination of flags, width, precision, '*', length
+ *  modifier and conversion over a set of edge values, formatted through a
+ *  chunk buffer of 7 bytes so the output crosses chunks, and once more
+ *  through lfmt_vpack() and lfmt_unpack(). Run it after changing the parser
+ *  or the conversions.
+ *
+ *  Build: cc -O2 -o lfmt_check tools/lfmt_check.c
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <wchar.h>
+/* Built in, so the check needs no other file of the library */
+#include "../logging_fmt.c"
+
+/* Defines  *********************************************************** */
+#define OUT_SIZE                512
+#define CHUNK_SIZE              7
+#define PACK_SIZE               256
+#define SHOW_MAX                10
+
+#define ARRAY_LEN(a)            (sizeof(a) / sizeof((a)[0]))
+
+/**
+ * @brief output collected by the flush function
+ */
+typedef struct {
+  char   buf[OUT_SIZE];
+  size_t len;
+}out_t;
+
+/* Static Variables *************************************************** */
+static unsigned long cases, errors;
+
+/* Static Functions *************************************************** */
+static size_t collect(void       *arg,
+                      const char *str,
+                      size_t     len)
+{
+  out_t *o = arg;
+  size_t n = MIN(len, OUT_SIZE - 1 - o->len);
+
+  memcpy(o->buf + o->len, str, n);
+  o->len += n;
+  return len;
+}
+
+static void mismatch(const char *how,
+                     const char *fmt,
+                     const char *want,
+                     const char *got)
+{
+  if (errors++ < SHOW_MAX) {
+    printf("mismatch %s: \"%s\" want \"%s\" got \"%s\"\n", how, fmt, want, got);
+  }
+}
+
+/**
+ * @brief format a message with vsnprintf(), lfmt_vprintf() and through
+ * lfmt_vpack() and lfmt_unpack(), and compare the results
+ */
+static void one(const char *fmt,
+                ...)
+{
+  char          want[OUT_SIZE], chunk[CHUNK_SIZE];
+  uint8_t       packed[PACK_SIZE];
+  out_t         got = { { 0 }, 0 };
+  lfmt_stream_t s;
+  va_list       ap;
+  size_t        n;
+
+  cases++;
+  va_start(ap, fmt);
+  vsnprintf(want, sizeof(want), fmt, ap);
+  va_end(ap);
+
+  va_start(ap, fmt);
+  lfmt_init(&s, chunk, sizeof(chunk), collect, &got);
+  lfmt_vprintf(&s, fmt, ap);
+  lfmt_flush(&s);
+  va_end(ap);
+  got.buf[got.len] = '\0';
+  if (strcmp(want, got.buf) || s.total != strlen(want)) {
+    mismatch("printf", fmt, want, got.buf);
+  }
+
+  va_start(ap, fmt);
+  n = lfmt_vpack(packed, sizeof(packed), fmt, ap);
+  va_end(ap);
+  got.len = 0;
+  lfmt_init(&s, chunk, sizeof(chunk), collect, &got);
+  lfmt_unpack(&s, fmt, packed, n);
+  lfmt_flush(&s);
+  got.buf[got.len] = '\0';
+  if (strcmp(want, got.buf)) {
+    mismatch("pack", fmt, want, got.buf);
+  }
+}
+
+/**
+ * @brief the conversion specifications of a conversion: every subset of the
+ * flags valid for it, with every width and precision, calling fn with each
+ */
+static void specs(const char *flags,
+                  const char *length,
+                  char       conv,
+                  int        with_prec,
+                  void (*fn)(const char *fmt, int star))
+{
+  static const char *widths[] = { "", "1", "5", "17", "*" };
+  static const char *precs[]  = { "", ".", ".0", ".1", ".4", ".12", ".*" };
+  size_t            nf        = strlen(flags);
+  char              fmt[32], f[8];
+
+  for (unsigned m = 0; m < (1u << nf); m++) {
+    size_t k = 0;
+
+    for (size_t i = 0; i < nf; i++) {
+      if (m & (1u << i)) {
+        f[k++] = flags[i];
+      }
+    }
+    f[k] = '\0';
+    for (size_t w = 0; w < ARRAY_LEN(widths); w++) {
+      for (size_t p = 0; p < (with_prec ? ARRAY_LEN(precs) : 1); p++) {
+        snprintf(fmt, sizeof(fmt), "<%%%s%s%s%s%c>", f, widths[w], precs[p], length, conv);
+        fn(fmt, (widths[w][0] == '*') | (precs[p][1] == '*') << 1);
+      }
+    }
+  }
+}
+
+/* The '*' parameters, a negative width means left aligned */
+static const int star_widths[] = { 9, -9 };
+static const int star_precs[]  = { 3, -1 };
+
+/* The edge values, converted to the type of each length modifier */
+static const long long ivals[] = {
+  0, 1, -1, 7, 42, -42, 127, -128, 255, 32767, -32768, 65535, 2147483647,
+  -2147483647 - 1, 4294967295LL, 9223372036854775807LL, -9223372036854775807LL - 1
+};
+
+#define ONE_STAR(fmt, star, v)                                            \
+  do {                                                                    \
+    if ((star) == 0) {                                                    \
+      one((fmt), (v));                                                    \
+    }                                                                     \
+    for (size_t w_ = 0; w_ < ARRAY_LEN(star_widths); w_++) {              \
+      for (size_t p_ = 0; p_ < ARRAY_LEN(star_precs); p_++) {             \
+        if ((star) == 1 && p_ == 0) {                                     \
+          one((fmt), star_widths[w_], (v));                               \
+        } else if ((star) == 2 && w_ == 0) {                              \
+          one((fmt), star_precs[p_], (v));                                \
+        } else if ((star) == 3) {                                         \
+          one((fmt), star_widths[w_], star_precs[p_], (v));               \
+        }                                                                 \
+      }                                                                   \
+    }                                                                     \
+  } while (0)
+
+/* Length modifier of the integer conversion being checked */
+static const char *cur_length;
+
+static void ints(const char *fmt,
+                 int        star)
+{
+  for (size_t i = 0; i < ARRAY_LEN(ivals); i++) {
+    long long v = ivals[i];
+
+    if (!strcmp(cur_length, "hh") || !strcmp(cur_length, "h") || !*cur_length) {
+      ONE_STAR(fmt, star, (int)v);
+    } else if (!strcmp(cur_length, "l")) {
+      ONE_STAR(fmt, star, (long)v);
+    } else if (!strcmp(cur_length, "ll")) {
+      ONE_STAR(fmt, star, v);
+    } else if (!strcmp(cur_length, "j")) {
+      ONE_STAR(fmt, star, (intmax_t)v);
+    } else if (!strcmp(cur_length, "z")) {
+      ONE_STAR(fmt, star, (size_t)v);
+    } else {
+      ONE_STAR(fmt, star, (ptrdiff_t)v);
+    }
+  }
+}
+
+static void chars(const char *fmt,
+                  int        star)
+{
+  static const int vals[] = { 'A', 'z', ' ', '%' };
+
+  for (size_t i = 0; i < ARRAY_LEN(vals); i++) {
+    if (*cur_length) {
+      ONE_STAR(fmt, star, (wint_t)vals[i]);
+    } else {
+      ONE_STAR(fmt, star, vals[i]);
+    }
+  }
+}
+
+static void strs(const char *fmt,
+                 int        star)
+{
+  static const char *vals[] = { "", "a", "abc", "hello, world", "%d" };
+
+  for (size_t i = 0; i < ARRAY_LEN(vals); i++) {
+    ONE_STAR(fmt, star, vals[i]);
+  }
+}
+
+static void ptrs(const char *fmt,
+                 int        star)
+{
+  static int  x;
+  static void *vals[3];
+
+  vals[0] = &x;
+  vals[1] = (void *)(uintptr_t)0x1234;
+  vals[2] = (void *)~(uintptr_t)0;
+  for (size_t i = 0; i < ARRAY_LEN(vals); i++) {
+    ONE_STAR(fmt, star, vals[i]);
+  }
+}
+
+static void floats(const char *fmt,
+                   int        star)
+{
+  static const double vals[] = { 0.0, -0.0, 1.0, -1.5, 3.14159265358979, 1e-7, 123456789.125, 1e15 };
+
+  for (size_t i = 0; i < ARRAY_LEN(vals); i++) {
+    if (*cur_length) {
+      ONE_STAR(fmt, star, (long double)vals[i]);
+    } else {
+      ONE_STAR(fmt, star, vals[i]);
+    }
+  }
+}
+
+int main(void)
+{
+  static const char *int_lengths[] = { "", "hh", "h", "l", "ll", "j", "z", "t" };
+  static const char signed_conv[]  = "di", unsigned_conv[] = "uoxX";
+  static const char float_conv[]   = "fFeEgGaA";
+
+  for (size_t l = 0; l < ARRAY_LEN(int_lengths); l++) {
+    cur_length = int_lengths[l];
+    for (size_t c = 0; signed_conv[c]; c++) {
+      specs("-+ 0", cur_length, signed_conv[c], 1, ints);
+    }
+    for (size_t c = 0; unsigned_conv[c]; c++) {
+      specs(unsigned_conv[c] == 'u' ? "-0" : "-#0", cur_length, unsigned_conv[c], 1, ints);
+    }
+  }
+  cur_length = "";
+  specs("-", "", 'c', 0, chars);
+  specs("-", "", 's', 1, strs);
+  specs("-", "", 'p', 0, ptrs);
+  for (size_t c = 0; float_conv[c]; c++) {
+    cur_length = "";
+    specs("-+ #0", "", float_conv[c], 1, floats);
+    /* Formatted as double, %La differs as soon as long double is wider */
+    if (float_conv[c] != 'a' && float_conv[c] != 'A') {
+      cur_length = "L";
+      specs("-+ #0", "L", float_conv[c], 1, floats);
+    }
+  }
+  cur_length = "l";
+  specs("-", "l", 'c', 0, chars);
+
+  /* Mixed parameters, to check the pack offsets stay in step */
+  one("%d %s %c %lu %p %.2f %%", -3, "ab", 'x', 123456789UL, (void *)&cases, 2.5);
+  one("%lc%hhd%lld%s%zu", (wint_t)'q', 300, -5LL, "z", (size_t)77);
+  one("%*d|%-*.*s|%.*f", 6, 42, 8, 2, "hello", 3, 1.0 / 3);
+  one("100%% done");
+  one("no conversion");
+
+  printf("%lu cases\n", cases);
+  printf("check: %s\n", errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+/*************************************************************************
+ *  @file logarc.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Writes the binary records of BINARY_ON in captures of the logging
+ *  output into an indexed archive, which logquery searches without decoding
+ *  what can't match. The records are cut into blocks of a fixed size before
+ *  compression, and every block has an entry in the index at the end of the
+ *  archive: its lowest and highest timestamp, the number of records per
+ *  level, a bloom filter of its call sites with their levels and a bloom
+ *  filter of the tokens of its messages, the runs of letters, digits and '_'
+ *  in them. The records are kept as they are, so they take little room, and
+ *  formatted again when queried.
+ *
+ *  Build: cc -O2 -o logarc tools/logarc.c tools/logbin.c
+ *
+ *  Usage: logarc [options] firmware.elf archive.lba [capture...]
+ *    -b <KiB>   size of a block before compression, 64 by default
+ *    -t <bits>  bits of the token bloom filter of a block, 16384 by default,
+ *               more for fewer false hits on blocks with many distinct
+ *               values
+ *    -i         go on if the build ID of a capture doesn't match
+ *    -r <hz>    timestamp ticks per second, if the sync records have none
+ *    -s         statistics on stderr at the end
+ *  The captures, raw or written by logpack, are archived in the order
+ *  given, from stdin if none is.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define SITE_BITS               1024
+
+/* Static Variables *************************************************** */
+static logbin_elf_t       elf;
+static logbin_arc_head_t  head = { .magic = LOGBIN_ARC_MAGIC, .block_len = 64u << 10,
+                                   .site_bits = SITE_BITS, .token_bits = 16384 };
+static logbin_arc_block_t blk;
+static uint8_t            *raw, *zip, *blooms;
+static logbin_out_t       index_buf, msg;
+static FILE               *arc;
+static uint64_t           hz, fixed_hz, offset;
+static int                ignore_id, mismatch;
+static uint64_t           n_records, n_bytes;
+
+/* Static Functions *************************************************** */
+
+static void add_tokens(const char *s,
+                       size_t     len)
+{
+  const char *end = s + len;
+  char       tok[LOGBIN_TOKEN_MAX];
+  size_t     n;
+
+  while ((n = logbin_token(&s, end, tok))) {
+    logbin_bloom_add(blooms + head.site_bits / 8, head.token_bits, tok, n);
+  }
+}
+
+/**
+ * @brief compress the block being filled, if any, add its index entry and
+ * start the next one
+ */
+static void flush_block(void)
+{
+  size_t bloom_len = (head.site_bits + head.token_bits) / 8;
+
+  if (!blk.len) {
+    return;
+  }
+  blk.offset = offset;
+  blk.hz     = hz;
+  blk.clen   = (uint32_t)logbin_lz_compress(zip, raw, blk.len);
+  fwrite(zip, 1, blk.clen, arc);
+  offset += blk.clen;
+  logbin_write(&index_buf, &blk, sizeof(blk));
+  logbin_write(&index_buf, blooms, bloom_len);
+  head.blocks++;
+  memset(&blk, 0, sizeof(blk));
+  memset(blooms, 0, bloom_len);
+}
+
+/**
+ * @brief add the items of a capture to the blocks, see logbin_read_cb
+ */
+static long archive(void                 *ctx,
+                    const uint8_t        *p,
+                    size_t               len,
+                    int                  eof,
+                    const logbin_block_t *b)
+{
+  size_t used = 0;
+
+  (void)ctx;
+  if (b && !fixed_hz && b->hz != hz) {
+    flush_block();
+    hz = b->hz;
+  }
+  while (used < len) {
+    logbin_item_t it;
+    logbin_site_t site;
+    uint64_t      key;
+    size_t        n = logbin_next(p + used, len - used, eof, &it);
+
+    if (it.kind == LOGBIN_MORE) {
+      break;
+    }
+    if (it.kind == LOGBIN_SYNCED) {
+      if (it.build_id != elf.build_id && !mismatch) {
+        fprintf(stderr, "logarc: build ID %016llx of the capture doesn't match "
+                "%016llx of the ELF file\n",
+                (unsigned long long)it.build_id, (unsigned long long)elf.build_id);
+        mismatch = 1;
+        if (!ignore_id) {
+          return -1;
+        }
+      }
+      /* A block has one rate, the sync record itself isn't kept */
+      if (!fixed_hz && it.hz != hz) {
+        flush_block();
+        hz = it.hz;
+      }
+      used += n;
+      continue;
+    }
+
+    if (it.kind == LOGBIN_BYTES) {
+      n = n < head.block_len - blk.len ? n : head.block_len - blk.len;
+      add_tokens((const char *)p + used, n);
+    } else if (blk.len + n > head.block_len) {
+      flush_block();
+    }
+    if (it.kind == LOGBIN_RECORD) {
+      if (!blk.records || it.ts < blk.ts_min) {
+        blk.ts_min = it.ts;
+      }
+      if (!blk.records || it.ts > blk.ts_max) {
+        blk.ts_max = it.ts;
+      }
+      blk.records++;
+      blk.levels[it.lvl]++;
+      n_records++;
+      key = it.site << 3 | it.lvl;
+      logbin_bloom_add(blooms, head.site_bits, &key, sizeof(key));
+      if (!logbin_site(&elf, it.site, &site)) {
+        msg.len = 0;
+        logbin_format(&msg, elf.word, site.fmt, it.args, it.args_len);
+        add_tokens(msg.p, msg.len);
+      }
+    }
+    memcpy(raw + blk.len, p + used, n);
+    blk.len += (uint32_t)n;
+    used    += n;
+    if (blk.len == head.block_len) {
+      flush_block();
+    }
+  }
+  return (long)used;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logarc [-b KiB] [-t bits] [-i] [-r hz] [-s] firmware.elf archive.lba "
+          "[capture...]\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  int i, stats = 0, ret = 0;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char *a = argv[i];
+
+    if (!strcmp(a, "-b") && i + 1 < argc) {
+      head.block_len = (uint32_t)atoi(argv[++i]) << 10;
+    } else if (!strcmp(a, "-t") && i + 1 < argc) {
+      head.token_bits = ((uint32_t)atoi(argv[++i]) + 63) & ~63u;
+    } else if (!strcmp(a, "-i")) {
+      ignore_id = 1;
+    } else if (!strcmp(a, "-r") && i + 1 < argc) {
+      fixed_hz = hz = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(a, "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (argc - i < 2) {
+    usage();
+  }
+  if (head.block_len < LOGBIN_FRAME_MAX || head.block_len > LOGBIN_BLOCK_MAX || !head.token_bits) {
+    fprintf(stderr, "logarc: block or filter size out of range\n");
+    return 2;
+  }
+  if (logbin_load(&elf, argv[i])) {
+    return 1;
+  }
+  raw    = malloc(head.block_len);
+  zip    = malloc(LOGBIN_LZ_BOUND(head.block_len));
+  blooms = calloc(1, (head.site_bits + head.token_bits) / 8);
+  arc    = fopen(argv[i + 1], "wb");
+  if (!raw || !zip || !blooms || !arc) {
+    perror(argv[i + 1]);
+    return 1;
+  }
+  head.build_id = elf.build_id;
+  offset        = sizeof(head);
+  fwrite(&head, 1, sizeof(head), arc);
+
+  if (argc - i == 2) {
+    ret = logbin_read(stdin, archive, NULL, &n_bytes) != 0;
+  }
+  for (int k = i + 2; k < argc && !ret; k++) {
+    FILE *in = fopen(argv[k], "rb");
+
+    if (!in) {
+      perror(argv[k]);
+      return 1;
+    }
+    ret = logbin_read(in, archive, NULL, &n_bytes) != 0;
+    fclose(in);
+  }
+  if (ret) {
+    fclose(arc);
+    remove(argv[i + 1]);
+    return ret;
+  }
+
+  /* The index follows the blocks, the header is written again to find it */
+  flush_block();
+  head.index = offset;
+  fwrite(index_buf.p, 1, index_buf.len, arc);
+  fseek(arc, 0, SEEK_SET);
+  fwrite(&head, 1, sizeof(head), arc);
+  if (fclose(arc)) {
+    perror(argv[i + 1]);
+    return 1;
+  }
+
+  if (stats) {
+    fprintf(stderr, "logarc: %llu bytes, %llu records in %u blocks, %llu bytes compressed, "
+            "%llu bytes of index\n",
+            (unsigned long long)n_bytes, (unsigned long long)n_records, head.blocks,
+            (unsigned long long)(offset - sizeof(head)), (unsigned long long)index_buf.len);
+  }
+  return 0;
+}
@@ -0,0 +1,1094 @@
+/*************************************************************************
+ *  @file logbin.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Host-side decoding of the binary records of BINARY_ON, see
+ *  logbin.h.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "logbin.h"
+#include "../logging_ctrl.h"
+
+/* Defines  *********************************************************** */
+#define SECTION                 "logging_fmt"
+#define RTT_SYMBOL              "_SEGGER_RTT"
+#define RTT_ID                  "SEGGER RTT"
+#define READ_LEN                (1u << 20)
+#define LZ_MIN_MATCH            4
+#define LZ_HASH_BITS            12
+
+/* Length modifiers */
+enum {
+  LEN_NONE,
+  LEN_HH,
+  LEN_H,
+  LEN_L,
+  LEN_LL,
+  LEN_J,
+  LEN_Z
+};
+
+/* Static Variables *************************************************** */
+static const char *const flags[] = {
+  "[\x1b[4;41mFTL\x1b[0m]",
+  "[\x1b[1;31mERR\x1b[0m]",
+  "[\x1b[4;45mWRN\x1b[0m]",
+  "[\x1b[4;46mIPM\x1b[0m]",
+  "[\x1b[1;33mDHL\x1b[0m]",
+  "[\x1b[1;32mDBG\x1b[0m]",
+  "[VER]",
+  "[???]"
+};
+static const char *const names[] = {
+  "[FTL]", "[ERR]", "[WRN]", "[IPM]", "[DHL]", "[DBG]", "[VER]", "[???]"
+};
+
+/* Static Functions *************************************************** */
+static uint64_t rd(const uint8_t *p,
+                   int           n)
+{
+  uint64_t v = 0;
+
+  while (n--) {
+    v = v << 8 | p[n];
+  }
+  return v;
+}
+
+/**
+ * @brief CRC-32 with the polynomial 0xEDB88320, as zlib computes it
+ */
+static uint32_t crc32(const uint8_t *p,
+                      size_t        len)
+{
+  uint32_t crc = 0xFFFFFFFF;
+
+  while (len--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) {
+      crc = crc & 1 ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+static void wr(uint8_t  *p,
+               uint64_t v,
+               int      n)
+{
+  while (n--) {
+    *p++ = (uint8_t)v;
+    v  >>= 8;
+  }
+}
+
+/**
+ * @brief take a CBOR unsigned integer
+ *
+ * @return 0 on success, -1 if it's not one or runs past end
+ */
+static int get_uint(const uint8_t **p,
+                    const uint8_t *end,
+                    uint64_t      *v)
+{
+  unsigned ai, n;
+
+  if (*p >= end || (**p >> 5) != 0) {
+    return -1;
+  }
+  ai = *(*p)++ & 0x1F;
+  if (ai < 24) {
+    *v = ai;
+    return 0;
+  }
+  if (ai > 27) {
+    return -1;
+  }
+  n = 1u << (ai - 24);
+  if ((size_t)(end - *p) < n) {
+    return -1;
+  }
+  for (*v = 0; n--; (*p)++) {
+    *v = *v << 8 | **p;
+  }
+  return 0;
+}
+
+/**
+ * @brief take the next packed parameter, a missing one reads as zero
+ */
+static uint64_t take(const uint8_t **p,
+                     const uint8_t *end,
+                     unsigned      n)
+{
+  uint64_t v;
+
+  if ((size_t)(end - *p) < n) {
+    *p = end;
+    return 0;
+  }
+  v   = rd(*p, (int)n);
+  *p += n;
+  return v;
+}
+
+/**
+ * @brief the section of an ELF file by name
+ *
+ * @return section header, NULL if not found
+ */
+static const uint8_t *find_section(const logbin_elf_t *e,
+                                   const char         *name)
+{
+  const uint8_t *elf  = e->elf;
+  int           wide  = e->word == 8;
+  uint64_t      shoff = wide ? rd(elf + 0x28, 8) : rd(elf + 0x20, 4);
+  unsigned      shentsize = (unsigned)rd(elf + (wide ? 0x3A : 0x2E), 2);
+  unsigned      shnum     = (unsigned)rd(elf + (wide ? 0x3C : 0x30), 2);
+  unsigned      shstrndx  = (unsigned)rd(elf + (wide ? 0x3E : 0x32), 2);
+  size_t        len       = strlen(name) + 1;
+
+  if (shstrndx >= shnum || shoff + (uint64_t)shnum * shentsize > e->elf_len) {
+    return NULL;
+  }
+  const uint8_t *shstr  = elf + shoff + (uint64_t)shstrndx * shentsize;
+  uint64_t      stroff  = wide ? rd(shstr + 0x18, 8) : rd(shstr + 0x10, 4);
+
+  for (unsigned i = 0; i < shnum; i++) {
+    const uint8_t *sh = elf + shoff + (uint64_t)i * shentsize;
+    uint64_t      n   = stroff + rd(sh, 4);
+
+    if (n + len <= e->elf_len && !memcmp(elf + n, name, len)) {
+      return sh;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief the address of a symbol from the symbol table of an ELF file
+ *
+ * @return address, 0 if not found
+ */
+static uint64_t find_symbol(const logbin_elf_t *e,
+                            const char         *name)
+{
+  const uint8_t *elf  = e->elf;
+  int           wide  = e->word == 8;
+  const uint8_t *symtab = find_section(e, ".symtab");
+  const uint8_t *strtab = find_section(e, ".strtab");
+  size_t        len     = strlen(name) + 1;
+
+  if (!symtab || !strtab) {
+    return 0;
+  }
+  uint64_t off    = wide ? rd(symtab + 0x18, 8) : rd(symtab + 0x10, 4);
+  uint64_t size   = wide ? rd(symtab + 0x20, 8) : rd(symtab + 0x14, 4);
+  uint64_t stroff = wide ? rd(strtab + 0x18, 8) : rd(strtab + 0x10, 4);
+  unsigned entsize = wide ? 24 : 16;
+
+  if (off + size > e->elf_len) {
+    return 0;
+  }
+  for (uint64_t i = 0; i + entsize <= size; i += entsize) {
+    const uint8_t *sym = elf + off + i;
+    uint64_t      n    = stroff + rd(sym, 4);
+
+    if (n + len <= e->elf_len && !memcmp(elf + n, name, len)) {
+      return wide ? rd(sym + 8, 8) : rd(sym + 4, 4);
+    }
+  }
+  return 0;
+}
+
+/* Public Functions *************************************************** */
+void logbin_write(logbin_out_t *o,
+                  const void   *p,
+                  size_t       n)
+{
+  if (o->len + n > o->cap) {
+    size_t cap = o->cap ? o->cap : 4096;
+
+    while (cap < o->len + n) {
+      cap *= 2;
+    }
+    o->p = realloc(o->p, cap);
+    if (!o->p) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    o->cap = cap;
+  }
+  memcpy(o->p + o->len, p, n);
+  o->len += n;
+}
+
+uint8_t logbin_crc8(const uint8_t *p,
+                    size_t        len)
+{
+  return lctrl_crc8(0, p, len);
+}
+
+const uint8_t *logbin_section(const logbin_elf_t *e,
+                              const char         *name,
+                              uint64_t           *len)
+{
+  const uint8_t *sh = find_section(e, name);
+  uint64_t      off;
+
+  if (!sh) {
+    return NULL;
+  }
+  off  = e->word == 8 ? rd(sh + 0x18, 8) : rd(sh + 0x10, 4);
+  *len = e->word == 8 ? rd(sh + 0x20, 8) : rd(sh + 0x14, 4);
+  return off + *len <= e->elf_len ? e->elf + off : NULL;
+}
+
+int logbin_open(logbin_elf_t *e,
+                const char   *path)
+{
+  FILE *f = fopen(path, "rb");
+  long size;
+
+  memset(e, 0, sizeof(*e));
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  e->elf = malloc(size > 0 ? (size_t)size : 1);
+  if (!e->elf || fread(e->elf, 1, (size_t)size, f) != (size_t)size) {
+    fprintf(stderr, "%s: read error\n", path);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  e->elf_len = (size_t)size;
+  if (size < 64 || memcmp(e->elf, "\x7f" "ELF", 4) || e->elf[5] != 1) {
+    fprintf(stderr, "%s: not a little endian ELF file\n", path);
+    return -1;
+  }
+  e->word     = e->elf[4] == 2 ? 8 : 4;
+  e->rtt_addr = find_symbol(e, RTT_SYMBOL);
+  return 0;
+}
+
+int logbin_load(logbin_elf_t *e,
+                const char   *path)
+{
+  if (logbin_open(e, path)) {
+    return -1;
+  }
+  e->fmt = (const char *)logbin_section(e, SECTION, &e->fmt_len);
+  if (!e->fmt) {
+    fprintf(stderr, "%s: no " SECTION " section, built without BINARY_ON?\n", path);
+    return -1;
+  }
+  e->build_id = 0xCBF29CE484222325ull;
+  for (uint64_t i = 0; i < e->fmt_len; i++) {
+    e->build_id = (e->build_id ^ (uint8_t)e->fmt[i]) * 0x100000001B3ull;
+  }
+  return 0;
+}
+
+size_t logbin_next(const uint8_t *p,
+                   size_t        len,
+                   int           eof,
+                   logbin_item_t *it)
+{
+  const uint8_t *q, *end;
+  size_t        n;
+
+  memset(it, 0, sizeof(*it));
+  if (!len) {
+    it->kind = LOGBIN_MORE;
+    return 0;
+  }
+  if (p[0] != LOGBIN_FRAME_START && p[0] != LOGBIN_KV_START) {
+    /* Bytes up to the next frame */
+    for (n = 1; n < len && p[n] != LOGBIN_FRAME_START && p[n] != LOGBIN_KV_START; n++) {
+    }
+    it->kind = LOGBIN_BYTES;
+    return n;
+  }
+
+  if (len < 2 || len < (size_t)p[1] + 3) {
+    it->kind = eof ? LOGBIN_BYTES : LOGBIN_MORE;
+    return eof ? 1 : 0;
+  }
+  n        = (size_t)p[1] + 3;
+  it->kind = LOGBIN_BYTES;
+  if (logbin_crc8(p + 1, n - 2) != p[n - 1]) {
+    return 1;
+  }
+  if (p[0] == LOGBIN_KV_START) {
+    return n;
+  }
+
+  q   = p + 2;
+  end = p + n - 1;
+  if (q >= end) {
+    return 1;
+  }
+  if (*q & LOGBIN_SYNC) {
+    if (end - q < 9) {
+      return 1;
+    }
+    it->build_id = rd(q + 1, 8);
+    q           += 9;
+    if (get_uint(&q, end, &it->hz)) {
+      return 1;
+    }
+    it->kind = LOGBIN_SYNCED;
+    return n;
+  }
+  it->lvl = *q & 0x07;
+  if ((*q++ & 0x08) ? get_uint(&q, end, &it->site) || get_uint(&q, end, &it->ts)
+      : get_uint(&q, end, &it->site)) {
+    return 1;
+  }
+  it->args     = q;
+  it->args_len = (size_t)(end - q);
+  it->kind     = LOGBIN_RECORD;
+  return n;
+}
+
+int logbin_site(const logbin_elf_t *e,
+                uint64_t           off,
+                logbin_site_t      *site)
+{
+  const char *s   = e->fmt + off;
+  const char *end = e->fmt + e->fmt_len;
+  const char **f[] = { &site->fmt, &site->file, &site->line };
+
+  if (off >= e->fmt_len) {
+    return -1;
+  }
+  for (int i = 0; i < 3; i++) {
+    const char *z = memchr(s, '\0', (size_t)(end - s));
+
+    if (!z || (i < 2 && z + 1 >= end)) {
+      return -1;
+    }
+    *f[i] = s;
+    s     = z + 1;
+  }
+  return 0;
+}
+
+uint64_t logbin_site_next(const logbin_elf_t *e,
+                          uint64_t           *off,
+                          logbin_site_t      *site)
+{
+  /* Descriptors may be padded with zeros for alignment */
+  while (*off < e->fmt_len && !e->fmt[*off]) {
+    (*off)++;
+  }
+  if (*off >= e->fmt_len || logbin_site(e, *off, site)) {
+    return 0;
+  }
+  return (uint64_t)(site->line + strlen(site->line) + 1 - e->fmt);
+}
+
+int logbin_read(FILE           *in,
+                logbin_read_cb cb,
+                void           *ctx,
+                uint64_t       *bytes)
+{
+  uint8_t        *buf = malloc(READ_LEN + LOGBIN_FRAME_MAX);
+  logbin_block_t b;
+  size_t         len, n;
+  long           used = 0;
+
+  if (!buf) {
+    return -1;
+  }
+  len     = fread(buf, 1, LOGBIN_BLOCK_HEAD, in);
+  *bytes += len;
+  if (len == LOGBIN_BLOCK_HEAD && !logbin_block_parse(buf, &b)) {
+    uint8_t *payload = NULL;
+
+    do {
+      payload = realloc(payload, b.len ? b.len : 1);
+      n       = payload ? fread(payload, 1, b.len, in) : 0;
+      *bytes += n;
+      used    = payload ? cb(ctx, payload, n, 1, &b) : -1;
+      len     = used < 0 ? 0 : fread(buf, 1, LOGBIN_BLOCK_HEAD, in);
+      *bytes += len;
+    } while (len == LOGBIN_BLOCK_HEAD && !logbin_block_parse(buf, &b));
+    free(payload);
+  } else {
+    do {
+      n       = fread(buf + len, 1, READ_LEN, in);
+      len    += n;
+      *bytes += n;
+      used    = cb(ctx, buf, len, n == 0, NULL);
+      if (used < 0) {
+        break;
+      }
+      memmove(buf, buf + used, len - (size_t)used);
+      len -= (size_t)used;
+    } while (n);
+  }
+  free(buf);
+  return used < 0 ? -1 : 0;
+}
+
+void logbin_format(logbin_out_t  *o,
+                   unsigned      word,
+                   const char    *fmt,
+                   const uint8_t *args,
+                   size_t        len)
+{
+  const uint8_t *a   = args;
+  const uint8_t *end = args + len;
+  char          buf[512];
+
+  while (*fmt) {
+    const char *lit = fmt;
+    char       spec[32], *sp = spec, conv;
+    int        width = 0, prec = -1, left = 0, length = LEN_NONE;
+    unsigned   size;
+    int        n;
+
+    while (*fmt && *fmt != '%') {
+      fmt++;
+    }
+    logbin_write(o, lit, (size_t)(fmt - lit));
+    if (!*fmt) {
+      break;
+    }
+    fmt++;
+
+    /* Flags */
+    *sp++ = '%';
+    while (*fmt && strchr("-+ #0", *fmt)) {
+      left |= *fmt == '-';
+      if (sp < spec + 8) {
+        *sp++ = *fmt;
+      }
+      fmt++;
+    }
+    /* Width and precision, from the parameters if '*' */
+    if (*fmt == '*') {
+      width = (int)(int32_t)take(&a, end, 4);
+      if (width < 0) {
+        left  = 1;
+        width = -width;
+      }
+      fmt++;
+    } else {
+      while (*fmt >= '0' && *fmt <= '9') {
+        width = width * 10 + (*fmt++ - '0');
+      }
+    }
+    if (*fmt == '.') {
+      fmt++;
+      if (*fmt == '*') {
+        prec = (int)(int32_t)take(&a, end, 4);
+        prec = prec < 0 ? -1 : prec;
+        fmt++;
+      } else {
+        prec = 0;
+        while (*fmt >= '0' && *fmt <= '9') {
+          prec = prec * 10 + (*fmt++ - '0');
+        }
+      }
+    }
+    if (left && !memchr(spec, '-', (size_t)(sp - spec))) {
+      *sp++ = '-';
+    }
+    /* Length modifier */
+    switch (*fmt) {
+      case 'h':
+        length = fmt[1] == 'h' ? (fmt++, LEN_HH) : LEN_H;
+        fmt++;
+        break;
+      case 'l':
+        length = fmt[1] == 'l' ? (fmt++, LEN_LL) : LEN_L;
+        fmt++;
+        break;
+      case 'j':
+        length = LEN_J;
+        fmt++;
+        break;
+      case 'z':
+      case 't':
+        length = LEN_Z;
+        fmt++;
+        break;
+      case 'L':
+        fmt++;
+        break;
+      default:
+        break;
+    }
+    conv = *fmt;
+    if (!conv) {
+      break;
+    }
+    fmt++;
+    sp += sprintf(sp, "%d", width);
+    if (prec >= 0) {
+      sp += sprintf(sp, ".%d", prec);
+    }
+
+    size = length == LEN_L || length == LEN_Z ? word : length >= LEN_LL ? 8 : 4;
+    n    = 0;
+    switch (conv) {
+      case 'd':
+      case 'i': {
+        uint64_t v = take(&a, end, size);
+        int64_t  s = size == 8 ? (int64_t)v : (int64_t)(int32_t)v;
+
+        s = length == LEN_HH ? (signed char)s : length == LEN_H ? (short)s : s;
+        strcpy(sp, "lld");
+        n = snprintf(buf, sizeof(buf), spec, (long long)s);
+        break;
+      }
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o': {
+        uint64_t v = take(&a, end, size);
+
+        v = length == LEN_HH ? (unsigned char)v : length == LEN_H ? (unsigned short)v : v;
+        sp[0] = 'l';
+        sp[1] = 'l';
+        sp[2] = conv;
+        sp[3] = '\0';
+        n = snprintf(buf, sizeof(buf), spec, (unsigned long long)v);
+        break;
+      }
+      case 'c':
+        strcpy(sp, "c");
+        n = snprintf(buf, sizeof(buf), spec, (int)(char)take(&a, end, 4));
+        break;
+      case 'p': {
+        /* Always with the "0x" prefix, padded with spaces */
+        char hex[24];
+        int  pad;
+
+        snprintf(hex, sizeof(hex), "0x%llx", (unsigned long long)take(&a, end, word));
+        pad = width - (int)strlen(hex);
+        n   = snprintf(buf, sizeof(buf), "%*s%s%*s", left ? 0 : pad > 0 ? pad : 0, "",
+                       hex, left && pad > 0 ? pad : 0, "");
+        break;
+      }
+      case 's': {
+        /* Length prefixed, the precision is applied on the target */
+        unsigned l = (unsigned)take(&a, end, 1);
+
+        l = (unsigned)((size_t)(end - a) < l ? (size_t)(end - a) : l);
+        n = snprintf(buf, sizeof(buf), left ? "%-*.*s" : "%*.*s", width, (int)l, (const char *)a);
+        a += l;
+        break;
+      }
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        uint64_t v = take(&a, end, 8);
+        double   d;
+
+        memcpy(&d, &v, sizeof(d));
+        sp[0] = conv;
+        sp[1] = '\0';
+        n = snprintf(buf, sizeof(buf), spec, d);
+        break;
+      }
+      case 'n':
+        break;
+      case '%':
+        buf[0] = '%';
+        n      = 1;
+        break;
+      default:
+        buf[0] = '%';
+        buf[1] = conv;
+        n      = 2;
+        break;
+    }
+    logbin_write(o, buf, n < 0 ? 0 : n < (int)sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+  }
+}
+
+int logbin_render_head(logbin_out_t         *o,
+                       const logbin_elf_t   *e,
+                       const logbin_style_t *st,
+                       const logbin_item_t  *it,
+                       logbin_site_t        *site)
+{
+  char hdr[96];
+  int  n;
+
+  if (st->hz) {
+    uint64_t s = it->ts / st->hz;
+    uint64_t u = (it->ts % st->hz) * 1000000 / st->hz;
+
+    n = snprintf(hdr, sizeof(hdr), "[RT-%llu:%02u:%02u:%02u.%06u]",
+                 (unsigned long long)(s / 86400), (unsigned)(s % 86400 / 3600),
+                 (unsigned)(s % 3600 / 60), (unsigned)(s % 60), (unsigned)u);
+  } else {
+    n = snprintf(hdr, sizeof(hdr), "[@%llu]", (unsigned long long)it->ts);
+  }
+  logbin_write(o, hdr, (size_t)n);
+
+  if (logbin_site(e, it->site, site)) {
+    n = snprintf(hdr, sizeof(hdr), "[%*s]", (int)st->name_width + 6, "?");
+    logbin_write(o, hdr, (size_t)n);
+    logbin_write(o, st->color ? flags[it->lvl] : names[it->lvl],
+                 strlen(st->color ? flags[it->lvl] : names[it->lvl]));
+    n = snprintf(hdr, sizeof(hdr), ": <unknown call site 0x%llx>\n",
+                 (unsigned long long)it->site);
+    logbin_write(o, hdr, (size_t)n);
+    return -1;
+  }
+
+  /* Module name, the file name without path and extension */
+  const char *stem = site->file, *c;
+  size_t     len;
+
+  for (c = site->file; *c; c++) {
+    if (*c == '/' || *c == '\\') {
+      stem = c + 1;
+    }
+  }
+  len = strcspn(stem, ".");
+  len = len < st->name_width ? len : st->name_width;
+  n   = snprintf(hdr, sizeof(hdr), "[%*.*s:%-5s]", (int)st->name_width, (int)len, stem, site->line);
+  logbin_write(o, hdr, (size_t)n);
+  logbin_write(o, st->color ? flags[it->lvl] : names[it->lvl],
+               strlen(st->color ? flags[it->lvl] : names[it->lvl]));
+  logbin_write(o, ": ", 2);
+  return 0;
+}
+
+void logbin_render(logbin_out_t         *o,
+                   const logbin_elf_t   *e,
+                   const logbin_style_t *st,
+                   const logbin_item_t  *it)
+{
+  logbin_site_t site;
+
+  if (!logbin_render_head(o, e, st, it, &site)) {
+    logbin_format(o, e->word, site.fmt, it->args, it->args_len);
+  }
+}
+
+long logbin_rtt_ring(const logbin_elf_t *e,
+                     const uint8_t      *dump,
+                     size_t             len,
+                     uint64_t           base,
+                     unsigned           channel,
+                     uint8_t            **ring,
+                     int                *wrapped)
+{
+  const uint8_t *cb = NULL, *up;
+  unsigned      w   = e->word;
+  uint64_t      buf, size, wr;
+  size_t        n;
+
+  *ring    = NULL;
+  *wrapped = 0;
+  for (size_t i = 0; i + sizeof(RTT_ID) <= len; i++) {
+    if (!memcmp(dump + i, RTT_ID, sizeof(RTT_ID))) {
+      cb = dump + i;
+      break;
+    }
+  }
+  if (!cb) {
+    fprintf(stderr, "no RTT control block in the dump\n");
+    return -1;
+  }
+  if (!base) {
+    if (!e->rtt_addr) {
+      fprintf(stderr, "no " RTT_SYMBOL " in the ELF file, give the dump address\n");
+      return -1;
+    }
+    base = e->rtt_addr - (uint64_t)(cb - dump);
+  }
+
+  /* acID[16], MaxNumUpBuffers, MaxNumDownBuffers, aUp[] */
+  up = cb + 24 + (size_t)channel * (2 * w + 16);
+  if (up + 2 * w + 16 > dump + len || channel >= rd(cb + 16, 4)) {
+    fprintf(stderr, "no up-buffer %u in the RTT control block\n", channel);
+    return -1;
+  }
+  buf  = rd(up + w, (int)w);
+  size = rd(up + 2 * w, 4);
+  wr   = rd(up + 2 * w + 4, 4);
+  if (buf < base || buf - base + size > len || wr >= size) {
+    fprintf(stderr, "up-buffer %u at 0x%llx is outside the dump\n",
+            channel, (unsigned long long)buf);
+    return -1;
+  }
+  *ring = malloc(size ? (size_t)size : 1);
+  if (!*ring) {
+    return -1;
+  }
+
+  /* Wrapped if anything was written after the write offset */
+  const uint8_t *b = dump + (buf - base);
+
+  for (n = (size_t)wr; n < size && !b[n]; n++) {
+  }
+  if (n < size) {
+    *wrapped = 1;
+    memcpy(*ring, b + wr, (size_t)(size - wr));
+    memcpy(*ring + (size - wr), b, (size_t)wr);
+    return (long)size;
+  }
+  memcpy(*ring, b, (size_t)wr);
+  return (long)wr;
+}
+
+void logbin_block_head(uint8_t              *p,
+                       const logbin_block_t *b)
+{
+  memcpy(p, LOGBIN_BLOCK_MARK, LOGBIN_BLOCK_MARK_LEN);
+  wr(p + 8, LOGBIN_BLOCK_HEAD, 4);
+  wr(p + 12, b->len, 4);
+  wr(p + 16, b->build_id, 8);
+  wr(p + 24, b->hz, 8);
+  wr(p + 32, b->ts, 8);
+  wr(p + 40, b->records, 4);
+  wr(p + 44, crc32(p, 44), 4);
+}
+
+int logbin_block_parse(const uint8_t  *p,
+                       logbin_block_t *b)
+{
+  if (memcmp(p, LOGBIN_BLOCK_MARK, LOGBIN_BLOCK_MARK_LEN)
+      || rd(p + 8, 4) != LOGBIN_BLOCK_HEAD
+      || rd(p + 44, 4) != crc32(p, 44)
+      || rd(p + 12, 4) > LOGBIN_BLOCK_MAX) {
+    return -1;
+  }
+  b->len      = (uint32_t)rd(p + 12, 4);
+  b->build_id = rd(p + 16, 8);
+  b->hz       = rd(p + 24, 8);
+  b->ts       = rd(p + 32, 8);
+  b->records  = (uint32_t)rd(p + 40, 4);
+  return 0;
+}
+
+/**
+ * @brief write a literal run and a back reference, without one if off is 0
+ */
+static uint8_t *lz_sequence(uint8_t       *op,
+                            const uint8_t *lit,
+                            size_t        lit_len,
+                            size_t        off,
+                            size_t        match_len)
+{
+  uint8_t *token = op++;
+  size_t  n;
+
+  n      = match_len - (off ? LZ_MIN_MATCH : 0);
+  *token = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4 | (n < 15 ? n : 15));
+  if (lit_len >= 15) {
+    for (n = lit_len - 15; n >= 255; n -= 255) {
+      *op++ = 255;
+    }
+    *op++ = (uint8_t)n;
+  }
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if (!off) {
+    return op;
+  }
+  *op++ = (uint8_t)off;
+  *op++ = (uint8_t)(off >> 8);
+  if (match_len - LZ_MIN_MATCH >= 15) {
+    for (n = match_len - LZ_MIN_MATCH - 15; n >= 255; n -= 255) {
+      *op++ = 255;
+    }
+    *op++ = (uint8_t)n;
+  }
+  return op;
+}
+
+size_t logbin_lz_compress(uint8_t       *dst,
+                          const uint8_t *src,
+                          size_t        len)
+{
+  static uint32_t table[1u << LZ_HASH_BITS];
+  const uint8_t   *ip = src, *anchor = src, *end = src + len;
+  uint8_t         *op = dst;
+
+  /* Positions plus one, 0 is empty */
+  memset(table, 0, sizeof(table));
+  while (len >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+    uint32_t      seq = (uint32_t)rd(ip, 4);
+    uint32_t      h   = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+    const uint8_t *ref = table[h] ? src + table[h] - 1 : NULL;
+    size_t        n;
+
+    table[h] = (uint32_t)(ip - src + 1);
+    if (!ref || ip - ref > 0xFFFF || (uint32_t)rd(ref, 4) != seq) {
+      ip++;
+      continue;
+    }
+    for (n = LZ_MIN_MATCH; ip + n < end && ip[n] == ref[n]; n++) {
+    }
+    op     = lz_sequence(op, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), n);
+    ip    += n;
+    anchor = ip;
+  }
+  if (anchor < end) {
+    op = lz_sequence(op, anchor, (size_t)(end - anchor), 0, 0);
+  }
+  return (size_t)(op - dst);
+}
+
+long logbin_lz_decompress(uint8_t       *dst,
+                          size_t        cap,
+                          const uint8_t *src,
+                          size_t        len)
+{
+  return logbin_lz_stream(dst, 0, cap, src, len);
+}
+
+long logbin_lz_stream(uint8_t       *dst,
+                      size_t        pos,
+                      size_t        cap,
+                      const uint8_t *src,
+                      size_t        len)
+{
+  const uint8_t *ip = src, *end = src + len;
+  uint8_t       *op = dst + pos;
+
+  if (pos > cap) {
+    return -1;
+  }
+  while (ip < end) {
+    size_t token = *ip++;
+    size_t n     = token >> 4, off;
+
+    if (n == 15) {
+      do {
+        if (ip >= end) {
+          return -1;
+        }
+        n += *ip;
+      } while (*ip++ == 255);
+    }
+    if ((size_t)(end - ip) < n || (size_t)(dst + cap - op) < n) {
+      return -1;
+    }
+    memcpy(op, ip, n);
+    op += n;
+    ip += n;
+    if (ip == end) {
+      break;
+    }
+
+    /* Back reference, may overlap what it produces */
+    if (end - ip < 2) {
+      return -1;
+    }
+    off = (size_t)rd(ip, 2);
+    ip += 2;
+    n   = (token & 15) + LZ_MIN_MATCH;
+    if ((token & 15) == 15) {
+      do {
+        if (ip >= end) {
+          return -1;
+        }
+        n += *ip;
+      } while (*ip++ == 255);
+    }
+    if (!off || off > (size_t)(op - dst) || (size_t)(dst + cap - op) < n) {
+      return -1;
+    }
+    for (const uint8_t *ref = op - off; n--; ) {
+      *op++ = *ref++;
+    }
+  }
+  return (long)(op - dst - pos);
+}
+
+/**
+ * @brief parse a length of a compressed frame head, unsigned LEB128 of 2
+ * bytes at most
+ *
+ * @return bytes of the length, 0 if more are needed, -1 if invalid
+ */
+static int lz_len(const uint8_t *p,
+                  size_t        len,
+                  size_t        *v)
+{
+  if (len < 1 || (p[0] & 0x80 && len < 2)) {
+    return 0;
+  }
+  if (!(p[0] & 0x80)) {
+    *v = p[0];
+    return 1;
+  }
+  *v = (size_t)(p[0] & 0x7F) | (size_t)p[1] << 7;
+  return p[1] & 0x80 ? -1 : 2;
+}
+
+size_t logbin_unz(logbin_unz_t  *z,
+                  const uint8_t *p,
+                  size_t        len,
+                  int           eof,
+                  logbin_out_t  *o)
+{
+  static const char lost[] = "--- compressed frames lost ---\n";
+  size_t            used   = 0;
+
+  while (used < len) {
+    const uint8_t *f = p + used, *c;
+    size_t        left = len - used, raw = 0, clen = 0, n;
+    int           a, b, restart;
+    long          got;
+
+    if (f[0] != LOGBIN_LZ_START) {
+      c        = memchr(f, LOGBIN_LZ_START, left);
+      n        = c ? (size_t)(c - f) : left;
+      z->junk += n;
+      used    += n;
+      continue;
+    }
+
+    /* Start byte, flags, the two lengths, the payload and the CRC */
+    a = left < 2 ? 0 : lz_len(f + 2, left - 2, &raw);
+    b = a <= 0 ? a : lz_len(f + 2 + a, left - 2 - a, &clen);
+    if (!b && !eof) {
+      break;
+    }
+    if (b <= 0 || !raw || raw > LOGBIN_LZ_RAW_MAX || clen > LOGBIN_LZ_BOUND(raw)) {
+      z->junk++;
+      used++;
+      continue;
+    }
+    n = 2 + a + b + clen + 1;
+    if (left < n) {
+      if (!eof) {
+        break;
+      }
+      z->junk++;
+      used++;
+      continue;
+    }
+    if (logbin_crc8(f + 1, n - 2) != f[n - 1]) {
+      z->junk++;
+      used++;
+      continue;
+    }
+    used += n;
+
+    /* A restart drops the history, any other frame must follow the last one */
+    restart = f[1] & LOGBIN_LZ_RESTART;
+    if (z->synced && (f[1] & 0x7F) != z->seq) {
+      z->lost  += (f[1] - z->seq) & 0x7F;
+      z->synced = 0;
+      logbin_write(o, lost, sizeof(lost) - 1);
+    }
+    z->seq = (f[1] + 1) & 0x7F;
+    if (restart) {
+      z->synced = 1;
+      z->len    = 0;
+    }
+    if (!z->synced) {
+      z->skipped++;
+      continue;
+    }
+    if (z->len + raw > sizeof(z->hist)) {
+      memmove(z->hist, z->hist + z->len - LOGBIN_LZ_WINDOW, LOGBIN_LZ_WINDOW);
+      z->len = LOGBIN_LZ_WINDOW;
+    }
+    got = logbin_lz_stream(z->hist, z->len, z->len + raw, f + 2 + a + b, clen);
+    if (got != (long)raw) {
+      z->junk  += n;
+      z->synced = 0;
+      logbin_write(o, lost, sizeof(lost) - 1);
+      continue;
+    }
+    logbin_write(o, z->hist + z->len, raw);
+    z->len += raw;
+    z->frames++;
+  }
+  return used;
+}
+
+size_t logbin_token(const char **s,
+                    const char *end,
+                    char       *tok)
+{
+  const char *p = *s;
+  size_t     n  = 0;
+
+  while (p < end && !isalnum((unsigned char)*p) && *p != '_') {
+    p++;
+  }
+  for (; p < end && (isalnum((unsigned char)*p) || *p == '_'); p++) {
+    if (n < LOGBIN_TOKEN_MAX) {
+      tok[n++] = (char)tolower((unsigned char)*p);
+    }
+  }
+  *s = p;
+  return n;
+}
+
+/**
+ * @brief the bits of a key in a bloom filter, by double hashing the two
+ * halves of its FNV-1a hash
+ */
+static void bloom_bits(unsigned   nbits,
+                       const void *key,
+                       size_t     len,
+                       uint32_t   *bit)
+{
+  const uint8_t *k = key;
+  uint64_t      h  = 0xCBF29CE484222325ull;
+
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ k[i]) * 0x100000001B3ull;
+  }
+  for (uint32_t i = 0; i < LOGBIN_BLOOM_K; i++) {
+    bit[i] = (uint32_t)((h + i * (h >> 32 | 1)) % nbits);
+  }
+}
+
+void logbin_bloom_add(uint8_t    *bits,
+                      unsigned   nbits,
+                      const void *key,
+                      size_t     len)
+{
+  uint32_t bit[LOGBIN_BLOOM_K];
+
+  bloom_bits(nbits, key, len, bit);
+  for (int i = 0; i < LOGBIN_BLOOM_K; i++) {
+    bits[bit[i] >> 3] |= (uint8_t)(1u << (bit[i] & 7));
+  }
+}
+
+int logbin_bloom_test(const uint8_t *bits,
+                      unsigned      nbits,
+                      const void    *key,
+                      size_t        len)
+{
+  uint32_t bit[LOGBIN_BLOOM_K];
+
+  bloom_bits(nbits, key, len, bit);
+  for (int i = 0; i < LOGBIN_BLOOM_K; i++) {
+    if (!(bits[bit[i] >> 3] & (1u << (bit[i] & 7)))) {
+      return 0;
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,504 @@
+/*************************************************************************
+ *  @file logbin.h
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Host-side decoding of the binary records of BINARY_ON, shared by
+ *  the host tools: the call site descriptors and the build ID are read from
+ *  the ELF file of the firmware, a capture is split into records and the
+ *  bytes passed through, and the records are formatted as the text the
+ *  device emits without BINARY_ON. Little endian targets only.
+ ************************************************************************/
+
+#ifndef LOGBIN_H
+#define LOGBIN_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Defines  *********************************************************** */
+#define LOGBIN_FRAME_START      0x1C /**< Starts a binary record frame */
+#define LOGBIN_KV_START         0x1D /**< Starts a key/value frame */
+#define LOGBIN_SYNC             0x80 /**< Flags a sync record */
+#define LOGBIN_FRAME_MAX        (1 + 1 + 255 + 1)
+#define LOGBIN_BLOCK_MARK       "\xA5" "LOGBLK" "\x5A" /**< Starts a block of a block capture */
+#define LOGBIN_BLOCK_MARK_LEN   8
+#define LOGBIN_BLOCK_HEAD       48   /**< Size of a block header */
+#define LOGBIN_BLOCK_MAX        (64u << 20) /**< Largest payload of a block */
+#define LOGBIN_LZ_BOUND(n)      ((n) + (n) / 255 + 16) /**< Compressed size of n bytes at most */
+#define LOGBIN_ARC_MAGIC        "LOGARC1" /**< Starts an archive, with its terminating zero */
+#define LOGBIN_LEVELS           8
+#define LOGBIN_BLOOM_K          4    /**< Bits set per key in the bloom filters */
+#define LOGBIN_TOKEN_MAX        64   /**< Longer tokens are cut to this */
+#define LOGBIN_LZ_START         0x1A /**< Starts a compressed frame of COMPRESS_ON */
+#define LOGBIN_LZ_RESTART       0x80 /**< Flags a compressed frame dropping the history */
+#define LOGBIN_LZ_WINDOW        16384 /**< Largest COMPRESS_WINDOW */
+#define LOGBIN_LZ_RAW_MAX       (LOGBIN_LZ_WINDOW / 2) /**< Largest frame before compression */
+
+/* Kinds of the items a capture is split into */
+enum {
+  LOGBIN_MORE,                       /**< Incomplete, more bytes are needed */
+  LOGBIN_BYTES,                      /**< Bytes to pass through */
+  LOGBIN_RECORD,                     /**< Binary record */
+  LOGBIN_SYNCED                      /**< Sync record */
+};
+
+/**
+ * @brief firmware the records are decoded with
+ */
+typedef struct {
+  uint8_t        *elf;               /**< Contents of the ELF file */
+  size_t         elf_len;            /**< Size of the ELF file */
+  const char     *fmt;               /**< Contents of the logging_fmt section */
+  uint64_t       fmt_len;            /**< Size of the logging_fmt section */
+  uint64_t       build_id;           /**< FNV-1a hash of the logging_fmt section */
+  unsigned       word;               /**< Size of long, size_t and pointers on the target */
+  uint64_t       rtt_addr;           /**< Address of _SEGGER_RTT, 0 if not found */
+}logbin_elf_t;
+
+/**
+ * @brief decompressor of the frames of COMPRESS_ON, see logbin_unz(), zeroed
+ * before the first frame
+ */
+typedef struct {
+  uint8_t        hist[2 * LOGBIN_LZ_WINDOW]; /**< History followed by the frame being decompressed */
+  size_t         len;                /**< Bytes of history */
+  int            synced;             /**< Non-zero if the history is the one of the device */
+  uint8_t        seq;                /**< Sequence number of the next frame */
+  uint64_t       frames;             /**< Frames decompressed */
+  uint64_t       lost;               /**< Frames lost, by their sequence numbers */
+  uint64_t       skipped;            /**< Frames skipped while waiting for a restart */
+  uint64_t       junk;               /**< Bytes outside of the frames or of corrupt frames */
+}logbin_unz_t;
+
+/**
+ * @brief item of a capture, see logbin_next()
+ */
+typedef struct {
+  int            kind;               /**< LOGBIN_xxx kind */
+  uint8_t        lvl;                /**< Level of a record */
+  uint64_t       site;               /**< Descriptor offset of a record */
+  uint64_t       ts;                 /**< Timestamp of a record, 0 if none */
+  const uint8_t  *args;              /**< Packed parameters of a record */
+  size_t         args_len;           /**< Bytes of packed parameters */
+  uint64_t       build_id;           /**< Build ID of a sync record */
+  uint64_t       hz;                 /**< Timestamp ticks per second of a sync record */
+}logbin_item_t;
+
+/**
+ * @brief call site descriptor
+ */
+typedef struct {
+  const char     *fmt;               /**< Format string */
+  const char     *file;              /**< File name as given to the compiler */
+  const char     *line;              /**< Line */
+}logbin_site_t;
+
+/**
+ * @brief growing output buffer
+ */
+typedef struct {
+  char           *p;                 /**< Contents */
+  size_t         len;                /**< Bytes used */
+  size_t         cap;                /**< Bytes allocated */
+}logbin_out_t;
+
+/**
+ * @brief rendering options
+ */
+typedef struct {
+  int            color;              /**< Non-zero for the colored level flags */
+  unsigned       name_width;         /**< Width of the file name, FILE_NAME_LENGTH */
+  uint64_t       hz;                 /**< Timestamp ticks per second, 0 to show the ticks */
+}logbin_style_t;
+
+/**
+ * @brief header of a block of a block capture, see logbin_block_head(). The
+ * payload is the capture bytes, cut on item boundaries, so a block decodes
+ * without the ones before it.
+ */
+typedef struct {
+  uint64_t       build_id;           /**< Build ID of the records, 0 if no sync record was seen */
+  uint64_t       hz;                 /**< Timestamp ticks per second, 0 if not known */
+  uint64_t       ts;                 /**< Timestamp of the first record, 0 if none */
+  uint32_t       records;            /**< Number of records */
+  uint32_t       len;                /**< Bytes of the payload following the header */
+}logbin_block_t;
+
+/**
+ * @brief header of an archive, followed by the compressed blocks and the
+ * block index. Archives are read by mapping them, so they are in the byte
+ * order of the host which wrote them.
+ */
+typedef struct {
+  char           magic[8];           /**< LOGBIN_ARC_MAGIC */
+  uint64_t       build_id;           /**< Build ID of the records */
+  uint64_t       index;              /**< Offset of the block index */
+  uint32_t       blocks;             /**< Number of blocks */
+  uint32_t       block_len;          /**< Size of the blocks before compression, at most */
+  uint32_t       site_bits;          /**< Bits of a call site bloom filter, multiple of 64 */
+  uint32_t       token_bits;         /**< Bits of a token bloom filter, multiple of 64 */
+  uint32_t       reserved[6];
+}logbin_arc_head_t;
+
+/**
+ * @brief entry of the block index of an archive, followed by the call site
+ * bloom filter and the token bloom filter of the block
+ */
+typedef struct {
+  uint64_t       offset;             /**< Offset of the compressed block */
+  uint64_t       ts_min;             /**< Lowest record timestamp */
+  uint64_t       ts_max;             /**< Highest record timestamp */
+  uint64_t       hz;                 /**< Timestamp ticks per second, 0 if not known */
+  uint32_t       clen;               /**< Size of the compressed block */
+  uint32_t       len;                /**< Size of the block */
+  uint32_t       records;            /**< Number of records */
+  uint32_t       levels[LOGBIN_LEVELS]; /**< Number of records per level */
+  uint32_t       reserved;
+}logbin_arc_block_t;
+
+/**
+ * @brief logbin_open read an ELF file, its word size and the address of the
+ * RTT control block, without looking for the call site descriptors
+ *
+ * @param e - firmware to fill
+ * @param path - ELF file
+ *
+ * @return 0 on success, -1 otherwise with the reason on stderr
+ */
+int logbin_open(logbin_elf_t *e,
+                const char   *path);
+
+/**
+ * @brief logbin_load read the call site descriptors, the word size and the
+ * address of the RTT control block from an ELF file, see logbin_open()
+ *
+ * @param e - firmware to fill
+ * @param path - ELF file
+ *
+ * @return 0 on success, -1 otherwise with the reason on stderr
+ */
+int logbin_load(logbin_elf_t *e,
+                const char   *path);
+
+/**
+ * @brief logbin_section find a section of an ELF file by name
+ *
+ * @param e - firmware from logbin_open()
+ * @param name - section name
+ * @param len - set to the size of the section
+ *
+ * @return contents of the section, NULL if not found or not within the file
+ */
+const uint8_t *logbin_section(const logbin_elf_t *e,
+                              const char         *name,
+                              uint64_t           *len);
+
+/**
+ * @brief logbin_crc8 CRC-8 of the frames, as the device computes it with
+ * lctrl_crc8()
+ *
+ * @param p - bytes
+ * @param len - number of bytes
+ *
+ * @return crc value
+ */
+uint8_t logbin_crc8(const uint8_t *p,
+                    size_t        len);
+
+/**
+ * @brief logbin_next take the next item of a capture. A frame which fails its
+ * CRC is taken as bytes, one at a time, until the next frame is found, so the
+ * decoding resynchronizes after lost or corrupt bytes.
+ *
+ * @param p - capture bytes
+ * @param len - number of bytes
+ * @param eof - non-zero if no more bytes follow, an incomplete frame is then
+ * passed through instead of LOGBIN_MORE
+ * @param it - item found
+ *
+ * @return bytes of the item, 0 if kind is LOGBIN_MORE
+ */
+size_t logbin_next(const uint8_t *p,
+                   size_t        len,
+                   int           eof,
+                   logbin_item_t *it);
+
+/**
+ * @brief logbin_site look up a call site descriptor
+ *
+ * @param e - firmware
+ * @param off - descriptor offset
+ * @param site - descriptor found
+ *
+ * @return 0 on success, -1 if the offset isn't a descriptor
+ */
+int logbin_site(const logbin_elf_t *e,
+                uint64_t           off,
+                logbin_site_t      *site);
+
+/**
+ * @brief logbin_site_next find the first call site descriptor at or after an
+ * offset, the descriptors are walked with it from offset 0
+ *
+ * @param e - firmware
+ * @param off - offset, set to the one of the descriptor found
+ * @param site - descriptor found
+ *
+ * @return offset after the descriptor, 0 if there is none
+ */
+uint64_t logbin_site_next(const logbin_elf_t *e,
+                          uint64_t           *off,
+                          logbin_site_t      *site);
+
+/**
+ * @brief callback of logbin_read()
+ *
+ * @param ctx - as given to logbin_read()
+ * @param p - capture bytes
+ * @param len - number of bytes
+ * @param eof - non-zero if no more bytes follow
+ * @param b - header of the block the bytes are the payload of, NULL for a
+ * raw capture
+ *
+ * @return bytes taken, the rest is given again with more bytes, -1 to stop
+ */
+typedef long (*logbin_read_cb)(void                 *ctx,
+                               const uint8_t        *p,
+                               size_t               len,
+                               int                  eof,
+                               const logbin_block_t *b);
+
+/**
+ * @brief logbin_read feed a capture to a callback: a raw capture in pieces of
+ * a MiB, the incomplete frame at the end of one given again with the next, a
+ * block capture written by logpack a whole block at a time
+ *
+ * @param in - capture
+ * @param cb - callback
+ * @param ctx - passed to the callback
+ * @param bytes - incremented by the bytes read
+ *
+ * @return 0 on success, -1 if the callback stopped
+ */
+int logbin_read(FILE           *in,
+                logbin_read_cb cb,
+                void           *ctx,
+                uint64_t       *bytes);
+
+/**
+ * @brief logbin_format format a message from the parameters packed on the
+ * target, as lfmt_unpack() does
+ *
+ * @param o - output
+ * @param word - size of long, size_t and pointers on the target
+ * @param fmt - format string
+ * @param args - packed parameters
+ * @param len - bytes of packed parameters
+ */
+void logbin_format(logbin_out_t  *o,
+                   unsigned      word,
+                   const char    *fmt,
+                   const uint8_t *args,
+                   size_t        len);
+
+/**
+ * @brief logbin_render render a record as the text the device emits without
+ * BINARY_ON, "[RT-d:hh:mm:ss.uuuuuu][      file:line ][FLG]: message"
+ *
+ * @param o - output
+ * @param e - firmware
+ * @param st - rendering options
+ * @param it - record
+ */
+void logbin_render(logbin_out_t         *o,
+                   const logbin_elf_t   *e,
+                   const logbin_style_t *st,
+                   const logbin_item_t  *it);
+
+/**
+ * @brief logbin_render_head render a record up to its message, so a message
+ * formatted already, e.g. to be filtered, is not formatted again
+ *
+ * @param o - output
+ * @param e - firmware
+ * @param st - rendering options
+ * @param it - record
+ * @param site - set to the call site descriptor
+ *
+ * @return 0 if the message is to follow, -1 if the call site is unknown and
+ * the record is rendered whole
+ */
+int logbin_render_head(logbin_out_t         *o,
+                       const logbin_elf_t   *e,
+                       const logbin_style_t *st,
+                       const logbin_item_t  *it,
+                       logbin_site_t        *site);
+
+/**
+ * @brief logbin_rtt_ring extract the contents of an RTT up-buffer from a
+ * memory dump of the target, oldest bytes first
+ *
+ * @param e - firmware, for the word size and the address of _SEGGER_RTT
+ * @param dump - memory dump
+ * @param len - size of the dump
+ * @param base - address of the first byte of the dump, 0 to derive it from
+ * the address of _SEGGER_RTT and its position in the dump
+ * @param channel - up-buffer
+ * @param ring - set to the bytes, allocated, NULL on failure
+ * @param wrapped - set to non-zero if the buffer has wrapped around, the
+ * oldest record is then cut short
+ *
+ * @return number of bytes, -1 with the reason on stderr on failure
+ */
+long logbin_rtt_ring(const logbin_elf_t *e,
+                     const uint8_t      *dump,
+                     size_t             len,
+                     uint64_t           base,
+                     unsigned           channel,
+                     uint8_t            **ring,
+                     int                *wrapped);
+
+/**
+ * @brief logbin_block_head encode a block header, little endian: the marker,
+ * the header length, the payload length, the build ID, the rate, the first
+ * timestamp, the record count and a CRC-32 of the bytes before it
+ *
+ * @param p - LOGBIN_BLOCK_HEAD bytes to fill
+ * @param b - header
+ */
+void logbin_block_head(uint8_t              *p,
+                       const logbin_block_t *b);
+
+/**
+ * @brief logbin_block_parse decode a block header
+ *
+ * @param p - LOGBIN_BLOCK_HEAD bytes
+ * @param b - header found
+ *
+ * @return 0 on success, -1 if the bytes aren't a valid header
+ */
+int logbin_block_parse(const uint8_t  *p,
+                       logbin_block_t *b);
+
+/**
+ * @brief logbin_lz_compress compress bytes as a sequence of literal runs and
+ * back references of up to 65535 bytes, in the LZ4 block layout
+ *
+ * @param dst - LOGBIN_LZ_BOUND(len) bytes at least
+ * @param src - bytes
+ * @param len - number of bytes
+ *
+ * @return compressed size
+ */
+size_t logbin_lz_compress(uint8_t       *dst,
+                          const uint8_t *src,
+                          size_t        len);
+
+/**
+ * @brief logbin_lz_decompress decompress what logbin_lz_compress() gives,
+ * or a device compresses with a smaller window
+ *
+ * @param dst - output
+ * @param cap - size of the output
+ * @param src - compressed bytes
+ * @param len - number of compressed bytes
+ *
+ * @return decompressed size, -1 if corrupt or larger than cap
+ */
+long logbin_lz_decompress(uint8_t       *dst,
+                          size_t        cap,
+                          const uint8_t *src,
+                          size_t        len);
+
+/**
+ * @brief logbin_lz_stream decompress a frame of a stream, its back references
+ * may reach into the frames decompressed before it
+ *
+ * @param dst - output, the frames before first
+ * @param pos - bytes of the frames before
+ * @param cap - size of the output
+ * @param src - compressed bytes
+ * @param len - number of compressed bytes
+ *
+ * @return decompressed size, -1 if corrupt or larger than cap - pos
+ */
+long logbin_lz_stream(uint8_t       *dst,
+                      size_t        pos,
+                      size_t        cap,
+                      const uint8_t *src,
+                      size_t        len);
+
+/**
+ * @brief logbin_unz decompress the frames of COMPRESS_ON in a capture. A
+ * frame is only decompressed with the history of the device, from a restart
+ * on and without any frame lost since, otherwise it is skipped. A line
+ * "--- compressed frames lost ---" is output where frames go missing. The
+ * bytes outside of the frames are dropped.
+ *
+ * @param z - decompressor
+ * @param p - capture bytes
+ * @param len - number of bytes
+ * @param eof - non-zero if no more bytes follow
+ * @param o - output
+ *
+ * @return bytes used, the rest is an incomplete frame
+ */
+size_t logbin_unz(logbin_unz_t  *z,
+                  const uint8_t *p,
+                  size_t        len,
+                  int           eof,
+                  logbin_out_t  *o);
+
+/**
+ * @brief logbin_token take the next token of a text, a run of letters,
+ * digits and '_', lowered and cut to LOGBIN_TOKEN_MAX
+ *
+ * @param s - text, advanced past the token
+ * @param end - end of the text
+ * @param tok - LOGBIN_TOKEN_MAX bytes to fill
+ *
+ * @return length of the token, 0 at the end of the text
+ */
+size_t logbin_token(const char **s,
+                    const char *end,
+                    char       *tok);
+
+/**
+ * @brief logbin_bloom_add add a key to a bloom filter
+ *
+ * @param bits - filter
+ * @param nbits - bits of the filter
+ * @param key - key
+ * @param len - bytes of the key
+ */
+void logbin_bloom_add(uint8_t    *bits,
+                      unsigned   nbits,
+                      const void *key,
+                      size_t     len);
+
+/**
+ * @brief logbin_bloom_test test if a key may be in a bloom filter
+ *
+ * @return 0 if it is certainly not, 1 otherwise
+ */
+int logbin_bloom_test(const uint8_t *bits,
+                      unsigned      nbits,
+                      const void    *key,
+                      size_t        len);
+
+/**
+ * @brief logbin_write append bytes to an output buffer, it grows as needed
+ */
+void logbin_write(logbin_out_t *o,
+                  const void   *p,
+                  size_t       n);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //LOGBIN_H
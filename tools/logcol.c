@@ -0,0 +1,509 @@
+/*************************************************************************
+ *  @file logcol.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Exports the binary records of BINARY_ON in captures of the logging
+ *  output as columns, for analytics in notebooks or scripts, and counts the
+ *  records per call site and period from them. The file needs nothing else
+ *  to be read, the call sites are in it. Little endian:
+ *
+ *    header      "LOGCOL1\0", u64 build ID, u64 ticks per second, u32 number
+ *                of sites, u32 size of long, size_t and pointers on the target
+ *    sites       per site, u64 offset in the logging_fmt section, u32 length
+ *                and the descriptor, format "\0" file "\0" line "\0"
+ *    row groups  to the end of the file, each u32 number of rows and five
+ *                columns, each u32 size, u32 size compressed and the column
+ *                compressed as logbin_lz_compress() does:
+ *      ts        timestamp, as the difference to the one of the row before,
+ *                zigzag LEB128, the first of a group to 0
+ *      level     u8 level code
+ *      site      u16 index of the site, 0xFFFF if not in the ELF file
+ *      arglen    u16 bytes of the parameters
+ *      args      parameters, packed as lfmt_vpack() does, back to back
+ *
+ *  So a scan only decompresses the columns it needs, and the timestamps and
+ *  site indices take a byte or two a record.
+ *
+ *  Build: cc -O2 -o logcol tools/logcol.c tools/logbin.c
+ *
+ *  Usage: logcol [options] firmware.elf columns.lcol [capture...]
+ *         logcol -c <seconds> [options] columns.lcol
+ *    -c <seconds>  count the records per call site and period, as CSV of
+ *                  the start of the period, the site and the count
+ *    -l <level>    count only the records of this level or above, 0 to 6
+ *    -i            go on if the build ID of a capture doesn't match
+ *    -s            statistics on stderr at the end
+ *  The captures, raw or written by logpack, are exported in the order
+ *  given, from stdin if none is.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define MAGIC                   "LOGCOL1"
+#define GROUP_ROWS              65536
+#define NO_SITE                 0xFFFF
+
+/* Columns */
+enum {
+  COL_TS,
+  COL_LEVEL,
+  COL_SITE,
+  COL_ARGLEN,
+  COL_ARGS,
+  COL_NUM
+};
+
+/* Static Variables *************************************************** */
+static const char *const col_names[COL_NUM] = { "ts", "level", "site", "arglen", "args" };
+
+static logbin_elf_t elf;
+static FILE         *col;
+static logbin_out_t cols[COL_NUM];
+static uint16_t     *site_index;         /* Index of the site at each offset of logging_fmt */
+static uint32_t     rows;
+static uint64_t     prev_ts, hz;
+static int          ignore_id, mismatch;
+static uint64_t     n_rows, n_bytes, n_raw[COL_NUM], n_stored[COL_NUM];
+
+/* Static Functions *************************************************** */
+
+static void put(logbin_out_t *o,
+                uint64_t     v,
+                int          n)
+{
+  uint8_t b[8];
+
+  for (int i = 0; i < n; i++, v >>= 8) {
+    b[i] = (uint8_t)v;
+  }
+  logbin_write(o, b, (size_t)n);
+}
+
+static void fput(FILE     *f,
+                 uint64_t v,
+                 int      n)
+{
+  for (int i = 0; i < n; i++, v >>= 8) {
+    putc((int)(v & 0xFF), f);
+  }
+}
+
+static uint64_t get(const uint8_t *p,
+                    int           n)
+{
+  uint64_t v = 0;
+
+  while (n--) {
+    v = v << 8 | p[n];
+  }
+  return v;
+}
+
+/**
+ * @brief compress the columns of the row group being filled, if any, and
+ * write it
+ */
+static void flush_group(void)
+{
+  if (!rows) {
+    return;
+  }
+  fput(col, rows, 4);
+  for (int c = 0; c < COL_NUM; c++) {
+    uint8_t *zip = malloc(LOGBIN_LZ_BOUND(cols[c].len));
+    size_t  n;
+
+    if (!zip) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    n = logbin_lz_compress(zip, (const uint8_t *)cols[c].p, cols[c].len);
+    fput(col, cols[c].len, 4);
+    fput(col, n, 4);
+    fwrite(zip, 1, n, col);
+    free(zip);
+    n_raw[c]    += cols[c].len;
+    n_stored[c] += n;
+    cols[c].len  = 0;
+  }
+  rows    = 0;
+  prev_ts = 0;
+}
+
+/**
+ * @brief add the records of a capture to the columns, see logbin_read_cb
+ */
+static long export(void                 *ctx,
+                   const uint8_t        *p,
+                   size_t               len,
+                   int                  eof,
+                   const logbin_block_t *b)
+{
+  size_t used = 0;
+
+  (void)ctx;
+  if (b && b->hz) {
+    hz = b->hz;
+  }
+  while (used < len) {
+    logbin_item_t it;
+    size_t        n = logbin_next(p + used, len - used, eof, &it);
+    uint64_t      z;
+
+    if (it.kind == LOGBIN_MORE) {
+      break;
+    }
+    used += n;
+    if (it.kind == LOGBIN_SYNCED) {
+      if (it.build_id != elf.build_id && !mismatch) {
+        fprintf(stderr, "logcol: build ID %016llx of the capture doesn't match "
+                "%016llx of the ELF file\n",
+                (unsigned long long)it.build_id, (unsigned long long)elf.build_id);
+        mismatch = 1;
+        if (!ignore_id) {
+          return -1;
+        }
+      }
+      hz = it.hz ? it.hz : hz;
+      continue;
+    }
+    if (it.kind != LOGBIN_RECORD) {
+      continue;
+    }
+
+    /* Zigzag, so going back in time after a reset takes few bytes as well */
+    z       = (it.ts - prev_ts) << 1 ^ (uint64_t)((int64_t)(it.ts - prev_ts) >> 63);
+    prev_ts = it.ts;
+    do {
+      uint8_t c = (uint8_t)(z & 0x7F);
+
+      z >>= 7;
+      c  |= z ? 0x80 : 0;
+      logbin_write(&cols[COL_TS], &c, 1);
+    } while (z);
+    logbin_write(&cols[COL_LEVEL], &it.lvl, 1);
+    put(&cols[COL_SITE], it.site < elf.fmt_len ? site_index[it.site] : NO_SITE, 2);
+    put(&cols[COL_ARGLEN], it.args_len, 2);
+    logbin_write(&cols[COL_ARGS], it.args, it.args_len);
+    n_rows++;
+    if (++rows == GROUP_ROWS) {
+      flush_group();
+    }
+  }
+  return (long)used;
+}
+
+/**
+ * @brief export captures to a column file
+ *
+ * @param argc - number of arguments left
+ * @param argv - ELF file, column file and captures
+ *
+ * @return exit code
+ */
+static int export_file(int  argc,
+                       char **argv)
+{
+  logbin_out_t  head  = { 0 };
+  logbin_site_t site;
+  uint32_t      sites = 0;
+  int           ret   = 0;
+
+  if (logbin_load(&elf, argv[0])) {
+    return 1;
+  }
+  site_index = malloc((elf.fmt_len ? elf.fmt_len : 1) * sizeof(*site_index));
+  col        = fopen(argv[1], "wb");
+  if (!site_index || !col) {
+    perror(argv[1]);
+    return 1;
+  }
+  memset(site_index, 0xFF, (elf.fmt_len ? elf.fmt_len : 1) * sizeof(*site_index));
+
+  /* The sites are numbered in the order of the section */
+  for (uint64_t off = 0, next; (next = logbin_site_next(&elf, &off, &site)); off = next) {
+    site_index[off] = (uint16_t)(sites < NO_SITE ? sites++ : NO_SITE);
+  }
+  logbin_write(&head, MAGIC, sizeof(MAGIC));
+  put(&head, elf.build_id, 8);
+  put(&head, 0, 8);
+  put(&head, sites, 4);
+  put(&head, elf.word, 4);
+  for (uint64_t off = 0, next; (next = logbin_site_next(&elf, &off, &site)); off = next) {
+    if (site_index[off] != NO_SITE) {
+      put(&head, off, 8);
+      put(&head, next - off, 4);
+      logbin_write(&head, elf.fmt + off, next - off);
+    }
+  }
+  fwrite(head.p, 1, head.len, col);
+
+  if (argc == 2) {
+    ret = logbin_read(stdin, export, NULL, &n_bytes) != 0;
+  }
+  for (int k = 2; k < argc && !ret; k++) {
+    FILE *in = fopen(argv[k], "rb");
+
+    if (!in) {
+      perror(argv[k]);
+      return 1;
+    }
+    ret = logbin_read(in, export, NULL, &n_bytes) != 0;
+    fclose(in);
+  }
+  flush_group();
+
+  /* The rate is known at the end, after the sync records */
+  fseek(col, sizeof(MAGIC) + 8, SEEK_SET);
+  fput(col, hz, 8);
+  if (fclose(col) || ret) {
+    remove(argv[1]);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief read and decompress a column of a row group, or skip it
+ *
+ * @param f - column file
+ * @param buf - buffer, grown as needed
+ * @param keep - zero to skip the column
+ *
+ * @return size of the column, -1 if the file is cut short or corrupt
+ */
+static long read_column(FILE         *f,
+                        logbin_out_t *buf,
+                        int          keep)
+{
+  uint8_t  len[8];
+  uint8_t  *zip;
+  uint32_t raw, stored;
+  long     n;
+
+  if (fread(len, 1, 8, f) != 8) {
+    return -1;
+  }
+  raw    = (uint32_t)get(len, 4);
+  stored = (uint32_t)get(len + 4, 4);
+  if (!keep) {
+    return fseek(f, stored, SEEK_CUR) ? -1 : 0;
+  }
+  if (buf->cap < raw) {
+    buf->p   = realloc(buf->p, raw);
+    buf->cap = raw;
+  }
+  buf->len = 0;
+  zip = malloc(stored ? stored : 1);
+  if (!zip || !buf->p || fread(zip, 1, stored, f) != stored) {
+    free(zip);
+    return -1;
+  }
+  n = logbin_lz_decompress((uint8_t *)buf->p, raw, zip, stored);
+  free(zip);
+  buf->len = n < 0 ? 0 : (size_t)n;
+  return n == (long)raw ? n : -1;
+}
+
+/**
+ * @brief count the records of a column file per call site and period
+ *
+ * @param path - column file
+ * @param period - length of a period, in seconds, in ticks without a rate
+ * @param max_lvl - highest level counted
+ *
+ * @return exit code
+ */
+static int count_file(const char *path,
+                      double     period,
+                      int        max_lvl)
+{
+  FILE         *f = fopen(path, "rb");
+  uint8_t      head[sizeof(MAGIC) + 24];
+  uint32_t     sites, *counts, *touched, n_touched = 0;
+  const char   **names;
+  logbin_out_t buf[COL_NUM] = { { 0 } };
+  uint64_t     *ts = NULL, ticks, bucket = 0, lo = 1, hi = 0;
+  size_t       ts_cap = 0;
+
+  if (!f || fread(head, 1, sizeof(head), f) != sizeof(head) || memcmp(head, MAGIC, sizeof(MAGIC))) {
+    fprintf(stderr, "%s: not a column file\n", path);
+    return 1;
+  }
+  hz      = get(head + sizeof(MAGIC) + 8, 8);
+  sites   = (uint32_t)get(head + sizeof(MAGIC) + 16, 4);
+  ticks   = (uint64_t)(period * (hz ? (double)hz : 1));
+  names   = calloc(sites + 1, sizeof(*names));
+  counts  = calloc(sites + 1, sizeof(*counts));
+  touched = calloc(sites + 1, sizeof(*touched));
+  if (!names || !counts || !touched || !ticks) {
+    return 1;
+  }
+
+  /* Sites as file:line, the file without its path */
+  for (uint32_t i = 0; i < sites; i++) {
+    uint8_t  h[12];
+    char     *d, *file, *line, *c, *name;
+    uint32_t len;
+
+    if (fread(h, 1, 12, f) != 12) {
+      return 1;
+    }
+    len = (uint32_t)get(h + 8, 4);
+    d   = calloc(1, len + 1);
+    if (!d || fread(d, 1, len, f) != len) {
+      return 1;
+    }
+    file = d + strlen(d) + 1;
+    line = file + strlen(file) + 1;
+    for (c = file; *c; c++) {
+      file = *c == '/' || *c == '\\' ? c + 1 : file;
+    }
+    name = malloc(strlen(file) + strlen(line) + 2);
+    if (!name) {
+      return 1;
+    }
+    sprintf(name, "%s:%s", file, line);
+    names[i] = name;
+    free(d);
+  }
+  names[sites] = "?";
+
+  printf("start,site,count\n");
+  for (;;) {
+    uint8_t  r[4];
+    uint32_t n;
+
+    if (fread(r, 1, 4, f) != 4) {
+      break;
+    }
+    n = (uint32_t)get(r, 4);
+    /* Only the columns counted are decompressed */
+    for (int c = 0; c < COL_NUM; c++) {
+      if (read_column(f, &buf[c], c <= COL_SITE) < 0) {
+        fprintf(stderr, "%s: row group cut short\n", path);
+        return 1;
+      }
+    }
+    if (buf[COL_LEVEL].len != n || buf[COL_SITE].len != 2 * (size_t)n) {
+      fprintf(stderr, "%s: row group is corrupt\n", path);
+      return 1;
+    }
+    if (ts_cap < n) {
+      ts     = realloc(ts, n * sizeof(*ts));
+      ts_cap = n;
+    }
+
+    /* The timestamps, as a sum of the differences */
+    const uint8_t *p = (const uint8_t *)buf[COL_TS].p, *end = p + buf[COL_TS].len;
+    uint64_t      t  = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+      uint64_t z = 0;
+
+      for (int sh = 0; p < end; sh += 7) {
+        z |= (uint64_t)(*p & 0x7F) << sh;
+        if (!(*p++ & 0x80)) {
+          break;
+        }
+      }
+      t    += z >> 1 ^ (uint64_t)-(int64_t)(z & 1);
+      ts[i] = t;
+    }
+
+    /* A period ends at a new one, the division only when it does */
+    const uint8_t *lvl  = (const uint8_t *)buf[COL_LEVEL].p;
+    const uint8_t *site = (const uint8_t *)buf[COL_SITE].p;
+
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t s;
+
+      if (lvl[i] > max_lvl) {
+        continue;
+      }
+      if (ts[i] < lo || ts[i] > hi) {
+        for (uint32_t k = 0; k < n_touched; k++) {
+          printf("%.3f,%s,%u\n", (double)(bucket * ticks) / (hz ? (double)hz : 1),
+                 names[touched[k]], counts[touched[k]]);
+          counts[touched[k]] = 0;
+        }
+        n_touched = 0;
+        bucket    = ts[i] / ticks;
+        lo        = bucket * ticks;
+        hi        = lo + ticks - 1;
+      }
+      s = site[2 * i] | (uint32_t)site[2 * i + 1] << 8;
+      s = s < sites ? s : sites;
+      if (!counts[s]++) {
+        touched[n_touched++] = s;
+      }
+    }
+  }
+  for (uint32_t k = 0; k < n_touched; k++) {
+    printf("%.3f,%s,%u\n", (double)(bucket * ticks) / (hz ? (double)hz : 1),
+           names[touched[k]], counts[touched[k]]);
+  }
+  fclose(f);
+  return 0;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logcol [-i] [-s] firmware.elf columns.lcol [capture...]\n"
+          "       logcol -c seconds [-l level] [-s] columns.lcol\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  struct timespec start, stop;
+  double          period  = 0;
+  int             i, max_lvl = 7, stats = 0, ret;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      period = atof(argv[++i]);
+      if (period <= 0) {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+      max_lvl = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-i")) {
+      ignore_id = 1;
+    } else if (!strcmp(argv[i], "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (period ? argc - i != 1 : argc - i < 2) {
+    usage();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ret = period ? count_file(argv[i], period, max_lvl) : export_file(argc - i, argv + i);
+  fflush(stdout);
+
+  if (stats) {
+    double s;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    s = (double)(stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    if (!period) {
+      fprintf(stderr, "logcol: %llu bytes, %llu records\n",
+              (unsigned long long)n_bytes, (unsigned long long)n_rows);
+      for (int c = 0; c < COL_NUM; c++) {
+        fprintf(stderr, "  %-6s %10llu bytes, %10llu compressed\n", col_names[c],
+                (unsigned long long)n_raw[c], (unsigned long long)n_stored[c]);
+      }
+    }
+    fprintf(stderr, "logcol: %.3f ms\n", s * 1e3);
+  }
+  return ret;
+}
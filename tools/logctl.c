@@ -0,0 +1,248 @@
+/*************************************************************************
+ *  @file logctl.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Host side of the logging control channel, see logging_ctrl.h.
+ *
+ *  Build: cc -O2 -o logctl tools/logctl.c
+ *
+ *  Encode a command to stdout, e.g. to send it through the RTT telnet port
+ *  of the channel:
+ *    logctl [-s seq] ping
+ *    logctl [-s seq] level <level>
+ *    logctl [-s seq] module <name> <level|off>
+ *    logctl [-s seq] site <module> <line> <on|off>
+ *    logctl [-s seq] iface <rtt|vcom|both|none>
+ *    logctl [-s seq] dump
+ *    logctl [-s seq] stats
+ *    logctl [-s seq] reset-stats
+ *  Decode the responses read from stdin:
+ *    logctl -d
+ *  Levels are numbers or fatal, error, warning, info, highlight, debug and
+ *  verbose.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "../logging_ctrl.h"
+
+/* Defines  *********************************************************** */
+#define STATS_COUNTERS          6
+
+/* Static Variables *************************************************** */
+static const char *levels[] = {
+  "fatal", "error", "warning", "info", "highlight", "debug", "verbose"
+};
+
+static const char *counters[STATS_COUNTERS] = {
+  "calls", "filtered", "emitted", "bytes", "truncated", "dropped"
+};
+
+static const char *status_str[] = {
+  "ok", "unsupported", "bad argument", "no room"
+};
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: logctl [-s seq] ping|level|module|site|iface|dump|stats|reset-stats [args]\n"
+          "       logctl -d < responses\n");
+  exit(2);
+}
+
+static int parse_level(const char *s)
+{
+  char *end;
+  long v;
+
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    if (!strcasecmp(s, levels[i])) {
+      return (int)i;
+    }
+  }
+  if (!strcasecmp(s, "off")) {
+    return 0xFF;
+  }
+  v = strtol(s, &end, 0);
+  if (*end || v < 0 || v > 0xFF) {
+    fprintf(stderr, "bad level: %s\n", s);
+    exit(2);
+  }
+  return (int)v;
+}
+
+static void send_frame(uint8_t       op,
+                       uint8_t       seq,
+                       const uint8_t *payload,
+                       size_t        len)
+{
+  uint8_t frame[4 + LCTRL_PAYLOAD_MAX + 1];
+
+  if (len > LCTRL_PAYLOAD_MAX) {
+    fprintf(stderr, "payload too long\n");
+    exit(2);
+  }
+  frame[0] = LCTRL_SYNC;
+  frame[1] = op;
+  frame[2] = seq;
+  frame[3] = (uint8_t)len;
+  memcpy(frame + 4, payload, len);
+  frame[4 + len] = lctrl_crc8(0, frame + 1, 3 + len);
+  fwrite(frame, 1, 5 + len, stdout);
+}
+
+static int encode(int  argc,
+                  char **argv,
+                  uint8_t seq)
+{
+  uint8_t    p[LCTRL_PAYLOAD_MAX];
+  size_t     n = 0;
+  const char *cmd;
+
+  if (argc < 1) {
+    usage();
+  }
+  cmd = argv[0];
+  if (!strcmp(cmd, "ping") && argc == 1) {
+    send_frame(LCTRL_PING, seq, p, 0);
+  } else if (!strcmp(cmd, "level") && argc == 2) {
+    p[n++] = (uint8_t)parse_level(argv[1]);
+    send_frame(LCTRL_SET_LEVEL, seq, p, n);
+  } else if (!strcmp(cmd, "module") && argc == 3) {
+    p[n++] = (uint8_t)parse_level(argv[2]);
+    if (strlen(argv[1]) > sizeof(p) - n) {
+      usage();
+    }
+    memcpy(p + n, argv[1], strlen(argv[1]));
+    send_frame(LCTRL_SET_MODULE_LEVEL, seq, p, n + strlen(argv[1]));
+  } else if (!strcmp(cmd, "site") && argc == 4) {
+    unsigned long line = strtoul(argv[2], NULL, 0);
+
+    p[n++] = !strcmp(argv[3], "on");
+    p[n++] = (uint8_t)line;
+    p[n++] = (uint8_t)(line >> 8);
+    if (strlen(argv[1]) > sizeof(p) - n) {
+      usage();
+    }
+    memcpy(p + n, argv[1], strlen(argv[1]));
+    send_frame(LCTRL_SET_SITE, seq, p, n + strlen(argv[1]));
+  } else if (!strcmp(cmd, "iface") && argc == 2) {
+    if (!strcmp(argv[1], "rtt")) {
+      p[0] = 1;
+    } else if (!strcmp(argv[1], "vcom")) {
+      p[0] = 2;
+    } else if (!strcmp(argv[1], "both")) {
+      p[0] = 3;
+    } else if (!strcmp(argv[1], "none")) {
+      p[0] = 0;
+    } else {
+      usage();
+    }
+    send_frame(LCTRL_SET_INTERFACES, seq, p, 1);
+  } else if (!strcmp(cmd, "dump") && argc == 1) {
+    send_frame(LCTRL_DUMP_RECORDER, seq, p, 0);
+  } else if (!strcmp(cmd, "stats") && argc == 1) {
+    send_frame(LCTRL_GET_STATS, seq, p, 0);
+  } else if (!strcmp(cmd, "reset-stats") && argc == 1) {
+    send_frame(LCTRL_RESET_STATS, seq, p, 0);
+  } else {
+    usage();
+  }
+  return 0;
+}
+
+static void print_response(const uint8_t *f)
+{
+  uint8_t       op     = f[1] & ~LCTRL_RSP;
+  uint8_t       len    = f[3];
+  uint8_t       status = f[4];
+  const uint8_t *p     = f + 5;
+
+  printf("seq %u op %u: %s", f[2], op,
+         status < sizeof(status_str) / sizeof(status_str[0])
+         ? status_str[status] : "?");
+  if (op == LCTRL_SET_INTERFACES && len == 2) {
+    printf(", interfaces 0x%02x", p[0]);
+  } else if (op == LCTRL_DUMP_RECORDER && len == 3) {
+    printf(", %u records dumped", p[0] | (p[1] << 8));
+  }
+  printf("\n");
+  if (op == LCTRL_GET_STATS && status == LCTRL_OK) {
+    size_t nlevels = (len - 1) / (4 * STATS_COUNTERS);
+
+    printf("%-10s", "level");
+    for (int j = 0; j < STATS_COUNTERS; j++) {
+      printf(" %10s", counters[j]);
+    }
+    printf("\n");
+    for (size_t i = 0; i < nlevels; i++) {
+      printf("%-10s", i < sizeof(levels) / sizeof(levels[0]) ? levels[i] : "?");
+      for (int j = 0; j < STATS_COUNTERS; j++, p += 4) {
+        printf(" %10u", p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+      }
+      printf("\n");
+    }
+  }
+}
+
+static int decode(void)
+{
+  uint8_t f[5 + 255], *sync;
+  size_t  n = 0, need;
+  int     c, bad = 0, eof = 0;
+
+  /* f keeps the bytes read but not consumed yet, they are rescanned */
+  for (;;) {
+    /* Drop the bytes before the next sync byte */
+    sync = memchr(f, LCTRL_SYNC, n);
+    n    = sync ? n - (size_t)(sync - f) : 0;
+    memmove(f, sync ? sync : f, n);
+
+    need = n < 4 ? 4 : 5 + (size_t)f[3];
+    if (n < need && !eof) {
+      if ((c = getchar()) == EOF) {
+        eof = 1;
+      } else {
+        f[n++] = (uint8_t)c;
+      }
+      continue;
+    }
+    if (!n) {
+      break;
+    }
+    if (n < need || !(f[1] & LCTRL_RSP) || !f[3]
+        || lctrl_crc8(0, f + 1, 3 + f[3]) != f[4 + f[3]]) {
+      /* Not a response, a sync byte within the bytes read may start one. A
+       * frame cut short by the end of the input isn't counted. */
+      bad += n >= need;
+      memmove(f, f + 1, --n);
+      continue;
+    }
+    print_response(f);
+    n -= need;
+    memmove(f, f + need, n);
+  }
+  if (bad) {
+    fprintf(stderr, "%d bad frames\n", bad);
+  }
+  return bad ? 1 : 0;
+}
+
+int main(int  argc,
+         char **argv)
+{
+  uint8_t seq = 0;
+  int     i   = 1;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    return decode();
+  }
+  if (argc > 2 && !strcmp(argv[1], "-s")) {
+    seq = (uint8_t)strtoul(argv[2], NULL, 0);
+    i   = 3;
+  }
+  return encode(argc - i, argv + i, seq);
+}
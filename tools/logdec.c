@@ -0,0 +1,490 @@
+/*************************************************************************
+ *  @file logdec.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Decodes the binary records of BINARY_ON in a capture of the logging
+ *  output, or in a memory dump of the target, into the text the device
+ *  emits without it. The format strings, file names and lines are read from
+ *  the logging_fmt section of the ELF file of the firmware, and the build ID
+ *  in the sync records is checked against it. The text, the key/value frames
+ *  of KV_ON and the headers of RTT_PER_CONTEXT are passed through as they
+ *  are, so the output can be piped into logkv or split by logmerge. A block
+ *  capture written by logpack is recognized by its first block header, and
+ *  its blocks are decoded by a pool of threads, the output keeps their order.
+ *
+ *  Build: cc -O2 -pthread -o logdec tools/logdec.c tools/logbin.c
+ *
+ *  Usage: logdec [options] firmware.elf [capture]
+ *    -m            no colors, the level flags are rendered as "[ERR]"
+ *    -i            go on decoding if the build ID doesn't match
+ *    -w <n>        width of the file name, FILE_NAME_LENGTH, 10 by default
+ *    -r <hz>       timestamp ticks per second, if the sync records have none
+ *    -d            the capture is a memory dump of the target, the RTT
+ *                  up-buffer in it is decoded, oldest bytes first
+ *    -a <address>  address of the dump, by default derived from the address
+ *                  of _SEGGER_RTT in the ELF file
+ *    -c <channel>  RTT up-buffer to decode from the dump, 0 by default
+ *    -j <n>        threads decoding a block capture, the number of cores by
+ *                  default
+ *    -s            statistics on stderr at the end
+ *  The capture is read from stdin if not given, as a stream in blocks of a
+ *  MiB, so captures of any size are decoded in bounded memory.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define BLOCK_LEN               (1u << 20)
+
+/* States of a block slot */
+enum {
+  SLOT_FREE,
+  SLOT_READY,
+  SLOT_DONE
+};
+
+/**
+ * @brief state of a decoder, one per block being decoded
+ */
+typedef struct {
+  logbin_out_t   out;                /**< Text decoded */
+  logbin_style_t style;              /**< Rendering options, with the rate in use */
+  uint64_t       records;            /**< Records decoded */
+  uint64_t       syncs;              /**< Sync records decoded */
+  uint64_t       bad_id;             /**< Build ID which didn't match, 0 if none */
+  int            synced;             /**< Non-zero if a build ID was checked */
+}dec_t;
+
+/**
+ * @brief block of a block capture, handed from the reader to the threads
+ */
+typedef struct {
+  logbin_block_t b;                  /**< Header */
+  uint8_t        *payload;           /**< Payload */
+  size_t         cap;                /**< Bytes allocated for the payload */
+  dec_t          d;                  /**< Decoder */
+  int            ret;                /**< Result of decode() */
+  int            state;              /**< SLOT_xxx state */
+}slot_t;
+
+/* Static Variables *************************************************** */
+static logbin_elf_t   elf;
+static logbin_style_t style = { .color = 1, .name_width = 10 };
+static dec_t          dec;
+static int            ignore_id, stats, synced;
+static uint64_t       fixed_hz;
+static uint64_t       n_records, n_syncs, n_bytes, n_blocks, n_skipped;
+
+static pthread_mutex_t lock      = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  done_cond = PTHREAD_COND_INITIALIZER;
+static slot_t          *slots;
+static unsigned        n_slots;
+static uint64_t        filled, taken;
+static int             quit;
+
+/* Static Functions *************************************************** */
+
+/**
+ * @brief decode the items of a buffer to the output of a decoder
+ *
+ * @param d - decoder
+ * @param p - capture bytes
+ * @param len - number of bytes
+ * @param eof - non-zero if no more bytes follow
+ *
+ * @return bytes decoded, the rest is an incomplete frame, -1 on a build ID
+ * mismatch unless -i is given
+ */
+static long decode(dec_t         *d,
+                   const uint8_t *p,
+                   size_t        len,
+                   int           eof)
+{
+  size_t used = 0;
+
+  while (used < len) {
+    logbin_item_t it;
+    size_t        n = logbin_next(p + used, len - used, eof, &it);
+
+    if (it.kind == LOGBIN_MORE) {
+      break;
+    }
+    switch (it.kind) {
+      case LOGBIN_RECORD:
+        logbin_render(&d->out, &elf, &d->style, &it);
+        d->records++;
+        break;
+      case LOGBIN_SYNCED:
+        d->syncs++;
+        if (it.build_id != elf.build_id) {
+          d->bad_id = it.build_id;
+          if (!ignore_id) {
+            return -1;
+          }
+        }
+        d->synced = 1;
+        if (!fixed_hz) {
+          d->style.hz = it.hz;
+        }
+        break;
+      default:
+        logbin_write(&d->out, p + used, n);
+        break;
+    }
+    used += n;
+  }
+  return (long)used;
+}
+
+/**
+ * @brief write the output of a decoder and take its counts, a build ID which
+ * doesn't match is reported once
+ */
+static void flush_out(dec_t *d)
+{
+  static uint64_t reported;
+
+  if (d->bad_id && d->bad_id != reported) {
+    reported = d->bad_id;
+    fprintf(stderr, "logdec: build ID %016llx of the capture doesn't match "
+            "%016llx of the ELF file\n",
+            (unsigned long long)d->bad_id, (unsigned long long)elf.build_id);
+  }
+  d->bad_id = 0;
+  fwrite(d->out.p, 1, d->out.len, stdout);
+  d->out.len = 0;
+  n_records += d->records;
+  n_syncs   += d->syncs;
+  synced    |= d->synced;
+  d->records = 0;
+  d->syncs   = 0;
+}
+
+/**
+ * @brief decode the blocks handed over, in any order
+ */
+static void *worker(void *arg)
+{
+  (void)arg;
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (taken == filled && !quit) {
+      pthread_cond_wait(&work_cond, &lock);
+    }
+    if (taken == filled) {
+      break;
+    }
+    slot_t *s = &slots[taken++ % n_slots];
+
+    pthread_mutex_unlock(&lock);
+    s->d.style  = style;
+    s->d.synced = s->b.build_id != 0;
+    if (s->b.hz && !fixed_hz) {
+      s->d.style.hz = s->b.hz;
+    }
+    s->d.bad_id = s->b.build_id != elf.build_id ? s->b.build_id : 0;
+    s->ret = s->d.bad_id && !ignore_id ? -1 : (int)(decode(&s->d, s->payload, s->b.len, 1) < 0);
+    pthread_mutex_lock(&lock);
+    s->state = SLOT_DONE;
+    pthread_cond_broadcast(&done_cond);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+/**
+ * @brief wait for a block to be decoded and write its output in order
+ *
+ * @param s - block slot
+ * @param emit - zero to drop the output, after an error
+ *
+ * @return 0 on success, 1 on a build ID mismatch
+ */
+static int write_slot(slot_t *s,
+                      int    emit)
+{
+  int ret;
+
+  pthread_mutex_lock(&lock);
+  while (s->state != SLOT_DONE) {
+    pthread_cond_wait(&done_cond, &lock);
+  }
+  s->state = SLOT_FREE;
+  pthread_mutex_unlock(&lock);
+  ret = s->ret;
+  if (emit) {
+    flush_out(&s->d);
+  }
+  s->d.out.len = 0;
+  return ret != 0;
+}
+
+/**
+ * @brief read the next block header of a block capture, skipping anything
+ * which isn't one until the next marker
+ *
+ * @param in - capture
+ * @param head - LOGBIN_BLOCK_HEAD bytes, the first *have are read already
+ * @param have - bytes of head read
+ * @param b - header found
+ *
+ * @return 0 on success, -1 at the end of the capture
+ */
+static int next_block(FILE           *in,
+                      uint8_t        *head,
+                      size_t         *have,
+                      logbin_block_t *b)
+{
+  for (;;) {
+    size_t        n = fread(head + *have, 1, LOGBIN_BLOCK_HEAD - *have, in);
+    const uint8_t *m;
+
+    *have   += n;
+    n_bytes += n;
+    if (*have < LOGBIN_BLOCK_HEAD) {
+      n_skipped += *have;
+      return -1;
+    }
+    *have = 0;
+    if (!logbin_block_parse(head, b)) {
+      return 0;
+    }
+    /* Resynchronize at the next byte which may start a marker */
+    m = memchr(head + 1, LOGBIN_BLOCK_MARK[0], LOGBIN_BLOCK_HEAD - 1);
+    n = m ? (size_t)(m - head) : LOGBIN_BLOCK_HEAD;
+    memmove(head, head + n, LOGBIN_BLOCK_HEAD - n);
+    *have      = LOGBIN_BLOCK_HEAD - n;
+    n_skipped += n;
+  }
+}
+
+/**
+ * @brief decode a block capture on a pool of threads
+ *
+ * @param in - capture
+ * @param head - first LOGBIN_BLOCK_HEAD bytes of the capture, read already
+ * @param threads - number of threads
+ *
+ * @return 0 on success, 1 on a build ID mismatch
+ */
+static int decode_blocks(FILE     *in,
+                         uint8_t  *head,
+                         unsigned threads)
+{
+  pthread_t      *tid = calloc(threads, sizeof(*tid));
+  logbin_block_t b;
+  uint64_t       written = 0;
+  size_t         have    = LOGBIN_BLOCK_HEAD;
+  int            ret     = 0;
+
+  /* Enough blocks in flight to keep every thread busy while one is written */
+  n_slots = 2 * threads;
+  slots   = calloc(n_slots, sizeof(*slots));
+  if (!tid || !slots) {
+    return 1;
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    pthread_create(&tid[i], NULL, worker, NULL);
+  }
+
+  while (!ret && !next_block(in, head, &have, &b)) {
+    slot_t *s = &slots[filled % n_slots];
+
+    if (filled - written == n_slots) {
+      ret = write_slot(&slots[written++ % n_slots], 1);
+      if (ret) {
+        break;
+      }
+    }
+    if (s->cap < b.len) {
+      s->payload = realloc(s->payload, b.len);
+      s->cap     = s->payload ? b.len : 0;
+      if (!s->payload) {
+        ret = 1;
+        break;
+      }
+    }
+    /* A cut short last block is decoded as far as it goes */
+    b.len    = (uint32_t)fread(s->payload, 1, b.len, in);
+    n_bytes += b.len;
+    s->b     = b;
+    n_blocks++;
+    pthread_mutex_lock(&lock);
+    s->state = SLOT_READY;
+    filled++;
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&lock);
+  }
+  while (written < filled) {
+    ret |= write_slot(&slots[written++ % n_slots], !ret);
+  }
+
+  pthread_mutex_lock(&lock);
+  quit = 1;
+  pthread_cond_broadcast(&work_cond);
+  pthread_mutex_unlock(&lock);
+  for (unsigned i = 0; i < threads; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  if (n_skipped) {
+    fprintf(stderr, "logdec: %llu bytes between the blocks skipped\n",
+            (unsigned long long)n_skipped);
+  }
+  return ret;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logdec [-m] [-i] [-w width] [-r hz] [-d [-a address] [-c channel]] "
+          "[-j threads] [-s] firmware.elf [capture]\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  FILE            *in = stdin;
+  int             i, dump = 0, ret = 0;
+  unsigned        channel = 0, threads = 0;
+  uint64_t        base    = 0;
+  struct timespec start, stop;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char *a = argv[i];
+
+    if (!strcmp(a, "-m")) {
+      style.color = 0;
+    } else if (!strcmp(a, "-i")) {
+      ignore_id = 1;
+    } else if (!strcmp(a, "-w") && i + 1 < argc) {
+      style.name_width = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(a, "-r") && i + 1 < argc) {
+      fixed_hz = style.hz = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(a, "-d")) {
+      dump = 1;
+    } else if (!strcmp(a, "-a") && i + 1 < argc) {
+      base = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(a, "-c") && i + 1 < argc) {
+      channel = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(a, "-j") && i + 1 < argc) {
+      threads = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(a, "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (i >= argc || argc - i > 2) {
+    usage();
+  }
+  if (!threads) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    threads = n > 0 ? (unsigned)n : 1;
+  }
+  dec.style = style;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (logbin_load(&elf, argv[i])) {
+    return 1;
+  }
+  if (argc - i == 2) {
+    in = fopen(argv[i + 1], "rb");
+    if (!in) {
+      perror(argv[i + 1]);
+      return 1;
+    }
+  }
+
+  if (dump) {
+    /* A dump is the RAM of the target, read it whole */
+    uint8_t *mem = NULL, *ring;
+    size_t  len  = 0, n, skip = 0;
+    long    ring_len;
+    int     wrapped;
+
+    do {
+      mem  = realloc(mem, len + BLOCK_LEN);
+      n    = mem ? fread(mem + len, 1, BLOCK_LEN, in) : 0;
+      len += n;
+    } while (n == BLOCK_LEN);
+    ring_len = mem ? logbin_rtt_ring(&elf, mem, len, base, channel, &ring, &wrapped) : -1;
+    if (ring_len < 0) {
+      return 1;
+    }
+    /* The oldest record of a wrapped buffer is cut short, start after it */
+    while (wrapped && skip < (size_t)ring_len) {
+      logbin_item_t it;
+      size_t        k = logbin_next(ring + skip, (size_t)ring_len - skip, 1, &it);
+      const uint8_t *nl;
+
+      if (it.kind != LOGBIN_BYTES) {
+        break;
+      }
+      nl = memchr(ring + skip, '\n', k);
+      skip = nl ? (size_t)(nl + 1 - ring) : skip + k;
+      if (nl) {
+        break;
+      }
+    }
+    n_bytes = (uint64_t)ring_len - skip;
+    ret     = decode(&dec, ring + skip, (size_t)ring_len - skip, 1) < 0;
+    flush_out(&dec);
+  } else {
+    uint8_t *buf = malloc(BLOCK_LEN + LOGBIN_FRAME_MAX);
+    size_t  len  = 0, n;
+    long    used;
+
+    if (!buf) {
+      return 1;
+    }
+    len     = fread(buf, 1, LOGBIN_BLOCK_HEAD, in);
+    n_bytes = len;
+    if (len == LOGBIN_BLOCK_HEAD && !logbin_block_parse(buf, &(logbin_block_t){ 0 })) {
+      ret = decode_blocks(in, buf, threads);
+    } else {
+      /* Incomplete frames at the end of a block are kept for the next one */
+      do {
+        n        = fread(buf + len, 1, BLOCK_LEN, in);
+        len     += n;
+        n_bytes += n;
+        used     = decode(&dec, buf, len, n == 0);
+        flush_out(&dec);
+        if (used < 0) {
+          ret = 1;
+          break;
+        }
+        memmove(buf, buf + used, len - (size_t)used);
+        len -= (size_t)used;
+      } while (n);
+    }
+  }
+  fflush(stdout);
+  if (in != stdin) {
+    fclose(in);
+  }
+
+  if (!synced && n_records) {
+    fprintf(stderr, "logdec: no sync record in the capture, build ID not checked\n");
+  }
+  if (stats) {
+    double s;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    s = (double)(stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "logdec: %llu bytes, %llu records, %llu sync records, %llu blocks "
+            "in %.3f s, %.1f MB/s\n",
+            (unsigned long long)n_bytes, (unsigned long long)n_records,
+            (unsigned long long)n_syncs, (unsigned long long)n_blocks, s,
+            s > 0 ? n_bytes / s / 1e6 : 0.0);
+  }
+  return ret;
+}
@@ -0,0 +1,396 @@
+/*************************************************************************
+ *  @file logkv.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Decodes the key/value records of LOGx_KV() in a capture of the
+ *  logging output, with the call site descriptors from the logging_kv
+ *  section of the ELF file of the firmware. The text records are passed
+ *  through as they are.
+ *
+ *  Build: cc -O2 -o logkv tools/logkv.c tools/logbin.c
+ *
+ *  Usage: logkv [options] firmware.elf [capture]
+ *    -j              JSON lines, {"time", "level", "file", "line", "event",
+ *                    "fields": {key: value}}, instead of text
+ *    -k              key/value records only, the text is dropped
+ *    -e <event>      only the records of this event
+ *    -f <key=value>  only the records with this field value, as rendered in
+ *                    text. Can be repeated, all must match
+ *    -l <level>      only the records of this level or above, 0 to 6
+ *  Any filter drops the text as well. The capture is read from stdin if not
+ *  given, as a stream, so it works on live output too.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define FRAME_START             0x1D
+#define SECTION                 "logging_kv"
+#define FIELD_MAX               8
+#define FILTER_MAX              16
+#define VALUE_LEN               600
+
+/**
+ * @brief call site descriptor
+ */
+typedef struct {
+  const char *file;           /**< File name */
+  const char *line;           /**< Line */
+  const char *event;          /**< Event name */
+  const char *key[FIELD_MAX]; /**< Keys */
+  int        key_num;         /**< Number of keys */
+}site_t;
+
+/**
+ * @brief decoded value
+ */
+typedef struct {
+  char text[VALUE_LEN]; /**< Value rendered as text */
+  int  quoted;          /**< Value is a string in JSON */
+}value_t;
+
+/* Static Variables *************************************************** */
+static const char    *lvl_names[] = { "FTL", "ERR", "WRN", "IPM", "DHL", "DBG", "VER" };
+static const uint8_t *sites;        /**< Contents of the logging_kv section */
+static uint64_t      sites_len;
+static int           json, kv_only, max_lvl = 7;
+static const char    *event_filter;
+static const char    *filters[FILTER_MAX];
+static int           filter_num;
+
+/* Static Functions *************************************************** */
+/**
+ * @brief load the logging_kv section of a little endian ELF file
+ *
+ * @return 0 on success, -1 otherwise
+ */
+static int load_sites(const char *path)
+{
+  static logbin_elf_t e;
+
+  if (logbin_open(&e, path)) {
+    return -1;
+  }
+  sites = logbin_section(&e, SECTION, &sites_len);
+  if (!sites) {
+    fprintf(stderr, "%s: no " SECTION " section, built without KV_ON?\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief next '\0' terminated string of a descriptor
+ */
+static const char *next_str(uint64_t *off)
+{
+  const char *s = (const char *)sites + *off;
+  size_t     n  = strnlen(s, sites_len - *off);
+
+  if (*off + n >= sites_len) {
+    return NULL;
+  }
+  *off += n + 1;
+  return s;
+}
+
+static int get_site(uint64_t off,
+                    site_t   *site)
+{
+  if (off >= sites_len) {
+    return -1;
+  }
+  site->file  = next_str(&off);
+  site->line  = site->file ? next_str(&off) : NULL;
+  site->event = site->line ? next_str(&off) : NULL;
+  if (!site->event) {
+    return -1;
+  }
+  /* The keys end with an empty string */
+  for (site->key_num = 0; site->key_num < FIELD_MAX; site->key_num++) {
+    const char *k = next_str(&off);
+
+    if (!k || !*k) {
+      break;
+    }
+    site->key[site->key_num] = k;
+  }
+  return 0;
+}
+
+/**
+ * @brief decode the head of a CBOR data item
+ *
+ * @return 0 on success, -1 at the end of the payload
+ */
+static int get_head(const uint8_t **p,
+                    const uint8_t *end,
+                    int           *major,
+                    uint64_t      *v)
+{
+  int info, n;
+
+  if (*p >= end) {
+    return -1;
+  }
+  *major = **p >> 5;
+  info   = **p & 0x1F;
+  (*p)++;
+  n = info < 24 ? 0 : info <= 27 ? 1 << (info - 24) : -1;
+  if (n < 0 || end - *p < n) {
+    return -1;
+  }
+  *v = n ? 0 : (uint64_t)info;
+  for (int i = 0; i < n; i++) {
+    *v = *v << 8 | *(*p)++;
+  }
+  return 0;
+}
+
+static void put_escaped(char       *out,
+                        size_t     size,
+                        const char *s,
+                        size_t     len,
+                        int        escape)
+{
+  size_t o = 0;
+
+  for (size_t i = 0; i < len && o + 7 < size; i++) {
+    unsigned char c = (unsigned char)s[i];
+
+    if (escape && (c == '"' || c == '\\')) {
+      out[o++] = '\\';
+      out[o++] = (char)c;
+    } else if (escape && c < 0x20) {
+      o += (size_t)snprintf(out + o, size - o, "\\u%04x", c);
+    } else {
+      out[o++] = (char)c;
+    }
+  }
+  out[o] = '\0';
+}
+
+/**
+ * @brief decode a value
+ *
+ * @return 0 on success, -1 at the end of the payload
+ */
+static int get_value(const uint8_t **p,
+                     const uint8_t *end,
+                     value_t       *val)
+{
+  const uint8_t *head = *p;
+  int           major;
+  uint64_t      v;
+
+  if (get_head(p, end, &major, &v)) {
+    return -1;
+  }
+  val->quoted = 0;
+  switch (major) {
+    case 0:
+      snprintf(val->text, sizeof(val->text), "%llu", (unsigned long long)v);
+      return 0;
+    case 1:
+      snprintf(val->text, sizeof(val->text), "-%llu", (unsigned long long)v + 1);
+      return 0;
+    case 2:
+    case 3:
+      if ((uint64_t)(end - *p) < v) {
+        return -1;
+      }
+      if (major == 3) {
+        put_escaped(val->text, sizeof(val->text), (const char *)*p, (size_t)v, json);
+      } else {
+        /* Hex digits */
+        val->text[0] = '\0';
+        for (uint64_t i = 0; i < v && i * 2 + 2 < sizeof(val->text); i++) {
+          sprintf(val->text + i * 2, "%02x", (*p)[i]);
+        }
+      }
+      val->quoted = 1;
+      *p         += v;
+      return 0;
+    case 7:
+      if (*head == 0xFA) {
+        uint32_t b = (uint32_t)(v & 0xFFFFFFFFu);
+        float    f;
+
+        memcpy(&f, &b, sizeof(f));
+        snprintf(val->text, sizeof(val->text), "%.9g", f);
+        return 0;
+      }
+      if (*head == 0xFB) {
+        double d;
+
+        memcpy(&d, &v, sizeof(d));
+        snprintf(val->text, sizeof(val->text), "%.17g", d);
+        return 0;
+      }
+      return -1;
+    default:
+      return -1;
+  }
+}
+
+static int matches(const site_t  *site,
+                   const value_t *vals,
+                   int           num)
+{
+  if (event_filter && strcmp(event_filter, site->event)) {
+    return 0;
+  }
+  for (int f = 0; f < filter_num; f++) {
+    const char *eq = strchr(filters[f], '=');
+    size_t     kl  = (size_t)(eq - filters[f]);
+    int        hit = 0;
+
+    for (int i = 0; i < num && !hit; i++) {
+      hit = strlen(site->key[i]) == kl && !strncmp(site->key[i], filters[f], kl)
+            && !strcmp(vals[i].text, eq + 1);
+    }
+    if (!hit) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief decode and output a frame payload
+ */
+static void put_record(const uint8_t *p,
+                       size_t        len)
+{
+  const uint8_t *end = p + len;
+  value_t       vals[FIELD_MAX];
+  site_t        site;
+  uint64_t      off, t = 0;
+  int           lvl, has_time, major, num = 0;
+  const char    *base;
+
+  if (!len) {
+    return;
+  }
+  lvl      = *p & 0x7;
+  has_time = *p & 0x8;
+  p++;
+  if (get_head(&p, end, &major, &off) || major || get_site(off, &site)
+      || (has_time && (get_head(&p, end, &major, &t) || major))) {
+    printf("--- key/value record of an unknown call site ---\n");
+    return;
+  }
+  /* Values cut short by the device are left out */
+  while (num < site.key_num && !get_value(&p, end, &vals[num])) {
+    num++;
+  }
+  if (lvl > max_lvl || !matches(&site, vals, num)) {
+    return;
+  }
+  base = strrchr(site.file, '/');
+  base = base ? base + 1 : site.file;
+  if (json) {
+    char ev[256];
+
+    put_escaped(ev, sizeof(ev), site.event, strlen(site.event), 1);
+    printf("{");
+    if (has_time) {
+      printf("\"time\":%llu,", (unsigned long long)t);
+    }
+    printf("\"level\":\"%s\",\"file\":\"%s\",\"line\":%s,\"event\":\"%s\",\"fields\":{",
+           lvl < 7 ? lvl_names[lvl] : "?", base, site.line, ev);
+    for (int i = 0; i < num; i++) {
+      printf(vals[i].quoted ? "%s\"%s\":\"%s\"" : "%s\"%s\":%s",
+             i ? "," : "", site.key[i], vals[i].text);
+    }
+    printf("}}\n");
+    return;
+  }
+  if (has_time) {
+    printf("[RT-%llu:%02u:%02u:%02u]", (unsigned long long)(t / 86400),
+           (unsigned)(t % 86400 / 3600), (unsigned)(t % 3600 / 60), (unsigned)(t % 60));
+  }
+  printf("[%s:%s][%s]: %s", base, site.line, lvl < 7 ? lvl_names[lvl] : "?", site.event);
+  for (int i = 0; i < num; i++) {
+    printf(" %s=%s", site.key[i], vals[i].text);
+  }
+  printf("\n");
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logkv [-j] [-k] [-e event] [-f key=value] [-l level] "
+          "firmware.elf [capture]\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  FILE *in = stdin;
+  int  i, c, text;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char *a = argv[i];
+
+    if (!strcmp(a, "-j")) {
+      json = 1;
+    } else if (!strcmp(a, "-k")) {
+      kv_only = 1;
+    } else if (!strcmp(a, "-e") && i + 1 < argc) {
+      event_filter = argv[++i];
+    } else if (!strcmp(a, "-f") && i + 1 < argc && filter_num < FILTER_MAX
+               && strchr(argv[i + 1], '=')) {
+      filters[filter_num++] = argv[++i];
+    } else if (!strcmp(a, "-l") && i + 1 < argc) {
+      max_lvl = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  if (i >= argc || argc - i > 2) {
+    usage();
+  }
+  if (load_sites(argv[i])) {
+    return 1;
+  }
+  if (argc - i == 2) {
+    in = fopen(argv[i + 1], "rb");
+    if (!in) {
+      perror(argv[i + 1]);
+      return 1;
+    }
+  }
+  text = !kv_only && !event_filter && !filter_num && max_lvl >= 7;
+
+  while ((c = getc(in)) != EOF) {
+    uint8_t frame[1 + 255 + 1];
+    int     len;
+
+    if (c != FRAME_START) {
+      if (text) {
+        putchar(c);
+      }
+      continue;
+    }
+    if ((len = getc(in)) == EOF
+        || fread(frame + 1, 1, (size_t)len + 1, in) != (size_t)len + 1) {
+      break;
+    }
+    frame[0] = (uint8_t)len;
+    if (logbin_crc8(frame, (size_t)len + 1) != frame[len + 1]) {
+      printf("--- corrupt key/value record ---\n");
+      continue;
+    }
+    put_record(frame + 1, (size_t)len);
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*************************************************************************
+ *  @file logmerge.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Merges the captures of the RTT up-buffers written with
+ *  RTT_PER_CONTEXT into one log ordered by the record timestamps.
+ *
+ *  Build: cc -O2 -o logmerge tools/logmerge.c
+ *
+ *  Usage: logmerge [-t] capture0 [capture1 ...]
+ *    -t  keep the context, sequence number and timestamp of every record as
+ *        a "<context>#<seq>@<timestamp> " prefix
+ *  Records a context lost, seen as gaps in its sequence numbers, are
+ *  reported inline. Each capture is read as a stream, so it works on
+ *  captures of any size.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Defines  *********************************************************** */
+#define REC_START               0x1E /**< Starts the record header */
+#define REC_BODY                0x1F /**< Ends the record header */
+#define HDR_LEN                 (16 + 1 + 8)
+
+/**
+ * @brief current record of a capture
+ */
+typedef struct {
+  FILE     *f;      /**< Capture */
+  int      eof;     /**< Capture is exhausted */
+  uint64_t ts;      /**< Timestamp of the record */
+  uint32_t seq;     /**< Sequence number of the record */
+  uint32_t next;    /**< Expected sequence number of the next record */
+  int      started; /**< A record has been read */
+  char     *body;   /**< Record body */
+  size_t   len;     /**< Body length */
+  size_t   cap;     /**< Body buffer size */
+}stream_t;
+
+/* Static Variables *************************************************** */
+static stream_t *streams;
+static int      *heap;
+static int      heap_len;
+
+/* Static Functions *************************************************** */
+static void append(stream_t *s,
+                   int      c)
+{
+  if (s->len == s->cap) {
+    s->cap  = s->cap ? s->cap * 2 : 256;
+    s->body = realloc(s->body, s->cap);
+    if (!s->body) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  s->body[s->len++] = (char)c;
+}
+
+static int parse_hex(const char *p,
+                     int        n,
+                     uint64_t   *v)
+{
+  *v = 0;
+  for (int i = 0; i < n; i++) {
+    int c = p[i];
+
+    *v <<= 4;
+    if (c >= '0' && c <= '9') {
+      *v |= (uint64_t)(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      *v |= (uint64_t)(c - 'a' + 10);
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief read the next record of a stream, bytes without a valid header are
+ * part of the previous record
+ *
+ * @return 0 on success, -1 at the end of the capture
+ */
+static int next_record(stream_t *s)
+{
+  int c;
+
+  s->len = 0;
+  for (;;) {
+    char     hdr[HDR_LEN + 1];
+    uint64_t ts, seq;
+
+    c = getc(s->f);
+    if (c == EOF) {
+      s->eof = 1;
+      return -1;
+    }
+    if (c != REC_START) {
+      continue;
+    }
+    if (fread(hdr, 1, sizeof(hdr), s->f) != sizeof(hdr)) {
+      s->eof = 1;
+      return -1;
+    }
+    if (hdr[16] == '.' && hdr[HDR_LEN] == REC_BODY
+        && !parse_hex(hdr, 16, &ts) && !parse_hex(hdr + 17, 8, &seq)) {
+      s->ts  = ts;
+      s->seq = (uint32_t)seq;
+      break;
+    }
+  }
+  /* Body runs up to the next header */
+  while ((c = getc(s->f)) != EOF && c != REC_START) {
+    append(s, c);
+  }
+  if (c == REC_START) {
+    ungetc(c, s->f);
+  }
+  return 0;
+}
+
+static int before(int a,
+                  int b)
+{
+  if (streams[a].ts != streams[b].ts) {
+    return streams[a].ts < streams[b].ts;
+  }
+  return a < b;
+}
+
+static void sift_down(int i)
+{
+  for (;;) {
+    int l = 2 * i + 1, r = l + 1, m = i, t;
+
+    if (l < heap_len && before(heap[l], heap[m])) {
+      m = l;
+    }
+    if (r < heap_len && before(heap[r], heap[m])) {
+      m = r;
+    }
+    if (m == i) {
+      return;
+    }
+    t       = heap[i];
+    heap[i] = heap[m];
+    heap[m] = t;
+    i       = m;
+  }
+}
+
+int main(int  argc,
+         char **argv)
+{
+  int tags = 0, n, first = 1;
+
+  if (argc > 1 && !strcmp(argv[1], "-t")) {
+    tags  = 1;
+    first = 2;
+  }
+  n = argc - first;
+  if (n < 1) {
+    fprintf(stderr, "usage: logmerge [-t] capture0 [capture1 ...]\n");
+    return 2;
+  }
+  streams = calloc((size_t)n, sizeof(stream_t));
+  heap    = calloc((size_t)n, sizeof(int));
+  for (int i = 0; i < n; i++) {
+    streams[i].f = fopen(argv[first + i], "rb");
+    if (!streams[i].f) {
+      perror(argv[first + i]);
+      return 1;
+    }
+    if (!next_record(&streams[i])) {
+      heap[heap_len++] = i;
+    }
+  }
+  for (int i = heap_len / 2 - 1; i >= 0; i--) {
+    sift_down(i);
+  }
+
+  /* k-way merge, the records of a context are in timestamp order already */
+  while (heap_len) {
+    int      i  = heap[0];
+    stream_t *s = &streams[i];
+
+    if (s->started && s->seq != s->next) {
+      printf("--- context %d: %lu records lost ---\n", i,
+             (unsigned long)(uint32_t)(s->seq - s->next));
+    }
+    s->started = 1;
+    s->next    = s->seq + 1;
+    if (tags) {
+      printf("%d#%lu@%llu ", i, (unsigned long)s->seq, (unsigned long long)s->ts);
+    }
+    fwrite(s->body, 1, s->len, stdout);
+    if (next_record(s)) {
+      heap[0] = heap[--heap_len];
+    }
+    sift_down(0);
+  }
+  for (int i = 0; i < n; i++) {
+    fclose(streams[i].f);
+    free(streams[i].body);
+  }
+  free(streams);
+  free(heap);
+  return 0;
+}
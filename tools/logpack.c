@@ -0,0 +1,171 @@
+/*************************************************************************
+ *  @file logpack.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Packs a capture of the logging output into a block capture, which
+ *  logdec decodes on all cores. The capture is cut into blocks on record
+ *  boundaries, and every block starts with a header holding the build ID and
+ *  the timestamp rate of the sync record before it, the timestamp of its
+ *  first record and its record count, so it decodes on its own. A new block
+ *  is started at every sync record. The ELF file isn't needed, the records
+ *  are only split, not formatted, so it keeps up with a live capture, e.g.
+ *  from the RTT telnet port of a J-Link.
+ *
+ *  Build: cc -O2 -o logpack tools/logpack.c tools/logbin.c
+ *
+ *  Usage: logpack [options] [capture] > capture.lbc
+ *    -b <KiB>  payload size of a block, 1024 by default
+ *    -s        statistics on stderr at the end
+ *  The capture is read from stdin if not given.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define READ_LEN                (1u << 20)
+
+/* Static Variables *************************************************** */
+static logbin_block_t blk;
+static uint8_t        *payload;
+static size_t         payload_cap = 1u << 20;
+static uint64_t       n_blocks, n_records, n_bytes, n_out;
+
+/* Static Functions *************************************************** */
+
+/**
+ * @brief write the block being filled, if any, and start the next one
+ */
+static void flush_block(void)
+{
+  uint8_t head[LOGBIN_BLOCK_HEAD];
+
+  if (!blk.len) {
+    return;
+  }
+  logbin_block_head(head, &blk);
+  fwrite(head, 1, sizeof(head), stdout);
+  fwrite(payload, 1, blk.len, stdout);
+  n_out      += sizeof(head) + blk.len;
+  n_blocks++;
+  blk.len     = 0;
+  blk.ts      = 0;
+  blk.records = 0;
+}
+
+/**
+ * @brief add the items of a buffer to the blocks
+ *
+ * @param p - capture bytes
+ * @param len - number of bytes
+ * @param eof - non-zero if no more bytes follow
+ *
+ * @return bytes taken, the rest is an incomplete frame
+ */
+static size_t pack(const uint8_t *p,
+                   size_t        len,
+                   int           eof)
+{
+  size_t used = 0;
+
+  while (used < len) {
+    logbin_item_t it;
+    size_t        n = logbin_next(p + used, len - used, eof, &it);
+
+    if (it.kind == LOGBIN_MORE) {
+      break;
+    }
+    if (it.kind == LOGBIN_SYNCED) {
+      flush_block();
+      blk.build_id = it.build_id;
+      blk.hz       = it.hz;
+    }
+    /* Frames are kept whole, the bytes between them may be split */
+    if (it.kind == LOGBIN_BYTES) {
+      n = n < payload_cap - blk.len ? n : payload_cap - blk.len;
+    } else if (blk.len + n > payload_cap) {
+      flush_block();
+    }
+    if (it.kind == LOGBIN_RECORD) {
+      blk.ts = blk.records ? blk.ts : it.ts;
+      blk.records++;
+      n_records++;
+    }
+    memcpy(payload + blk.len, p + used, n);
+    blk.len += (uint32_t)n;
+    used    += n;
+    if (blk.len == payload_cap) {
+      flush_block();
+    }
+  }
+  return used;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logpack [-b KiB] [-s] [capture]\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  FILE    *in = stdin;
+  uint8_t *buf;
+  size_t  len = 0, n, used;
+  int     i, stats = 0;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      payload_cap = (size_t)atoi(argv[++i]) << 10;
+      if (payload_cap < LOGBIN_FRAME_MAX || payload_cap > LOGBIN_BLOCK_MAX) {
+        fprintf(stderr, "logpack: block size out of range\n");
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (argc - i > 1) {
+    usage();
+  }
+  if (argc - i == 1) {
+    in = fopen(argv[i], "rb");
+    if (!in) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+  buf     = malloc(READ_LEN + LOGBIN_FRAME_MAX);
+  payload = malloc(payload_cap);
+  if (!buf || !payload) {
+    return 1;
+  }
+
+  /* Incomplete frames at the end of a read are kept for the next one */
+  do {
+    n        = fread(buf + len, 1, READ_LEN, in);
+    len     += n;
+    n_bytes += n;
+    used     = pack(buf, len, n == 0);
+    memmove(buf, buf + used, len - used);
+    len -= used;
+  } while (n);
+  flush_block();
+  fflush(stdout);
+  if (in != stdin) {
+    fclose(in);
+  }
+
+  if (stats) {
+    fprintf(stderr, "logpack: %llu bytes, %llu records in %llu blocks, %llu bytes out\n",
+            (unsigned long long)n_bytes, (unsigned long long)n_records,
+            (unsigned long long)n_blocks, (unsigned long long)n_out);
+  }
+  return 0;
+}
@@ -0,0 +1,341 @@
+/*************************************************************************
+ *  @file logquery.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Searches an archive written by logarc. The archive is mapped, and
+ *  the index entry of every block is checked first: a block is skipped if
+ *  its time range, its record count per level, its bloom filter of call
+ *  sites with their levels or its token bloom filter shows nothing in it can
+ *  match. Only the blocks left are decompressed, and their records are
+ *  checked one by one and formatted as logdec does.
+ *
+ *  Build: cc -O2 -o logquery tools/logquery.c tools/logbin.c
+ *
+ *  Usage: logquery [options] firmware.elf archive.lba
+ *    -l <level>      only the records of this level or above, 0 to 6 or FTL,
+ *                    ERR, WRN, IPM, DHL, DBG, VER
+ *    -f <file>       only the records of this file, e.g. gatt.c or gatt
+ *    -t <from,to>    only the records in this time range, in seconds or
+ *                    [d:]hh:mm[:ss] since the start of the target, either
+ *                    may be left out. Taken as ticks in the blocks without a
+ *                    timestamp rate
+ *    -g <token>      only the records with this token in their message, a
+ *                    run of letters, digits and '_', case insensitive. Can
+ *                    be repeated, all must be found
+ *    -m              no colors, the level flags are rendered as "[ERR]"
+ *    -w <n>          width of the file name, FILE_NAME_LENGTH, 10 by default
+ *    -i              go on if the build ID of the archive doesn't match
+ *    -s              statistics on stderr at the end
+ *  Any filter drops the text between the records as well.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define TOKEN_NUM               8
+
+/* Static Variables *************************************************** */
+static const char *const lvl_names[] = { "FTL", "ERR", "WRN", "IPM", "DHL", "DBG", "VER" };
+
+static logbin_elf_t   elf;
+static logbin_style_t style = { .color = 1, .name_width = 10 };
+static logbin_out_t   out, msg;
+static int            max_lvl = 7;
+static const char     *file_filter;
+static uint8_t        *site_map;         /* Non-zero at the offsets of the sites of the file */
+static uint64_t       *sites;
+static size_t         site_num;
+static double         t_from = -1, t_to = -1;
+static char           tokens[TOKEN_NUM][LOGBIN_TOKEN_MAX];
+static size_t         token_len[TOKEN_NUM], token_num;
+
+/* Static Functions *************************************************** */
+
+/**
+ * @brief parse a time, seconds or [d:]hh:mm[:ss], the seconds may have a
+ * fraction
+ *
+ * @return seconds, -1 if empty
+ */
+static double parse_time(const char *s)
+{
+  static const double unit[4][4] = {
+    { 1 }, { 3600, 60 }, { 3600, 60, 1 }, { 86400, 3600, 60, 1 }
+  };
+  double v = 0, f[4];
+  int    n = 0;
+  char   *e;
+
+  if (!*s || *s == ',') {
+    return -1;
+  }
+  do {
+    f[n++] = strtod(s, &e);
+    s      = e + 1;
+  } while (*e == ':' && n < 4);
+  for (int i = 0; i < n; i++) {
+    v += f[i] * unit[n - 1][i];
+  }
+  return v;
+}
+
+/**
+ * @brief mark the call sites of the file filtered on, walking the call site
+ * descriptors of the logging_fmt section
+ */
+static void find_sites(void)
+{
+  size_t        want = strcspn(file_filter, ".");
+  logbin_site_t site;
+
+  site_map = calloc(1, elf.fmt_len ? elf.fmt_len : 1);
+  sites    = calloc(elf.fmt_len / 4 + 1, sizeof(*sites));
+  for (uint64_t off = 0, next; (next = logbin_site_next(&elf, &off, &site)); off = next) {
+    const char *stem, *c;
+
+    for (stem = c = site.file; *c; c++) {
+      if (*c == '/' || *c == '\\') {
+        stem = c + 1;
+      }
+    }
+    if (strcspn(stem, ".") == want && !strncmp(stem, file_filter, want)) {
+      site_map[off]     = 1;
+      sites[site_num++] = off;
+    }
+  }
+}
+
+/**
+ * @brief check if a timestamp range overlaps the range filtered on
+ */
+static int in_time(uint64_t lo,
+                   uint64_t hi,
+                   uint64_t hz)
+{
+  double k = hz ? (double)hz : 1;
+
+  return !(t_from >= 0 && (double)hi < t_from * k) && !(t_to >= 0 && (double)lo > t_to * k);
+}
+
+/**
+ * @brief check if a message has all the tokens filtered on
+ */
+static int has_tokens(const char *s,
+                      size_t     len)
+{
+  unsigned   found = 0;
+  const char *end  = s + len;
+  char       tok[LOGBIN_TOKEN_MAX];
+  size_t     n;
+
+  while ((n = logbin_token(&s, end, tok))) {
+    for (size_t i = 0; i < token_num; i++) {
+      if (n == token_len[i] && !memcmp(tok, tokens[i], n)) {
+        found |= 1u << i;
+      }
+    }
+  }
+  return found == (1u << token_num) - 1;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logquery [-l level] [-f file] [-t from,to] [-g token] [-m] [-w width] "
+          "[-i] [-s] firmware.elf archive.lba\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  const logbin_arc_head_t *h;
+  const uint8_t           *map;
+  struct stat             st;
+  struct timespec         start, stop;
+  int                     i, fd, ignore_id = 0, stats = 0, filtered;
+  size_t                  stride, bloom_len;
+  uint8_t                 *raw;
+  uint64_t                n_index = 0, n_site = 0, n_token = 0, n_read = 0, n_match = 0;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char *a = argv[i];
+
+    if (!strcmp(a, "-l") && i + 1 < argc) {
+      a       = argv[++i];
+      max_lvl = isdigit((unsigned char)a[0]) ? atoi(a) : -1;
+      for (int k = 0; k < 7 && max_lvl < 0; k++) {
+        max_lvl = strcasecmp(a, lvl_names[k]) ? -1 : k;
+      }
+      if (max_lvl < 0) {
+        usage();
+      }
+    } else if (!strcmp(a, "-f") && i + 1 < argc) {
+      file_filter = argv[++i];
+    } else if (!strcmp(a, "-t") && i + 1 < argc) {
+      a      = argv[++i];
+      t_from = parse_time(a);
+      t_to   = strchr(a, ',') ? parse_time(strchr(a, ',') + 1) : -1;
+    } else if (!strcmp(a, "-g") && i + 1 < argc && token_num < TOKEN_NUM) {
+      const char *s = argv[++i];
+
+      token_len[token_num] = logbin_token(&s, s + strlen(s), tokens[token_num]);
+      token_num           += token_len[token_num] != 0;
+    } else if (!strcmp(a, "-m")) {
+      style.color = 0;
+    } else if (!strcmp(a, "-w") && i + 1 < argc) {
+      style.name_width = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(a, "-i")) {
+      ignore_id = 1;
+    } else if (!strcmp(a, "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (argc - i != 2) {
+    usage();
+  }
+  if (logbin_load(&elf, argv[i])) {
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  fd = open(argv[i + 1], O_RDONLY);
+  if (fd < 0 || fstat(fd, &st)) {
+    perror(argv[i + 1]);
+    return 1;
+  }
+  map = (size_t)st.st_size >= sizeof(*h)
+        ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  h   = (const logbin_arc_head_t *)map;
+  if (map == MAP_FAILED || memcmp(h->magic, LOGBIN_ARC_MAGIC, sizeof(h->magic))) {
+    fprintf(stderr, "%s: not an archive\n", argv[i + 1]);
+    return 1;
+  }
+  bloom_len = (h->site_bits + h->token_bits) / 8;
+  stride    = sizeof(logbin_arc_block_t) + bloom_len;
+  if (h->index > (uint64_t)st.st_size || h->blocks > ((uint64_t)st.st_size - h->index) / stride) {
+    fprintf(stderr, "%s: index cut short\n", argv[i + 1]);
+    return 1;
+  }
+  if (h->build_id != elf.build_id) {
+    fprintf(stderr, "logquery: build ID %016llx of the archive doesn't match %016llx of the "
+            "ELF file\n", (unsigned long long)h->build_id, (unsigned long long)elf.build_id);
+    if (!ignore_id) {
+      return 1;
+    }
+  }
+  if (file_filter) {
+    find_sites();
+  }
+  filtered = max_lvl < 7 || file_filter || t_from >= 0 || t_to >= 0 || token_num;
+  raw      = malloc(h->block_len ? h->block_len : 1);
+  if (!raw) {
+    return 1;
+  }
+
+  for (uint32_t b = 0; b < h->blocks; b++) {
+    const logbin_arc_block_t *e     = (const logbin_arc_block_t *)(map + h->index + b * stride);
+    const uint8_t            *sbits = (const uint8_t *)(e + 1);
+    const uint8_t            *tbits = sbits + h->site_bits / 8;
+    uint32_t                 lvl_records = 0;
+    long                     len;
+    int                      hit;
+
+    /* The index entry first, the blocks which can't match aren't read */
+    for (int l = 0; l <= max_lvl && l < LOGBIN_LEVELS; l++) {
+      lvl_records += e->levels[l];
+    }
+    if (filtered && (!lvl_records || !in_time(e->ts_min, e->ts_max, e->hz))) {
+      n_index++;
+      continue;
+    }
+    hit = !file_filter;
+    for (size_t k = 0; k < site_num && !hit; k++) {
+      for (uint64_t l = 0, key; l <= (uint64_t)max_lvl && !hit; l++) {
+        key = sites[k] << 3 | l;
+        hit = logbin_bloom_test(sbits, h->site_bits, &key, sizeof(key));
+      }
+    }
+    if (!hit) {
+      n_site++;
+      continue;
+    }
+    for (size_t k = 0; k < token_num && hit; k++) {
+      hit = logbin_bloom_test(tbits, h->token_bits, tokens[k], token_len[k]);
+    }
+    if (!hit) {
+      n_token++;
+      continue;
+    }
+    if (e->offset > (uint64_t)st.st_size || e->clen > (uint64_t)st.st_size - e->offset) {
+      fprintf(stderr, "logquery: block %u cut short\n", b);
+      break;
+    }
+    len = logbin_lz_decompress(raw, h->block_len, map + e->offset, e->clen);
+    if (len < 0) {
+      fprintf(stderr, "logquery: block %u is corrupt\n", b);
+      continue;
+    }
+    n_read++;
+
+    style.hz = e->hz;
+    for (size_t used = 0, n; used < (size_t)len; used += n) {
+      logbin_item_t it;
+      logbin_site_t site;
+
+      n = logbin_next(raw + used, (size_t)len - used, 1, &it);
+      if (it.kind != LOGBIN_RECORD) {
+        if (!filtered) {
+          logbin_write(&out, raw + used, n);
+        }
+        continue;
+      }
+      if (it.lvl > max_lvl || !in_time(it.ts, it.ts, e->hz)
+          || (file_filter && (it.site >= elf.fmt_len || !site_map[it.site]))) {
+        continue;
+      }
+      if (token_num) {
+        msg.len = 0;
+        if (logbin_site(&elf, it.site, &site)) {
+          continue;
+        }
+        logbin_format(&msg, elf.word, site.fmt, it.args, it.args_len);
+        if (!has_tokens(msg.p, msg.len)) {
+          continue;
+        }
+      }
+      logbin_render(&out, &elf, &style, &it);
+      n_match++;
+    }
+    fwrite(out.p, 1, out.len, stdout);
+    out.len = 0;
+  }
+  fflush(stdout);
+
+  if (stats) {
+    double s;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    s = (double)(stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "logquery: %u blocks, %llu skipped by time or level, %llu by file, "
+            "%llu by token, %llu read, %llu records found in %.3f ms\n",
+            h->blocks, (unsigned long long)n_index, (unsigned long long)n_site,
+            (unsigned long long)n_token, (unsigned long long)n_read,
+            (unsigned long long)n_match, s * 1e3);
+  }
+  munmap((void *)map, (size_t)st.st_size);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*************************************************************************
+ *  @file logrender.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Renders the records of a capture of the logging output built with
+ *  COMPACT_ON as the colored text the device emits without it, restoring the
+ *  level flags, the brackets and the alignment of the location. Everything
+ *  else, the plain text, the key/value frames of KV_ON and the headers of
+ *  RTT_PER_CONTEXT, is passed through as it is, so the output can be piped
+ *  into logkv or split by logmerge.
+ *
+ *  Build: cc -O2 -o logrender tools/logrender.c
+ *
+ *  Usage: logrender [options] [capture]
+ *    -m      no colors, the level flags are rendered as "[ERR]"
+ *    -n      the records have no location, LOCATION_ON is 0, so a message
+ *            starting with "name:123 " isn't taken as one
+ *    -w <n>  width of the file name, FILE_NAME_LENGTH, 10 by default
+ *  The capture is read from stdin if not given, as a stream, so it works on
+ *  live output too, e.g. from the RTT telnet port of a J-Link.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Defines  *********************************************************** */
+#define LEVEL_CODE_BASE         0x10
+#define LEVEL_NUM               7
+#define KV_START                0x1D /**< Starts a key/value frame */
+#define REC_START               0x1E /**< Starts a per-context record header */
+#define REC_BODY                0x1F /**< Ends a per-context record header */
+#define HEAD_MAX                64
+
+/* Static Variables *************************************************** */
+static const char *const flags[LEVEL_NUM] = {
+  "[\x1b[4;41mFTL\x1b[0m]",
+  "[\x1b[1;31mERR\x1b[0m]",
+  "[\x1b[4;45mWRN\x1b[0m]",
+  "[\x1b[4;46mIPM\x1b[0m]",
+  "[\x1b[1;33mDHL\x1b[0m]",
+  "[\x1b[1;32mDBG\x1b[0m]",
+  "[VER]"
+};
+static const char *const names[LEVEL_NUM] = {
+  "FTL", "ERR", "WRN", "IPM", "DHL", "DBG", "VER"
+};
+static int mono, no_location, name_width = 10;
+
+/* Static Functions Definitions ************************************** */
+
+/**
+ * @brief time_len length of the time field at the start of a record head.
+ *
+ * @param s - record head after the level code
+ * @param len - length of the head
+ *
+ * @return length of the time without the space after it, 0 if there is none
+ */
+static size_t time_len(const char *s,
+                       size_t     len)
+{
+  size_t n;
+
+  /* RT-d:hh:mm:ss */
+  if (len > 3 && !memcmp(s, "RT-", 3)) {
+    for (n = 3; n < len && s[n] != ' '; n++) {
+      if (!isdigit((unsigned char)s[n]) && s[n] != ':') {
+        return 0;
+      }
+    }
+    return n < len ? n : 0;
+  }
+  /* yyyy-mm-dd hh:mm:ss */
+  if (len > 19 && s[19] == ' ' && s[4] == '-' && s[7] == '-' && s[10] == ' '
+      && s[13] == ':' && s[16] == ':') {
+    for (n = 0; n < 19; n++) {
+      if (!isdigit((unsigned char)s[n]) && !strchr("-: ", s[n])) {
+        return 0;
+      }
+    }
+    return 19;
+  }
+  return 0;
+}
+
+/**
+ * @brief location_len length of the location field, name:line, at the start
+ * of what is left of a record head.
+ *
+ * @param s - record head after the time
+ * @param len - length left
+ * @param colon - set to the offset of the ':'
+ *
+ * @return length of the location without the space after it, 0 if there is
+ * none
+ */
+static size_t location_len(const char *s,
+                           size_t     len,
+                           size_t     *colon)
+{
+  size_t n = 0;
+
+  while (n < len && s[n] != ':' && s[n] != ' ') {
+    n++;
+  }
+  if (!n || n >= len || s[n] != ':') {
+    return 0;
+  }
+  *colon = n++;
+  if (n >= len || !isdigit((unsigned char)s[n])) {
+    return 0;
+  }
+  while (n < len && isdigit((unsigned char)s[n])) {
+    n++;
+  }
+  return n < len && s[n] == ' ' ? n : 0;
+}
+
+/**
+ * @brief render_head print the head of a record as the text mode does,
+ * [time][      name:line ][FLG]: , the message follows as it is.
+ *
+ * @param lvl - level of the record
+ * @param s - head after the level code, the start of the message may follow
+ * @param len - bytes read after the level code
+ *
+ * @return bytes of s consumed by the head
+ */
+static size_t render_head(int        lvl,
+                          const char *s,
+                          size_t     len)
+{
+  size_t used = 0, n, colon;
+
+  n = time_len(s, len);
+  if (n) {
+    printf("[%.*s]", (int)n, s);
+    used = n + 1;
+  }
+  if (!no_location) {
+    n = location_len(s + used, len - used, &colon);
+    if (n) {
+      printf("[%*.*s:%-5.*s]",
+             name_width, (int)colon, s + used,
+             (int)(n - colon - 1), s + used + colon + 1);
+      used += n + 1;
+    }
+  }
+  if (mono) {
+    printf("[%s]: ", names[lvl]);
+  } else {
+    fputs(flags[lvl], stdout);
+    fputs(": ", stdout);
+  }
+  return used;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logrender [-m] [-n] [-w width] [capture]\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  FILE *in = stdin;
+  int  i, c, lvl;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if (!strcmp(argv[i], "-m")) {
+      mono = 1;
+    } else if (!strcmp(argv[i], "-n")) {
+      no_location = 1;
+    } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+      name_width = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  if (argc - i > 1) {
+    usage();
+  }
+  if (argc - i == 1) {
+    in = fopen(argv[i], "rb");
+    if (!in) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+
+  while ((c = getc(in)) != EOF) {
+    char   head[HEAD_MAX];
+    size_t len = 0, used;
+
+    if (c == KV_START) {
+      /* Length, payload and CRC, binary */
+      int n = getc(in);
+
+      putchar(c);
+      if (n == EOF) {
+        break;
+      }
+      putchar(n);
+      for (n++; n > 0 && (c = getc(in)) != EOF; n--) {
+        putchar(c);
+      }
+      continue;
+    }
+    if (c == REC_START) {
+      do {
+        putchar(c);
+      } while (c != REC_BODY && (c = getc(in)) != EOF);
+      continue;
+    }
+    if (c < LEVEL_CODE_BASE || c >= LEVEL_CODE_BASE + LEVEL_NUM) {
+      putchar(c);
+      continue;
+    }
+    lvl = c - LEVEL_CODE_BASE;
+
+    /*
+     * Read enough for the time and location, up to the end of the line or
+     * the start of the next record if this one was cut short
+     */
+    while (len < sizeof(head) && (c = getc(in)) != EOF) {
+      if (c == KV_START || c == REC_START
+          || (c >= LEVEL_CODE_BASE && c < LEVEL_CODE_BASE + LEVEL_NUM)) {
+        ungetc(c, in);
+        break;
+      }
+      head[len++] = (char)c;
+      if (c == '\n') {
+        break;
+      }
+    }
+    used = render_head(lvl, head, len);
+    fwrite(head + used, 1, len - used, stdout);
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+  return 0;
+}
@@ -0,0 +1,352 @@
+/*************************************************************************
+ *  @file logtail.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Follows a capture of the logging output with the binary records of
+ *  BINARY_ON while it is written, e.g. by the RTT logger of a J-Link. The
+ *  file is mapped, and only the bytes added since the last look are decoded.
+ *  The records are filtered on their level and call site before they are
+ *  formatted, and on a regular expression over their message before they
+ *  are rendered, so a busy capture costs little when most of it is dropped.
+ *  On Linux the file is watched with inotify and the new records are shown
+ *  as soon as they are written, elsewhere it is polled every POLL_US.
+ *
+ *  Build: cc -O2 -o logtail tools/logtail.c tools/logbin.c
+ *
+ *  Usage: logtail [options] firmware.elf capture
+ *    -l <level>      only the records of this level or above, 0 to 6 or FTL,
+ *                    ERR, WRN, IPM, DHL, DBG, VER
+ *    -f <module>     only the records of this module, the file name without
+ *                    path and extension. Can be repeated
+ *    -p <file:line>  only the records of this call site, e.g. gatt.c:120.
+ *                    Can be repeated
+ *    -e <regex>      only the records with a message matching this extended
+ *                    regular expression
+ *    -a              from the start of the capture instead of its end
+ *    -n              don't follow, exit at the end of the capture
+ *    -m              no colors, the level flags are rendered as "[ERR]"
+ *    -w <n>          width of the file name, FILE_NAME_LENGTH, 10 by default
+ *    -r <hz>         timestamp ticks per second, if the sync records have none
+ *    -s              statistics on stderr at the end, on SIGINT as well
+ *  Any filter drops the text between the records as well.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include <regex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define FILTER_MAX              16
+#define POLL_US                 200
+#define MAP_STEP                (1ull << 30) /**< The mapping grows in steps, it may outsize the file */
+
+/* Static Variables *************************************************** */
+static const char *const lvl_names[] = { "FTL", "ERR", "WRN", "IPM", "DHL", "DBG", "VER" };
+
+static logbin_elf_t   elf;
+static logbin_style_t style = { .color = 1, .name_width = 10 };
+static logbin_out_t   out, msg;
+static int            max_lvl = 7, filtered;
+static const char     *modules[FILTER_MAX], *sites[FILTER_MAX];
+static int            module_num, site_num;
+static uint8_t        *site_ok;          /* Non-zero at the offsets of the sites shown */
+static regex_t        re;
+static int            has_re;
+static uint64_t       fixed_hz;
+static volatile sig_atomic_t stop;
+static uint64_t       n_shown, n_dropped, n_batches;
+static double         lat_sum, lat_max;
+
+/* Static Functions *************************************************** */
+
+static double now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+
+/**
+ * @brief mark the call sites which pass the module and call site filters,
+ * so a record is checked with a lookup
+ */
+static void find_sites(void)
+{
+  logbin_site_t site;
+
+  site_ok = calloc(1, elf.fmt_len ? elf.fmt_len : 1);
+  if (!site_ok) {
+    exit(1);
+  }
+  for (uint64_t off = 0, next; (next = logbin_site_next(&elf, &off, &site)); off = next) {
+    const char *stem = site.file, *c;
+    size_t     stem_len, file_len;
+    int        ok = !module_num, at = !site_num;
+
+    for (c = site.file; *c; c++) {
+      stem = *c == '/' || *c == '\\' ? c + 1 : stem;
+    }
+    file_len = strlen(stem);
+    stem_len = strcspn(stem, ".");
+    for (int i = 0; i < module_num && !ok; i++) {
+      ok = strlen(modules[i]) == stem_len && !strncmp(modules[i], stem, stem_len);
+    }
+    for (int i = 0; i < site_num && !at; i++) {
+      const char *colon = strrchr(sites[i], ':');
+
+      at = colon && (size_t)(colon - sites[i]) == file_len && !strncmp(sites[i], stem, file_len)
+           && !strcmp(colon + 1, site.line);
+    }
+    site_ok[off] = ok && at;
+  }
+}
+
+/**
+ * @brief decode the items of the new bytes
+ *
+ * @param p - capture bytes
+ * @param len - number of bytes
+ * @param show - zero to only take the rate of the sync records, when
+ * skipping to the end of the capture
+ *
+ * @return bytes decoded, the rest is an incomplete frame
+ */
+static size_t tail(const uint8_t *p,
+                   size_t        len,
+                   int           show)
+{
+  size_t used = 0;
+
+  while (used < len) {
+    logbin_item_t it;
+    logbin_site_t site;
+    char          *nl;
+    int           hit;
+    size_t        n = logbin_next(p + used, len - used, 0, &it);
+
+    if (it.kind == LOGBIN_MORE) {
+      break;
+    }
+    used += n;
+    if (it.kind == LOGBIN_SYNCED) {
+      if (it.build_id != elf.build_id) {
+        fprintf(stderr, "logtail: build ID %016llx of the capture doesn't match "
+                "%016llx of the ELF file\n",
+                (unsigned long long)it.build_id, (unsigned long long)elf.build_id);
+      }
+      style.hz = fixed_hz ? fixed_hz : it.hz;
+      continue;
+    }
+    if (!show) {
+      continue;
+    }
+    if (it.kind != LOGBIN_RECORD) {
+      if (!filtered) {
+        logbin_write(&out, p + used - n, n);
+      }
+      continue;
+    }
+
+    /* The fields first, the message is only formatted for the records left */
+    if (it.lvl > max_lvl
+        || ((module_num || site_num) && (it.site >= elf.fmt_len || !site_ok[it.site]))) {
+      n_dropped++;
+      continue;
+    }
+    if (!has_re) {
+      logbin_render(&out, &elf, &style, &it);
+      n_shown++;
+      continue;
+    }
+    if (logbin_site(&elf, it.site, &site)) {
+      n_dropped++;
+      continue;
+    }
+    /* Matched without the newline, so '$' is the end of the message */
+    msg.len = 0;
+    logbin_format(&msg, elf.word, site.fmt, it.args, it.args_len);
+    logbin_write(&msg, "", 1);
+    nl = msg.len > 1 && msg.p[msg.len - 2] == '\n' ? msg.p + msg.len - 2 : NULL;
+    if (nl) {
+      *nl = '\0';
+    }
+    hit = !regexec(&re, msg.p, 0, NULL, 0);
+    if (nl) {
+      *nl = '\n';
+    }
+    if (!hit) {
+      n_dropped++;
+      continue;
+    }
+    logbin_render_head(&out, &elf, &style, &it, &site);
+    logbin_write(&out, msg.p, msg.len - 1);
+    n_shown++;
+  }
+  return used;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logtail [-l level] [-f module] [-p file:line] [-e regex] [-a] [-n] [-m] "
+          "[-w width] [-r hz] [-s] firmware.elf capture\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  const uint8_t *map = MAP_FAILED;
+  size_t        map_len = 0;
+  uint64_t      pos = 0;
+  struct stat   st;
+  int           i, fd, wd = -1, from_start = 0, follow = 1, stats = 0;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char *a = argv[i];
+
+    if (!strcmp(a, "-l") && i + 1 < argc) {
+      a       = argv[++i];
+      max_lvl = isdigit((unsigned char)a[0]) ? atoi(a) : -1;
+      for (int k = 0; k < 7 && max_lvl < 0; k++) {
+        max_lvl = strcasecmp(a, lvl_names[k]) ? -1 : k;
+      }
+      if (max_lvl < 0) {
+        usage();
+      }
+    } else if (!strcmp(a, "-f") && i + 1 < argc && module_num < FILTER_MAX) {
+      modules[module_num++] = argv[++i];
+    } else if (!strcmp(a, "-p") && i + 1 < argc && site_num < FILTER_MAX) {
+      sites[site_num++] = argv[++i];
+    } else if (!strcmp(a, "-e") && i + 1 < argc) {
+      if (regcomp(&re, argv[++i], REG_EXTENDED | REG_NOSUB)) {
+        fprintf(stderr, "logtail: bad regular expression\n");
+        return 2;
+      }
+      has_re = 1;
+    } else if (!strcmp(a, "-a")) {
+      from_start = 1;
+    } else if (!strcmp(a, "-n")) {
+      follow = 0;
+    } else if (!strcmp(a, "-m")) {
+      style.color = 0;
+    } else if (!strcmp(a, "-w") && i + 1 < argc) {
+      style.name_width = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(a, "-r") && i + 1 < argc) {
+      fixed_hz = style.hz = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(a, "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (argc - i != 2) {
+    usage();
+  }
+  if (logbin_load(&elf, argv[i])) {
+    return 1;
+  }
+  filtered = max_lvl < 7 || module_num || site_num || has_re;
+  if (module_num || site_num) {
+    find_sites();
+  }
+  fd = open(argv[i + 1], O_RDONLY);
+  if (fd < 0) {
+    perror(argv[i + 1]);
+    return 1;
+  }
+#ifdef __linux__
+  int ino = inotify_init1(IN_NONBLOCK);
+
+  wd = ino < 0 ? -1 : inotify_add_watch(ino, argv[i + 1], IN_MODIFY);
+#endif
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  /* Without -a, the capture is only scanned for the rate up to its end */
+  for (int first = 1; !stop; first = 0) {
+    double t0 = now();
+    size_t used;
+
+    if (fstat(fd, &st)) {
+      break;
+    }
+    if ((uint64_t)st.st_size < pos) {
+      fprintf(stderr, "logtail: capture truncated, from its start again\n");
+      pos = 0;
+    }
+    if ((uint64_t)st.st_size > pos) {
+      if ((size_t)st.st_size > map_len) {
+        if (map != MAP_FAILED) {
+          munmap((void *)map, map_len);
+        }
+        map_len = ((size_t)st.st_size + MAP_STEP - 1) / MAP_STEP * MAP_STEP;
+        map     = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+          perror(argv[i + 1]);
+          return 1;
+        }
+      }
+      used = tail(map + pos, (size_t)st.st_size - pos, from_start || !first);
+      pos += used;
+      if (out.len) {
+        fwrite(out.p, 1, out.len, stdout);
+        fflush(stdout);
+        out.len = 0;
+        t0      = now() - t0;
+        lat_sum += t0;
+        lat_max  = t0 > lat_max ? t0 : lat_max;
+        n_batches++;
+      }
+    }
+    if (!follow) {
+      break;
+    }
+
+    /* Wait for more, woken by the writes if inotify is there */
+#ifdef __linux__
+    if (wd >= 0) {
+      struct pollfd pfd = { .fd = ino, .events = POLLIN };
+      char          ev[4096];
+
+      if (poll(&pfd, 1, 100) > 0) {
+        while (read(ino, ev, sizeof(ev)) > 0) {
+        }
+      }
+      continue;
+    }
+#endif
+    (void)wd;
+    usleep(POLL_US);
+  }
+
+  if (stats) {
+    fprintf(stderr, "logtail: %llu records shown, %llu dropped, %llu batches, "
+            "%.1f us per batch on average, %.1f us at most\n",
+            (unsigned long long)n_shown, (unsigned long long)n_dropped,
+            (unsigned long long)n_batches, n_batches ? lat_sum / n_batches * 1e6 : 0.0,
+            lat_max * 1e6);
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+/*************************************************************************
+ *  @file logunz.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Decompresses a capture of the logging output built with
+ *  COMPRESS_ON into the output the device emits without it, the text and
+ *  the binary frames, so it can be piped into logrender, logkv or logdec.
+ *  The frames are decompressed with the history of the device from the
+ *  first restart on, see COMPRESS_RESTART, so a capture started late skips
+ *  the frames before it. A line "--- compressed frames lost ---" marks where
+ *  frames went missing. The ELF file isn't needed.
+ *
+ *  Build: cc -O2 -o logunz tools/logunz.c tools/logbin.c
+ *
+ *  Usage: logunz [-s] [capture]
+ *    -s  statistics on stderr at the end
+ *  The capture is read from stdin if not given, as a stream, so it works on
+ *  live output too, e.g. from the RTT telnet port of a J-Link.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "logbin.h"
+
+/* Defines  *********************************************************** */
+#define READ_LEN                (64u << 10)
+#define FRAME_MAX               (6 + LOGBIN_LZ_BOUND(LOGBIN_LZ_RAW_MAX) + 1)
+
+/* Static Variables *************************************************** */
+static logbin_unz_t unz;
+static logbin_out_t out;
+static uint8_t      buf[FRAME_MAX + READ_LEN];
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: logunz [-s] [capture]\n");
+  exit(2);
+}
+
+int main(int  argc,
+         char **argv)
+{
+  uint64_t n_in = 0, n_out = 0;
+  size_t   len  = 0, used;
+  ssize_t  n;
+  int      i, fd = STDIN_FILENO, stats = 0;
+
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if (!strcmp(argv[i], "-s")) {
+      stats = 1;
+    } else {
+      usage();
+    }
+  }
+  if (argc - i > 1) {
+    usage();
+  }
+  if (argc - i == 1) {
+    fd = open(argv[i], O_RDONLY);
+    if (fd < 0) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+
+  /* Whatever arrives is decompressed at once, an incomplete frame waits */
+  do {
+    n     = read(fd, buf + len, READ_LEN);
+    n     = n < 0 ? 0 : n;
+    len  += (size_t)n;
+    n_in += (uint64_t)n;
+    used  = logbin_unz(&unz, buf, len, n == 0, &out);
+    memmove(buf, buf + used, len - used);
+    len -= used;
+    if (out.len) {
+      fwrite(out.p, 1, out.len, stdout);
+      fflush(stdout);
+      n_out  += out.len;
+      out.len = 0;
+    }
+  } while (n);
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+
+  if (stats) {
+    fprintf(stderr, "logunz: %llu bytes in, %llu bytes out, %llu frames, %llu lost, "
+            "%llu skipped, %llu bytes of junk\n",
+            (unsigned long long)n_in, (unsigned long long)n_out,
+            (unsigned long long)unz.frames, (unsigned long long)unz.lost,
+            (unsigned long long)unz.skipped, (unsigned long long)unz.junk);
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+#!/bin/sh
+#*************************************************************************
+#  @file lw_size.sh
+#  @author Kevin
+#  @date 2020-08-10
+#  @note Reports the code size of a LIGHT_WEIGHT call site with the header
+#  expanded inline and with LW_THUNK_ON, and the size of the shared code in
+#  logging.c each costs once.
+#
+#  Usage: tools/lw_size.sh [-D... options]
+#    The options are passed to the compiler, e.g. -DLOGGING_INTERFACE=VCOM.
+#    CC, SIZE and CFLAGS select the toolchain, e.g.
+#      CC=arm-none-eabi-gcc SIZE=arm-none-eabi-size \
+#      CFLAGS="-Os -mcpu=cortex-m4 -mthumb" tools/lw_size.sh
+#    Without sl_sleeptimer.h in CFLAGS a stub is used for TIME_ON.
+#  Run it from the repository root.
+#*************************************************************************
+
+CC=${CC:-cc}
+SIZE=${SIZE:-size}
+CFLAGS=${CFLAGS:--Os}
+SITES=64
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/sl_sleeptimer.h" <<EOF
+#include <stdint.h>
+static inline int sl_sleeptimer_init(void){return 0;}
+uint32_t sl_sleeptimer_get_time(void);
+EOF
+
+# Call sites of every level with 0 to 2 parameters
+{
+  echo '#include "logging.h"'
+  echo 'void sites(int a, const char *s)'
+  echo '{'
+  i=0
+  while [ $i -lt $SITES ]; do
+    case $((i % 4)) in
+      0) printf '  LOGI("site %d\\n");\n' $i ;;
+      1) printf '  LOGW("site %d %%d\\n", a);\n' $i ;;
+      2) printf '  LOGD("site %d %%d %%s\\n", a, s);\n' $i ;;
+      3) printf '  LOGH("site %d %%s\\n", s);\n' $i ;;
+    esac
+    i=$((i + 1))
+  done
+  echo '}'
+} > "$TMP/sites.c"
+echo 'void sites(int a, const char *s){(void)a; (void)s;}' > "$TMP/empty.c"
+
+text()
+{
+  $SIZE "$1" | awk 'NR == 2 { print $1 }'
+}
+
+build()
+{
+  $CC $CFLAGS -I. -idirafter "$TMP" -DLOGGING_CONFIG=LIGHT_WEIGHT "$@" -c "$TMP/sites.c" -o "$TMP/sites.o" &&
+  $CC $CFLAGS -I. -idirafter "$TMP" -DLOGGING_CONFIG=LIGHT_WEIGHT "$@" -c "$TMP/empty.c" -o "$TMP/empty.o" &&
+  $CC $CFLAGS -I. -idirafter "$TMP" -DLOGGING_CONFIG=LIGHT_WEIGHT "$@" -c logging.c -o "$TMP/logging.o" &&
+  $CC $CFLAGS -I. -idirafter "$TMP" -DLOGGING_CONFIG=LIGHT_WEIGHT "$@" -c logging_fmt.c -o "$TMP/logging_fmt.o" || exit 1
+  site=$(( ($(text "$TMP/sites.o") - $(text "$TMP/empty.o")) / SITES ))
+  shared=$(( $(text "$TMP/logging.o") + $(text "$TMP/logging_fmt.o") ))
+}
+
+printf "%-8s %10s %12s\n" "" "per site" "logging*.c"
+build -DLW_THUNK_ON=0 "$@"
+printf "%-8s %10d %12d\n" "inline" $site $shared
+inline_site=$site
+inline_shared=$shared
+build -DLW_THUNK_ON=1 "$@"
+printf "%-8s %10d %12d\n" "thunk" $site $shared
+if [ $site -lt $inline_site ]; then
+  printf "thunk saves flash from %d call sites on\n" \
+         $(( (shared - inline_shared) / (inline_site - site) + 1 ))
+fi
@@ -0,0 +1,209 @@
+/*************************************************************************
+ *  @file rtt_copy_bench.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Checks and benchmarks the RTT ring copy engine against memcpy()
+ *  and the byte loop (SEGGER_RTT_MEMCPY_USE_BYTELOOP) over every size from 1
+ *  to 160 bytes, every source and destination alignment, and writes that
+ *  cross the wrap point of the ring.
+ *
+ *  Build: cc -O2 -o rtt_copy_bench tools/rtt_copy_bench.c
+ *  Add -D_RTT_USE_SSE2=0 for the Cortex-M3 word path, and also
+ *  -D_RTT_UNALIGNED_OK=0 for the Cortex-M0 one.
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/* The engine is static to SEGGER_RTT.c */
+#include "../segger_rtt/SEGGER_RTT.c"
+
+/* Defines  *********************************************************** */
+#define SIZE_MAX_BENCH          160
+#define ALIGN_NUM               8
+#define REPS                    2000
+#define RING_SIZE               256
+
+/**
+ * @brief copy method under test
+ */
+typedef void (*copy_fn_t)(char *, const char *, unsigned);
+
+/**
+ * @brief size classes of the report
+ */
+static const unsigned classes[][2] = {
+  { 1, 7 }, { 8, 15 }, { 16, 31 }, { 32, 63 }, { 64, 127 }, { 128, 160 }
+};
+#define CLASS_NUM               (sizeof(classes) / sizeof(classes[0]))
+
+/* Static Functions *************************************************** */
+static void __attribute__((noinline)) copy_memcpy(char       *d,
+                                                   const char *s,
+                                                   unsigned   n)
+{
+  memcpy(d, s, n);
+}
+
+static void __attribute__((noinline)) copy_byteloop(char       *d,
+                                                     const char *s,
+                                                     unsigned   n)
+{
+  /* Same loop as SEGGER_RTT_MEMCPY_USE_BYTELOOP, kept from vectorizing */
+  while (n--) {
+    *(volatile char *)d++ = *s++;
+  }
+}
+
+static void __attribute__((noinline)) copy_ring(char       *d,
+                                                 const char *s,
+                                                 unsigned   n)
+{
+  _RingCopy(d, s, n);
+}
+
+static copy_fn_t volatile methods[] = { copy_memcpy, copy_byteloop, copy_ring };
+static const char         *names[]  = { "memcpy", "byteloop", "ringcopy" };
+#define METHOD_NUM              (sizeof(methods) / sizeof(methods[0]))
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief check every size and alignment, including the bytes around the
+ * destination
+ */
+static int check(void)
+{
+  static char src[SIZE_MAX_BENCH + 64], dst[SIZE_MAX_BENCH + 64];
+  int         errors = 0;
+
+  for (unsigned i = 0; i < sizeof(src); i++) {
+    src[i] = (char)(i * 7 + 1);
+  }
+  for (unsigned n = 0; n <= SIZE_MAX_BENCH; n++) {
+    for (unsigned sa = 0; sa < 16; sa++) {
+      for (unsigned da = 0; da < 16; da++) {
+        memset(dst, 0x5A, sizeof(dst));
+        _RingCopy(dst + 16 + da, src + sa, n);
+        for (unsigned i = 0; i < sizeof(dst); i++) {
+          char want = (i >= 16 + da && i < 16 + da + n) ? src[sa + i - 16 - da] : 0x5A;
+          if (dst[i] != want) {
+            if (errors++ < 10) {
+              printf("mismatch: n %u src +%u dst +%u at %u\n", n, sa, da, i);
+            }
+            break;
+          }
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+/**
+ * @brief check and time wrapped writes, the ring starts at every offset
+ * within the last SIZE_MAX_BENCH bytes
+ */
+static int wrap(void)
+{
+  static char          ring[RING_SIZE], src[SIZE_MAX_BENCH];
+  SEGGER_RTT_BUFFER_UP r = { "bench", ring, RING_SIZE, 0, 0, 0 };
+  double               t_old = 0, t_new = 0, t0;
+  int                  errors = 0;
+
+  for (unsigned i = 0; i < sizeof(src); i++) {
+    src[i] = (char)(i * 3 + 1);
+  }
+  for (unsigned n = 1; n < SIZE_MAX_BENCH; n++) {
+    for (unsigned off = RING_SIZE - n; off < RING_SIZE; off++) {
+      unsigned rem = RING_SIZE - off, wr;
+
+      /* Two memcpy() calls as _WriteNoCheck() did before */
+      t0 = now_ns();
+      for (int k = 0; k < REPS / 10; k++) {
+        methods[0](ring + off, src, rem);
+        methods[0](ring, src + rem, n - rem);
+      }
+      t_old += now_ns() - t0;
+
+      memset(ring, 0, sizeof(ring));
+      t0 = now_ns();
+      for (int k = 0; k < REPS / 10; k++) {
+        wr = _RingWrite(&r, off, src, n);
+      }
+      t_new += now_ns() - t0;
+      for (unsigned i = 0; i < n; i++) {
+        if (ring[(off + i) % RING_SIZE] != src[i] || wr != (off + n) % RING_SIZE) {
+          errors++;
+          break;
+        }
+      }
+    }
+  }
+  printf("\nwrapped writes, all sizes and split points: memcpy x2 %.2f ns, ringwrite %.2f ns\n",
+         t_old / (REPS / 10) / (SIZE_MAX_BENCH * (SIZE_MAX_BENCH - 1) / 2),
+         t_new / (REPS / 10) / (SIZE_MAX_BENCH * (SIZE_MAX_BENCH - 1) / 2));
+  return errors;
+}
+
+int main(void)
+{
+  static char src[SIZE_MAX_BENCH + 64], dst[SIZE_MAX_BENCH + 64];
+  double      t[METHOD_NUM][CLASS_NUM][2] = { 0 };
+  unsigned    cnt[CLASS_NUM][2] = { 0 };
+  int         errors;
+
+  errors = check();
+  printf("check: %s\n\n", errors ? "FAILED" : "ok");
+
+  for (unsigned n = 1; n <= SIZE_MAX_BENCH; n++) {
+    unsigned c = 0;
+
+    while (n > classes[c][1]) {
+      c++;
+    }
+    for (unsigned sa = 0; sa < ALIGN_NUM; sa++) {
+      for (unsigned da = 0; da < ALIGN_NUM; da++) {
+        unsigned aligned = ((sa ^ da) & 3) == 0;
+
+        for (unsigned m = 0; m < METHOD_NUM; m++) {
+          double t0 = now_ns();
+
+          for (int k = 0; k < REPS; k++) {
+            methods[m](dst + da, src + sa, n);
+          }
+          t[m][c][aligned] += now_ns() - t0;
+        }
+        cnt[c][aligned]++;
+      }
+    }
+  }
+
+  printf("ns per copy  %-10s", "size");
+  for (unsigned m = 0; m < METHOD_NUM; m++) {
+    printf(" %9s %9s", names[m], "");
+  }
+  printf("\n%-22s", "");
+  for (unsigned m = 0; m < METHOD_NUM; m++) {
+    printf(" %9s %9s", "co-align", "misalign");
+  }
+  printf("\n");
+  for (unsigned c = 0; c < CLASS_NUM; c++) {
+    printf("             %3u..%-5u", classes[c][0], classes[c][1]);
+    for (unsigned m = 0; m < METHOD_NUM; m++) {
+      printf(" %9.2f %9.2f", t[m][c][1] / REPS / cnt[c][1], t[m][c][0] / REPS / cnt[c][0]);
+    }
+    printf("\n");
+  }
+
+  errors += wrap();
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/*************************************************************************
+ *  @file rtt_sim.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdlib.h>
+#include <string.h>
+#include "../segger_rtt/SEGGER_RTT.h"
+#include "rtt_sim.h"
+
+/* Defines  *********************************************************** */
+#define MARK_MAX                4096
+
+/**
+ * @brief data written up to a point in time
+ */
+typedef struct {
+  uint64_t pos;  /**< Bytes written in total */
+  uint64_t time; /**< Virtual time of the mark */
+}mark_t;
+
+/* Static Variables *************************************************** */
+static rtt_sim_cfg_t   cfg;
+static rtt_sim_stats_t st;
+static uint64_t        next_poll;   /**< Virtual time of the next poll */
+static uint64_t        budget_frac; /**< Drain budget carried over, in bytes * 1e6 */
+static unsigned        last_wr;     /**< Write offset at the last sample */
+static mark_t          marks[MARK_MAX];
+static unsigned        mark_head, mark_num;
+
+/* Static Functions *************************************************** */
+/**
+ * @brief count the bytes written since the last sample
+ */
+static void sample_written(SEGGER_RTT_BUFFER_UP *u)
+{
+  unsigned wr = u->WrOff;
+
+  st.written += (wr + u->SizeOfBuffer - last_wr) % u->SizeOfBuffer;
+  last_wr     = wr;
+}
+
+/**
+ * @brief check if the probe polls at a given time
+ */
+static int polls_at(uint64_t t)
+{
+  if (!cfg.attached) {
+    return 0;
+  }
+  for (unsigned i = 0; i < cfg.stall_num; i++) {
+    if (t >= cfg.stall[i].start && t < cfg.stall[i].start + cfg.stall[i].len) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief one poll of the probe at next_poll
+ */
+static void poll(void)
+{
+  SEGGER_RTT_BUFFER_UP *u = &_SEGGER_RTT.aUp[cfg.channel];
+  unsigned             rd = u->RdOff, wr = u->WrOff, used, n;
+
+  sample_written(u);
+  used        = (wr + u->SizeOfBuffer - rd) % u->SizeOfBuffer;
+  st.max_used = used > st.max_used ? used : st.max_used;
+  st.polls++;
+
+  if (cfg.rate) {
+    /* Unused budget is not saved up beyond one period */
+    budget_frac = budget_frac % 1000000u + (uint64_t)cfg.rate * cfg.poll_us;
+    n           = (unsigned)(budget_frac / 1000000u < used ? budget_frac / 1000000u : used);
+    budget_frac -= (uint64_t)n * 1000000u;
+  } else {
+    n = used;
+  }
+
+  for (unsigned i = 0; i < n; i++) {
+    if (cfg.capture) {
+      fputc(u->pBuffer[rd], cfg.capture);
+    }
+    rd = (rd + 1) % u->SizeOfBuffer;
+  }
+  u->RdOff    = rd;
+  st.drained += n;
+
+  while (mark_num && marks[mark_head].pos <= st.drained) {
+    uint64_t lat = next_poll - marks[mark_head].time;
+
+    st.lat_num++;
+    st.lat_sum += lat;
+    st.lat_max  = lat > st.lat_max ? lat : st.lat_max;
+    mark_head   = (mark_head + 1) % MARK_MAX;
+    mark_num--;
+  }
+}
+
+/* Public Functions *************************************************** */
+void rtt_sim_init(const rtt_sim_cfg_t *c)
+{
+  cfg = *c;
+  if (!cfg.poll_us) {
+    cfg.poll_us = 1000;
+  }
+  memset(&st, 0, sizeof(st));
+  next_poll   = 0;
+  budget_frac = 0;
+  mark_head   = 0;
+  mark_num    = 0;
+  last_wr     = _SEGGER_RTT.aUp[cfg.channel].WrOff;
+  _SEGGER_RTT.aUp[cfg.channel].RdOff = last_wr;
+}
+
+void rtt_sim_advance(uint64_t us)
+{
+  uint64_t end = st.now + us;
+
+  while (next_poll <= end) {
+    st.now = next_poll;
+    if (polls_at(next_poll)) {
+      poll();
+    }
+    next_poll += cfg.poll_us;
+  }
+  st.now = end;
+}
+
+void rtt_sim_mark(void)
+{
+  sample_written(&_SEGGER_RTT.aUp[cfg.channel]);
+  if (mark_num == MARK_MAX) {
+    /* Oldest mark is dropped, its latency is not measured */
+    mark_head = (mark_head + 1) % MARK_MAX;
+    mark_num--;
+  }
+  marks[(mark_head + mark_num) % MARK_MAX].pos  = st.written;
+  marks[(mark_head + mark_num) % MARK_MAX].time = st.now;
+  mark_num++;
+}
+
+unsigned rtt_sim_inject(unsigned   channel,
+                        const void *data,
+                        unsigned   len)
+{
+  SEGGER_RTT_BUFFER_DOWN *d = &_SEGGER_RTT.aDown[channel];
+  const char             *p = data;
+  unsigned               wr = d->WrOff, n = 0;
+
+  while (n < len && (wr + 1) % d->SizeOfBuffer != d->RdOff) {
+    d->pBuffer[wr] = p[n++];
+    wr             = (wr + 1) % d->SizeOfBuffer;
+  }
+  d->WrOff = wr;
+  return n;
+}
+
+void rtt_sim_wait(void)
+{
+  uint64_t t = next_poll;
+
+  /* Find the next poll which happens, the stalls are finite */
+  while (!polls_at(t)) {
+    if (!cfg.attached || t - next_poll > 3600ull * 1000000u) {
+      fprintf(stderr, "rtt_sim: blocking write with no probe reading\n");
+      exit(3);
+    }
+    t += cfg.poll_us;
+  }
+  st.blocked_us += t - st.now;
+  rtt_sim_advance(t - st.now);
+}
+
+void rtt_sim_stats(rtt_sim_stats_t *stats)
+{
+  sample_written(&_SEGGER_RTT.aUp[cfg.channel]);
+  *stats = st;
+}
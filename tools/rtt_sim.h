@@ -0,0 +1,111 @@
+/*************************************************************************
+ *  @file rtt_sim.h
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Host-side simulation of a debug probe reading the RTT control
+ *  block of a host build, driven by a virtual clock so the runs are
+ *  deterministic. The probe polls an up-buffer every poll period and drains
+ *  it at a limited byte rate, can stall for given time windows or be absent
+ *  altogether, and can inject data into the down-buffers.
+ *
+ *  Build SEGGER_RTT.c with -DSEGGER_RTT_WAIT_HOOK=rtt_sim_wait so writes in
+ *  BLOCK_IF_FIFO_FULL mode advance the virtual clock while they wait.
+ ************************************************************************/
+
+#ifndef RTT_SIM_H
+#define RTT_SIM_H
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Defines  *********************************************************** */
+#define RTT_SIM_STALL_MAX       8
+
+/**
+ * @brief probe configuration
+ */
+typedef struct {
+  unsigned channel;          /**< Up-buffer to drain */
+  uint32_t rate;             /**< Bytes drained per second, 0 for unlimited */
+  uint32_t poll_us;          /**< Polling period in microseconds */
+  uint8_t  attached;         /**< 0 if no probe is attached, nothing is ever drained */
+  FILE     *capture;         /**< Drained bytes are written here, may be NULL */
+  struct {
+    uint64_t start;          /**< Start of the stall in microseconds */
+    uint64_t len;            /**< Length of the stall in microseconds */
+  }        stall[RTT_SIM_STALL_MAX];
+  unsigned stall_num;        /**< Number of stalls */
+}rtt_sim_cfg_t;
+
+/**
+ * @brief probe statistics
+ */
+typedef struct {
+  uint64_t now;              /**< Virtual time in microseconds */
+  uint64_t polls;            /**< Polls done */
+  uint64_t written;          /**< Bytes written by the target */
+  uint64_t drained;          /**< Bytes drained by the probe */
+  uint32_t max_used;         /**< Peak fill of the up-buffer seen by the probe */
+  uint64_t blocked_us;       /**< Time the target spent waiting in blocking writes */
+  uint64_t lat_num;          /**< Marks drained */
+  uint64_t lat_sum;          /**< Sum of the latencies from a mark to its drain in microseconds */
+  uint64_t lat_max;          /**< Maximum latency in microseconds */
+}rtt_sim_stats_t;
+
+/**
+ * @brief rtt_sim_init attach the probe to the RTT control block and reset the
+ * virtual clock, call it after the RTT is initialized
+ *
+ * @param cfg - probe configuration
+ */
+void rtt_sim_init(const rtt_sim_cfg_t *cfg);
+
+/**
+ * @brief rtt_sim_advance advance the virtual clock, doing the polls due in
+ * the meantime
+ *
+ * @param us - microseconds to advance
+ */
+void rtt_sim_advance(uint64_t us);
+
+/**
+ * @brief rtt_sim_mark mark the data written so far, the latency is measured
+ * from now until the probe has drained all of it. Call it after each record.
+ */
+void rtt_sim_mark(void);
+
+/**
+ * @brief rtt_sim_inject write data to a down-buffer as the probe does
+ *
+ * @param channel - down-buffer
+ * @param data - data
+ * @param len - number of bytes
+ *
+ * @return number of bytes which fit into the down-buffer
+ */
+unsigned rtt_sim_inject(unsigned   channel,
+                        const void *data,
+                        unsigned   len);
+
+/**
+ * @brief rtt_sim_wait advance the virtual clock to the next poll, the hook
+ * of the blocking writes. Exits with status 3 if the probe never polls
+ * again.
+ */
+void rtt_sim_wait(void);
+
+/**
+ * @brief rtt_sim_stats get the probe statistics
+ *
+ * @param stats - output statistics
+ */
+void rtt_sim_stats(rtt_sim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //RTT_SIM_H
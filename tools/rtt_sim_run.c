@@ -0,0 +1,243 @@
+/*************************************************************************
+ *  @file rtt_sim_run.c
+ *  @author Kevin
+ *  @date 2020-08-10
+ *  @note Runs a logging workload against the simulated probe of rtt_sim.c
+ *  and reports what the probe received, e.g. to compare the RTT modes or
+ *  buffer sizes under a slow or stalling probe.
+ *
+ *  Build:
+ *    cc -O2 -I. -DLOGGING_INTERFACE=SEGGER_RTT -DSTATS_ON=1 \
+ *       -DSEGGER_RTT_WAIT_HOOK=rtt_sim_wait -o rtt_sim_run \
+ *       tools/rtt_sim_run.c tools/rtt_sim.c logging*.c segger_rtt/SEGGER_RTT.c
+ *
+ *  Usage: rtt_sim_run [options]
+ *    -m skip|trim|block  RTT mode of the terminal buffer (skip)
+ *    -r <bytes/s>        drain rate of the probe, 0 for unlimited (1000000)
+ *    -p <us>             polling period of the probe (1000)
+ *    -s <start>:<len>    stall of the probe in us, up to 8 times
+ *    -n                  no probe attached
+ *    -c <count>          number of messages (10000)
+ *    -i <us>             time between messages (100)
+ *    -l <length>         message length in characters (40)
+ *    -a                  log the levels from WARNING to VERBOSE in turn
+ *                        instead of only IMPORTANT_INFO
+ *    -v                  vary the messages, a few formats with changing
+ *                        parameters in turn instead of a run of 'x' of the
+ *                        given length, e.g. to measure COMPRESS_ON
+ *    -d <us>:<file>      inject a file into down-buffer 1 at a time, then
+ *                        call logging_ctrl_poll() if CTRL_ON is set
+ *    -o <file>           write the drained bytes to a file
+ ************************************************************************/
+
+/* Includes *********************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logging.h"
+#include "rtt_sim.h"
+
+#if (STATS_ON == 0)
+#error "Build with -DSTATS_ON=1"
+#endif
+
+/* Static Functions *************************************************** */
+static void usage(void)
+{
+  fprintf(stderr, "usage: rtt_sim_run [-m skip|trim|block] [-r rate] [-p poll_us] "
+          "[-s start:len] [-n] [-c count] [-i interval_us] [-l length] [-a] [-v] "
+          "[-d us:file] [-o capture]\n");
+  exit(2);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+/**
+ * @brief log the i-th of a few messages of a BLE application in turn
+ */
+static void log_varied(unsigned long i)
+{
+  switch (i % 4) {
+    case 0:
+      LOGI("conn %u rssi %d peer 00:0b:57:%02x:%02x:%02x\n", (unsigned)(i % 8),
+           -40 - (int)(i % 37), (unsigned)(i & 0xFF), (unsigned)(i >> 8 & 0xFF), 0x5Au);
+      break;
+    case 1:
+      LOGI("gatt write handle %u len %u status 0x%04x\n", (unsigned)(i % 64),
+           (unsigned)(i % 20), i % 50 ? 0u : 0x0185u);
+      break;
+    case 2:
+      LOGI("adv set %u interval %u ms tx power %d dBm\n", (unsigned)(i % 2),
+           100 + (unsigned)(i % 5) * 25, (int)(i % 9) - 4);
+      break;
+    default:
+      LOGI("timer %lu fired after %lu ticks\n", i % 16, 32768 + i % 1000);
+      break;
+  }
+}
+
+int main(int  argc,
+         char **argv)
+{
+  rtt_sim_cfg_t   cfg     = { .rate = 1000000, .poll_us = 1000, .attached = 1 };
+  unsigned        mode    = SEGGER_RTT_MODE_NO_BLOCK_SKIP;
+  unsigned long   count   = 10000, interval = 100, length = 40;
+  unsigned long   inject_at = 0;
+  int             all       = 0, varied = 0;
+  uint64_t        cpu_ns    = 0, emitted;
+  const char      *inject = NULL;
+  char            msg[1024];
+  logging_stats_t ls;
+  rtt_sim_stats_t ss;
+
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i], *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (!strcmp(a, "-n")) {
+      cfg.attached = 0;
+      continue;
+    }
+    if (!strcmp(a, "-a")) {
+      all = 1;
+      continue;
+    }
+    if (!strcmp(a, "-v")) {
+      varied = 1;
+      continue;
+    }
+    if (!v || a[0] != '-' || a[2]) {
+      usage();
+    }
+    i++;
+    switch (a[1]) {
+      case 'm':
+        mode = !strcmp(v, "trim") ? SEGGER_RTT_MODE_NO_BLOCK_TRIM
+               : !strcmp(v, "block") ? SEGGER_RTT_MODE_BLOCK_IF_FIFO_FULL
+               : SEGGER_RTT_MODE_NO_BLOCK_SKIP;
+        break;
+      case 'r':
+        cfg.rate = strtoul(v, NULL, 0);
+        break;
+      case 'p':
+        cfg.poll_us = strtoul(v, NULL, 0);
+        break;
+      case 's':
+        if (cfg.stall_num == RTT_SIM_STALL_MAX
+            || sscanf(v, "%llu:%llu",
+                      (unsigned long long *)&cfg.stall[cfg.stall_num].start,
+                      (unsigned long long *)&cfg.stall[cfg.stall_num].len) != 2) {
+          usage();
+        }
+        cfg.stall_num++;
+        break;
+      case 'c':
+        count = strtoul(v, NULL, 0);
+        break;
+      case 'i':
+        interval = strtoul(v, NULL, 0);
+        break;
+      case 'l':
+        length = strtoul(v, NULL, 0);
+        break;
+      case 'd':
+        inject_at = strtoul(v, NULL, 0);
+        inject    = strchr(v, ':');
+        if (!inject) {
+          usage();
+        }
+        inject++;
+        break;
+      case 'o':
+        cfg.capture = fopen(v, "wb");
+        if (!cfg.capture) {
+          perror(v);
+          return 1;
+        }
+        break;
+      default:
+        usage();
+    }
+  }
+  length = length < sizeof(msg) - 1 ? length : sizeof(msg) - 1;
+  memset(msg, 'x', length);
+  msg[length] = '\0';
+
+  logging_init(LOGGING_VERBOSE);
+  SEGGER_RTT_SetFlagsUpBuffer(0, mode);
+  rtt_sim_init(&cfg);
+  logging_stats_reset();
+
+  for (unsigned long i = 0; i < count; i++) {
+    if (inject && (unsigned long long)i * interval >= inject_at) {
+      FILE     *f = fopen(inject, "rb");
+      char     buf[256];
+      unsigned n  = f ? (unsigned)fread(buf, 1, sizeof(buf), f) : 0;
+
+      if (f) {
+        fclose(f);
+      }
+      printf("injected %u of %u bytes\n", rtt_sim_inject(1, buf, n), n);
+#if (CTRL_ON != 0)
+      logging_ctrl_poll();
+#endif
+      inject = NULL;
+    }
+    uint64_t t0 = now_ns();
+
+    if (varied) {
+      log_varied(i);
+    } else if (all) {
+      __log(__FILE__, __LINE__, LOGGING_WARNING + i % (LOGGING_LEVEL_NUM - LOGGING_WARNING),
+            "%06lu %s\n", i, msg);
+    } else {
+      LOGI("%06lu %s\n", i, msg);
+    }
+    cpu_ns += now_ns() - t0;
+    rtt_sim_mark();
+    rtt_sim_advance(interval);
+  }
+  /* Let the probe catch up */
+  rtt_sim_advance(10ull * 1000000u);
+
+  logging_stats_get(&ls);
+  rtt_sim_stats(&ss);
+  for (int l = 0; l < LOGGING_LEVEL_NUM; l++) {
+    if (!ls.level[l].calls) {
+      continue;
+    }
+    printf("level %d   emitted %lu truncated %lu dropped %lu filtered %lu\n", l,
+           (unsigned long)ls.level[l].emitted,
+           (unsigned long)ls.level[l].truncated,
+           (unsigned long)ls.level[l].dropped,
+           (unsigned long)ls.level[l].filtered);
+  }
+  printf("bytes     written %llu drained %llu\n",
+         (unsigned long long)ss.written, (unsigned long long)ss.drained);
+  printf("probe     polls %llu peak fill %lu/%u blocked %llu us\n",
+         (unsigned long long)ss.polls, (unsigned long)ss.max_used,
+         _SEGGER_RTT.aUp[0].SizeOfBuffer - 1, (unsigned long long)ss.blocked_us);
+  printf("latency   avg %llu us max %llu us over %llu records\n",
+         (unsigned long long)(ss.lat_num ? ss.lat_sum / ss.lat_num : 0),
+         (unsigned long long)ss.lat_max, (unsigned long long)ss.lat_num);
+
+  /* Records through the link per second of the run, CPU time of the host */
+  emitted = 0;
+  for (int l = 0; l < LOGGING_LEVEL_NUM; l++) {
+    emitted += ls.level[l].emitted;
+  }
+  printf("delivered %.0f records/s, %.1f bytes per record on the link\n",
+         count && interval ? emitted * 1e6 / ((double)count * interval) : 0.0,
+         emitted ? (double)ss.drained / emitted : 0.0);
+  printf("cpu       %.0f ns per call\n", count ? (double)cpu_ns / count : 0.0);
+  if (cfg.capture) {
+    fclose(cfg.capture);
+  }
+  return 0;
+}